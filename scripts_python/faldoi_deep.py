@@ -11,8 +11,6 @@ import shlex
 import subprocess
 import time  # added for 'profiling'
 
-from auxiliar_faldoi_functions import cut_deep_list as cut
-from auxiliar_faldoi_functions import delete_outliers as delete
 from rescore_prunning import confidence_values as confi
 
 # Start global timer
@@ -299,9 +297,10 @@ else:
 
 # Create a sparse flow from the deep matches.
 if sparse_flow:
-    param_fwd = "{} {} {} {}\n".format(cut(delete(confi(im_name0, im_name1, match_name_1, f_path), threshold)), width_im, height_im, sparse_name_1)
+    # Outliers (score <= threshold) are dropped by sparse_flow itself ('-min_score')
+    param_fwd = "{} {} {} {} -layout deep -min_score {}\n".format(confi(im_name0, im_name1, match_name_1, f_path), width_im, height_im, sparse_name_1, threshold)
     command_line_fwd = "{} {}\n".format(sparse_flow, param_fwd)
-    param_bwd = "{} {} {} {}\n".format(cut(delete(confi(im_name1, im_name0, match_name_2, f_path),threshold)), width_im, height_im, sparse_name_2)
+    param_bwd = "{} {} {} {} -layout deep -min_score {}\n".format(confi(im_name1, im_name0, match_name_2, f_path), width_im, height_im, sparse_name_2, threshold)
     command_line_bwd = "{} {}\n".format(sparse_flow, param_bwd)
     # Execute in parallel
     # Define processes to be run in parallel
@@ -11,7 +11,6 @@ import sys
 import time  # added for 'profiling'
 import multiprocessing
 
-from auxiliar_faldoi_functions import cut_matching_list as cut
 
 # Start global timer
 init_sift = time.time()
@@ -263,14 +262,15 @@ else:
 
 # Create a sparse flow from the sift matches.
 if sparse_flow_val:
-    param = "{} {} {} {}".format(cut(match_name_1), width_im, height_im, sparse_name_1)
-    
-# If we use custom matches that are already filtered, cut needs to be avoided
+    # sparse_flow reorders the columns of match_cli's output itself ('-layout sift')
+    param = "{} {} {} {} -layout sift".format(match_name_1, width_im, height_im, sparse_name_1)
+
+# If we use custom matches that are already filtered, the layout is the default one ('cut')
     #param = "{} {} {} {}".format(match_name_1, width_im, height_im, sparse_name_1)    
     command_line = "{} {}".format(sparse_flow, param)
     os.system(command_line)
     # Create a sparse flow from the sift matches (img I1).
-    param = "{} {} {} {}".format(cut(match_name_2), width_im, height_im, sparse_name_2)
+    param = "{} {} {} {} -layout sift".format(match_name_2, width_im, height_im, sparse_name_2)
     #param = "{} {} {} {}".format(match_name_2, width_im, height_im, sparse_name_2)
     command_line = "{} {}".format(sparse_flow, param)
     os.system(command_line)
@@ -0,0 +1,126 @@
+#include "MotionBackend.h"
+#include "faldoi_pipeline.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// Any OpenCV dense flow
+class OpenCVMotionBackend : public MotionBackend {
+public:
+    explicit OpenCVMotionBackend(Ptr<DenseOpticalFlow> flow) : m_flow(flow) {}
+
+    void Estimate(const Mat& prev_gray, const Mat& gray, Mat& flow_x, Mat& flow_y) override {
+        m_flow->calc(prev_gray, gray, m_flow_mat);
+        
+        // Split flow into X and Y components
+        split(m_flow_mat, m_flow_parts);
+        m_flow_parts[0].copyTo(flow_x);
+        m_flow_parts[1].copyTo(flow_y);
+    }
+
+private:
+    Ptr<DenseOpticalFlow> m_flow;
+    Mat m_flow_mat;
+    vector<Mat> m_flow_parts;
+};
+
+// FALDOI in process (faldoi_pipeline): SIFT seeds, local growing and optionally the global
+// refinement, with no files or processes in between. The float frames and the flow live in
+// buffers kept from call to call, and the keypoints of `gray` are kept for the next pair,
+// whose first frame it is when the frames come in order.
+class FaldoiMotionBackend : public MotionBackend {
+public:
+    FaldoiMotionBackend(bool local_only, int threads) : m_threads(threads) {
+        m_opt.local_only = local_only;
+    }
+
+    ~FaldoiMotionBackend() override {
+        if (m_keys) {
+            faldoi_free_keypoints(m_keys);
+        }
+    }
+
+    void Estimate(const Mat& prev_gray, const Mat& gray, Mat& flow_x, Mat& flow_y) override {
+#ifdef _OPENMP
+        // Per calling thread, like the jobs of faldoi_batch
+        if (m_threads > 0) {
+            omp_set_num_threads(m_threads);
+        }
+#endif
+        const int w = gray.cols, h = gray.rows;
+        const size_t size = size_t(w) * h;
+        if (m_i0.size() != size) {
+            m_i0.resize(size);
+            m_i1.resize(size);
+            m_flow.resize(2 * size);
+        }
+        Mat i0(h, w, CV_32F, m_i0.data());
+        Mat i1(h, w, CV_32F, m_i1.data());
+        prev_gray.convertTo(i0, CV_32F);
+        gray.convertTo(i1, CV_32F);
+
+        // Compared by content: callers may reuse their buffers
+        struct sift_keypoints *k0 = nullptr;
+        if (m_keys && prev_gray.size() == m_keys_frame.size() && norm(prev_gray, m_keys_frame, NORM_INF) == 0) {
+            k0 = m_keys;
+        } else {
+            if (m_keys) {
+                faldoi_free_keypoints(m_keys);
+            }
+            k0 = faldoi_frame_keypoints(m_i0.data(), w, h, 1, m_opt);
+        }
+        m_keys = faldoi_frame_keypoints(m_i1.data(), w, h, 1, m_opt);
+        gray.copyTo(m_keys_frame);
+        faldoi_match_keypoints(k0, m_keys, m_opt, m_fwd, m_bwd, nullptr);
+        faldoi_free_keypoints(k0);
+
+        faldoi_pipeline(m_i0.data(), m_i1.data(), nullptr, nullptr, w, h, 1, m_opt, &m_fwd, &m_bwd,
+                        m_flow.data(), nullptr, nullptr, nullptr);
+        // The local step leaves NaN where no seed grew (or a candidate was pruned): no motion there
+        Mat u(h, w, CV_32F, m_flow.data()), v(h, w, CV_32F, m_flow.data() + size);
+        patchNaNs(u, 0);
+        patchNaNs(v, 0);
+        u.copyTo(flow_x);
+        v.copyTo(flow_y);
+    }
+
+private:
+    int m_threads;
+    FaldoiPipelineOptions m_opt;
+    vector<float> m_i0, m_i1, m_flow;
+    MatchList m_fwd, m_bwd;
+    struct sift_keypoints *m_keys = nullptr;
+    Mat m_keys_frame;    // copy of the frame m_keys were computed on
+};
+
+}
+
+unique_ptr<MotionBackend> CreateMotionBackend(const string& name, int threads) {
+    if (name == "dis_ultrafast") {
+        return unique_ptr<MotionBackend>(new OpenCVMotionBackend(DISOpticalFlow::create(DISOpticalFlow::PRESET_ULTRAFAST)));
+    }
+    if (name == "dis_fast") {
+        return unique_ptr<MotionBackend>(new OpenCVMotionBackend(DISOpticalFlow::create(DISOpticalFlow::PRESET_FAST)));
+    }
+    if (name == "dis_medium") {
+        return unique_ptr<MotionBackend>(new OpenCVMotionBackend(DISOpticalFlow::create(DISOpticalFlow::PRESET_MEDIUM)));
+    }
+    if (name == "farneback") {
+        return unique_ptr<MotionBackend>(new OpenCVMotionBackend(FarnebackOpticalFlow::create()));
+    }
+    if (name == "faldoi_local" || name == "faldoi") {
+        return unique_ptr<MotionBackend>(new FaldoiMotionBackend(name == "faldoi_local", threads));
+    }
+    return nullptr;
+}
+
+const vector<string>& MotionBackendNames() {
+    static const vector<string> names = {"dis_ultrafast", "dis_fast", "dis_medium", "farneback", "faldoi_local", "faldoi"};
+    return names;
+}
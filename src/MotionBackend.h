@@ -0,0 +1,27 @@
+#ifndef __MotionBackend__
+#define __MotionBackend__
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Dense motion between two gray frames (CV_8UC1, same size), as flow_x and flow_y (CV_32F)
+// such that prev_gray(y, x) ~ gray(y + flow_y, x + flow_x). Backends keep state and workspaces
+// from call to call, so every thread needs its own instance.
+class MotionBackend {
+public:
+    virtual ~MotionBackend() {}
+    virtual void Estimate(const cv::Mat& prev_gray, const cv::Mat& gray, cv::Mat& flow_x, cv::Mat& flow_y) = 0;
+};
+
+// "dis_ultrafast", "dis_fast", "dis_medium" (DIS presets), "farneback", "faldoi_local"
+// (FALDOI local step) or "faldoi" (local and global steps); null if the name is unknown.
+// `threads` caps the OpenMP team of every FALDOI call (0: the OpenMP default), so several
+// instances running at once can share the cores.
+std::unique_ptr<MotionBackend> CreateMotionBackend(const std::string& name, int threads = 0);
+
+// Every name CreateMotionBackend accepts
+const std::vector<std::string>& MotionBackendNames();
+
+#endif
@@ -4,32 +4,57 @@
 using namespace std;
 using namespace cv;
 
-MotionDenoiser::MotionDenoiser(const std::vector<cv::Mat>& frames) {
-    if (frames.empty()) {
-        throw runtime_error("No frames provided");
+// Plane 0 (Y), 1 (U) or 2 (V) of an I420 frame of width x height pixels
+static Mat i420_plane(const Mat& frame, int plane, int width, int height) {
+    uchar* data = const_cast<uchar*>(frame.data);
+    if (plane == 0) {
+        return Mat(height, width, CV_8UC1, data);
+    }
+    const size_t luma = size_t(width) * height;
+    return Mat(height / 2, width / 2, CV_8UC1, data + luma + (plane - 1) * (luma / 4));
+}
+
+MotionDenoiser::MotionDenoiser(cv::Size size, FrameSink sink, FrameLayout layout, DenoiseMode mode) {
+    if (size.area() == 0) {
+        throw runtime_error("Empty frame size");
+    }
+    if (layout == FRAME_I420 && (size.width % 2 || size.height % 2)) {
+        throw runtime_error("I420 frames need an even size");
     }
     
-    m_frames = frames;
-    m_size = m_frames[0].size();
+    m_size = size;
+    m_layout = layout;
+    m_mode = mode;
     m_height = m_size.height;
     m_width = m_size.width;
-    m_frameNum = m_frames.size();
+    m_frameNum = 0;
+    m_emitted = 0;
+    m_sink = sink;
+    m_start = clock();
     
-    cout << "Initializing MotionDenoiser with " << m_frameNum << " frames" << endl;
+    cout << "Initializing MotionDenoiser (streaming, " << 2 * N + 1 << " frames in memory)" << endl;
     cout << "Frame size: " << m_width << "x" << m_height << endl;
     
-    // Initialize output frames
-    m_denoised_frames.resize(m_frameNum);
-    for (int i = 0; i < m_frameNum; i++) {
-        m_denoised_frames[i].create(m_size, CV_8UC3);
+    // Ring of input frames (a whole window around the reference)
+    const Size frame_size = m_layout == FRAME_I420 ? Size(m_width, m_height * 3 / 2) : m_size;
+    const int frame_type = m_layout == FRAME_I420 ? CV_8UC1 : CV_8UC3;
+    m_frames.resize(2 * N + 1);
+    for (int i = 0; i < 2 * N + 1; i++) {
+        m_frames[i].create(frame_size, frame_type);
     }
+    m_denoised.create(frame_size, frame_type);
+    m_previous.create(frame_size, frame_type);
     
-    // Initialize optical flow matrices
-    map_X.resize(m_frameNum - 1);
-    map_Y.resize(m_frameNum - 1);
-    for (int i = 0; i < m_frameNum - 1; i++) {
+    // Ring of optical flow matrices (the pairs of a window)
+    map_X.resize(2 * N);
+    map_Y.resize(2 * N);
+    back_X.resize(2 * N);
+    back_Y.resize(2 * N);
+    for (int i = 0; i < 2 * N; i++) {
         map_X[i].create(m_size, CV_32F);
         map_Y[i].create(m_size, CV_32F);
+        back_X[i].create(m_size, CV_32F);
+        back_Y[i].create(m_size, CV_32F);
     }
     
     // Initialize temporary flow matrices
@@ -43,13 +68,14 @@ MotionDenoiser::MotionDenoiser(const std::vector<cv::Mat>& frames) {
     }
     
     // Initialize other matrices
-    m_mask.create(m_size, CV_32FC1);
-    m_dst_temp = Mat::zeros(m_size, CV_32FC3);
-    m_diff = Mat::zeros(m_size, CV_32FC1);
-    m_temp = Mat::zeros(m_size, CV_8UC3);
+    m_warped.resize(2 * N);
+    for (int i = 0; i < 2 * N; i++) {
+        m_warped[i].create(frame_size, frame_type);
+    }
     m_mapedX = Mat::zeros(m_size, CV_32FC3);
     m_mapedY = Mat::zeros(m_size, CV_32FC3);
-    m_Counter_adder = Mat::ones(m_size, CV_32F);
+    m_warpX.create(m_size, CV_32F);
+    m_warpY.create(m_size, CV_32F);
     
     // Initialize coordinate matrices
     formatX = Mat::zeros(m_size, CV_32F);
@@ -60,205 +86,489 @@ MotionDenoiser::MotionDenoiser(const std::vector<cv::Mat>& frames) {
             formatY.at<float>(i, j) = i;
         }
     }
+    if (m_layout == FRAME_I420) {
+        formatHalfX = Mat::zeros(m_height / 2, m_width / 2, CV_32F);
+        formatHalfY = Mat::zeros(m_height / 2, m_width / 2, CV_32F);
+        for (int i = 0; i < m_height / 2; i++) {
+            for (int j = 0; j < m_width / 2; j++) {
+                formatHalfX.at<float>(i, j) = j;
+                formatHalfY.at<float>(i, j) = i;
+            }
+        }
+    }
     
-    // Initialize optical flow visualization
+    // Optical flow visualization is drawn on request only
     optical_flow_img.resize(2);  // [0] for color, [1] for arrows
-    optical_flow_img[0].resize(m_frameNum - 1);
-    optical_flow_img[1].resize(m_frameNum - 1);
-    for (int i = 0; i < m_frameNum - 1; i++) {
-        optical_flow_img[0][i].create(m_size, CV_8UC3);
-        optical_flow_img[1][i].create(m_size, CV_8UC3);
-    }
+    optical_flow_img[0].resize(2 * N);
+    optical_flow_img[1].resize(2 * N);
+    m_drawnPair.assign(2 * N, -1);
 }
 
-void MotionDenoiser::MotionEstimation() {
-    cout << "Starting motion estimation..." << endl;
-    
-    // Create optical flow object
-    Ptr<DenseOpticalFlow> flow = DISOpticalFlow::create(DISOpticalFlow::PRESET_MEDIUM);
+MotionEstimator::MotionEstimator(std::unique_ptr<MotionBackend> backend) {
+    SetBackend(std::move(backend));
+}
+
+void MotionEstimator::SetBackend(std::unique_ptr<MotionBackend> backend) {
+    m_backend = backend ? std::move(backend) : CreateMotionBackend("dis_medium");
+}
+
+bool MotionEstimator::Next(const cv::Mat& frame, cv::Mat& flow_x, cv::Mat& flow_y) {
+    // Each frame is converted to gray once: it is the current frame of this pair and the
+    // previous frame of the next one
+    swap(m_prev_gray, m_gray);
+    if (frame.type() == CV_8UC1) {
+        frame.rowRange(0, frame.rows * 2 / 3).copyTo(m_gray);
+    } else {
+        cvtColor(frame, m_gray, COLOR_BGR2GRAY);
+    }
+    if (m_prev_gray.empty()) {
+        return false;
+    }
     
-    for (int i = 1; i < m_frameNum; i++) {
-        Mat prev_gray, curr_gray;
-        cvtColor(m_frames[i-1], prev_gray, COLOR_BGR2GRAY);
-        cvtColor(m_frames[i], curr_gray, COLOR_BGR2GRAY);
-        
-        Mat flow_mat;
-        flow->calc(prev_gray, curr_gray, flow_mat);
-        
-        // Split flow into X and Y components
-        vector<Mat> flow_parts;
-        split(flow_mat, flow_parts);
-        flow_parts[0].copyTo(map_X[i-1]);
-        flow_parts[1].copyTo(map_Y[i-1]);
-        
-        // Generate flow visualization
-        Get_optical_flow_img(map_X[i-1], map_Y[i-1], 
-                           optical_flow_img[0][i-1], 
-                           optical_flow_img[1][i-1]);
-        
-        cout << "Computed flow for frames " << i-1 << " -> " << i << endl;
+    Estimate(m_prev_gray, m_gray, flow_x, flow_y);
+    return true;
+}
+
+void MotionEstimator::Estimate(const cv::Mat& prev_gray, const cv::Mat& gray, cv::Mat& flow_x, cv::Mat& flow_y) {
+    m_backend->Estimate(prev_gray, gray, flow_x, flow_y);
+}
+
+// Inverse of the flow of a pair, i+1 -> i on the grid of frame i+1: the fixed point of
+// B(y) = -F(y + B(y)), starting from -F. Computed once per pair, when the pair arrives.
+void MotionDenoiser::InvertFlow(int pair) {
+    Mat& bx = BackX(pair);
+    Mat& by = BackY(pair);
+    bx = -FlowX(pair);
+    by = -FlowY(pair);
+    for (int it = 0; it < 3; it++) {
+        m_mapedX = bx + formatX;
+        m_mapedY = by + formatY;
+        remap(FlowX(pair), m_warpX, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+        remap(FlowY(pair), m_warpY, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+        bx = -m_warpX;
+        by = -m_warpY;
     }
 }
 
+// dst = acc + flow(x + acc): the motion acc (reference -> k) followed by flow, which lives on
+// the grid of frame k. dst may be acc.
+void MotionDenoiser::Compose(const cv::Mat& acc_x, const cv::Mat& acc_y, const cv::Mat& flow_x, const cv::Mat& flow_y,
+                             cv::Mat& dst_x, cv::Mat& dst_y) {
+    m_mapedX = acc_x + formatX;
+    m_mapedY = acc_y + formatY;
+    remap(flow_x, m_warpX, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+    remap(flow_y, m_warpY, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+    add(acc_x, m_warpX, dst_x);
+    add(acc_y, m_warpY, dst_y);
+}
+
+// Motion from the reference to each neighbour, on the grid of the reference (remapping
+// neighbour k at x + motion aligns it with the reference). Each neighbour extends the motion
+// of the one next to it by one pair, so a window costs 2N - 2 compositions instead of
+// re-summing up to N flows per neighbour; the pair flows and their inverses are computed once
+// and reused by every window that contains them.
 void MotionDenoiser::AbsoluteMotion(int reference) {
-    // Compute absolute motion for frames before reference
-    for (int i = reference - N, k = 0; i < reference && k < N; i++, k++) {
-        if (i >= 0) {
-            temp_map_X[k] = map_X[i];
-            temp_map_Y[k] = map_Y[i];
-            for (int j = i + 1; j < reference; j++) {
-                temp_map_X[k] += map_X[j];
-                temp_map_Y[k] += map_Y[j];
-            }
+    // Frames after the reference (slots N..2N-1): forward flows
+    const int last = min(reference + N, m_frameNum - 1);
+    for (int k = reference + 1, m = N; k <= last; k++, m++) {
+        if (k == reference + 1) {
+            FlowX(reference).copyTo(temp_map_X[m]);
+            FlowY(reference).copyTo(temp_map_Y[m]);
+        } else {
+            Compose(temp_map_X[m - 1], temp_map_Y[m - 1], FlowX(k - 1), FlowY(k - 1), temp_map_X[m], temp_map_Y[m]);
         }
     }
     
-    // Compute absolute motion for frames after reference
-    for (int i = reference + N - 1, k = 2 * N - 1; i >= reference && k >= N; i--, k--) {
-        if (i < m_frames.size() - 1) {
-            temp_map_X[k] = -map_X[i];
-            temp_map_Y[k] = -map_Y[i];
-            for (int j = i - 1; j >= reference; j--) {
-                temp_map_X[k] -= map_X[j];
-                temp_map_Y[k] -= map_Y[j];
-            }
+    // Frames before the reference (slots N-1..0): inverted flows
+    const int first = max(reference - N, 0);
+    for (int k = reference - 1, m = N - 1; k >= first; k--, m--) {
+        if (k == reference - 1) {
+            BackX(k).copyTo(temp_map_X[m]);
+            BackY(k).copyTo(temp_map_Y[m]);
+        } else {
+            Compose(temp_map_X[m + 1], temp_map_Y[m + 1], BackX(k), BackY(k), temp_map_X[m], temp_map_Y[m]);
         }
     }
 }
 
-void MotionDenoiser::TargetFrameBuild(int reference) {
-    m_frames[reference].convertTo(m_dst_temp, CV_32FC3);
-    m_Counter_adder.setTo(1);
+// Aligns src with the reference given the motion reference -> src
+void MotionDenoiser::WarpFrame(const cv::Mat& src, cv::Mat& dst, const cv::Mat& motion_x, const cv::Mat& motion_y) {
+    m_mapedX = motion_x + formatX;
+    m_mapedY = motion_y + formatY;
+    // Samples from outside the frame repeat the edge: a constant 0 (black, and green in
+    // I420 chroma) would pass the rejection test next to dark pixels
+    if (m_layout == FRAME_BGR) {
+        remap(src, dst, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+        return;
+    }
+    
+    Mat y = i420_plane(src, 0, m_width, m_height);
+    Mat warped_y = i420_plane(dst, 0, m_width, m_height);
+    remap(y, warped_y, m_mapedX, m_mapedY, INTER_LINEAR, BORDER_REPLICATE);
+    
+    // A chroma sample moves by half the mean motion of its 2x2 luma block
+    resize(motion_x, m_halfX, formatHalfX.size(), 0, 0, INTER_AREA);
+    resize(motion_y, m_halfY, formatHalfY.size(), 0, 0, INTER_AREA);
+    m_halfMapX = m_halfX * 0.5 + formatHalfX;
+    m_halfMapY = m_halfY * 0.5 + formatHalfY;
+    for (int p = 1; p <= 2; p++) {
+        Mat c = i420_plane(src, p, m_width, m_height);
+        Mat warped_c = i420_plane(dst, p, m_width, m_height);
+        remap(c, warped_c, m_halfMapX, m_halfMapY, INTER_LINEAR, BORDER_REPLICATE);
+    }
+}
+
+// Aligns every neighbour of the reference with it (the warped frames are kept for the fusion)
+int MotionDenoiser::WarpNeighbours(int reference) {
+    int count = 0;
     
     // Process frames before reference
     for (int k = reference - N, m = 0; k < reference && m < N; k++, m++) {
         if (k >= 0) {
-            m_mapedX = temp_map_X[m] + formatX;
-            m_mapedY = temp_map_Y[m] + formatY;
-            
-            remap(m_frames[k], m_temp, m_mapedX, m_mapedY, INTER_LINEAR);
-            
-            for (int i = 0; i < m_height; i++) {
-                for (int j = 0; j < m_width; j++) {
-                    Vec3b ref_pixel = m_frames[reference].at<Vec3b>(i, j);
-                    Vec3b temp_pixel = m_temp.at<Vec3b>(i, j);
-                    
-                    int R = abs(ref_pixel[0] - temp_pixel[0]);
-                    int G = abs(ref_pixel[1] - temp_pixel[1]);
-                    int B = abs(ref_pixel[2] - temp_pixel[2]);
-                    int Y = (R + 2 * G + B) / 4;
-                    
-                    float weight = Y > 40 ? 0.0f : 1.0f;
-                    
-                    m_dst_temp.at<Vec3f>(i, j)[0] += weight * temp_pixel[0];
-                    m_dst_temp.at<Vec3f>(i, j)[1] += weight * temp_pixel[1];
-                    m_dst_temp.at<Vec3f>(i, j)[2] += weight * temp_pixel[2];
-                    m_Counter_adder.at<float>(i, j) += weight;
-                }
-            }
+            WarpFrame(Frame(k), m_warped[count++], temp_map_X[m], temp_map_Y[m]);
         }
     }
     
     // Process frames after reference
     for (int k = reference + 1, m = N; k <= reference + N && m < 2 * N; k++, m++) {
         if (k < m_frameNum) {
-            m_mapedX = temp_map_X[m] + formatX;
-            m_mapedY = temp_map_Y[m] + formatY;
-            
-            remap(m_frames[k], m_temp, m_mapedX, m_mapedY, INTER_LINEAR);
-            
-            for (int i = 0; i < m_height; i++) {
-                for (int j = 0; j < m_width; j++) {
-                    Vec3b ref_pixel = m_frames[reference].at<Vec3b>(i, j);
-                    Vec3b temp_pixel = m_temp.at<Vec3b>(i, j);
-                    
-                    int R = abs(ref_pixel[0] - temp_pixel[0]);
-                    int G = abs(ref_pixel[1] - temp_pixel[1]);
-                    int B = abs(ref_pixel[2] - temp_pixel[2]);
-                    int Y = (R + 2 * G + B) / 4;
-                    
-                    float weight = Y > 40 ? 0.0f : 1.0f;
-                    
-                    m_dst_temp.at<Vec3f>(i, j)[0] += weight * temp_pixel[0];
-                    m_dst_temp.at<Vec3f>(i, j)[1] += weight * temp_pixel[1];
-                    m_dst_temp.at<Vec3f>(i, j)[2] += weight * temp_pixel[2];
-                    m_Counter_adder.at<float>(i, j) += weight;
+            WarpFrame(Frame(k), m_warped[count++], temp_map_X[m], temp_map_Y[m]);
+        }
+    }
+    return count;
+}
+
+// One row of the fusion: the reference plus every warped neighbour whose pixel is close to it
+// (luma-weighted difference up to 40), averaged. The sums are integers, and the average is
+// taken as sum * (1 / count) rounded to nearest, which is exactly what the float
+// accumulation and Vec3f division used to produce.
+static void fuse_row(const uchar* ref, const uchar* const* warped, int count, int width,
+                     ushort* sum, uchar* weight, uchar* out) {
+    for (int x = 0; x < 3 * width; x++) {
+        sum[x] = ref[x];
+    }
+    for (int x = 0; x < width; x++) {
+        weight[x] = 1;
+    }
+    for (int k = 0; k < count; k++) {
+        const uchar* w = warped[k];
+        for (int x = 0; x < width; x++) {
+            const uchar* r = ref + 3 * x;
+            const uchar* p = w + 3 * x;
+            const int Y = (abs(r[0] - p[0]) + 2 * abs(r[1] - p[1]) + abs(r[2] - p[2])) >> 2;
+            const int keep = Y <= 40;
+            sum[3 * x] += keep * p[0];
+            sum[3 * x + 1] += keep * p[1];
+            sum[3 * x + 2] += keep * p[2];
+            weight[x] += keep;
+        }
+    }
+    for (int x = 0; x < width; x++) {
+        const float inv = 1.f / weight[x];
+        out[3 * x] = saturate_cast<uchar>(sum[3 * x] * inv);
+        out[3 * x + 1] = saturate_cast<uchar>(sum[3 * x + 1] * inv);
+        out[3 * x + 2] = saturate_cast<uchar>(sum[3 * x + 2] * inv);
+    }
+}
+
+// The BGR threshold in video-range luma (219 levels for 255)
+static const int LUMA_THRESHOLD = 40 * 219 / 255;
+
+// Native I420 version, on two luma rows and the chroma rows they share ([0], [1] Y, [2] U,
+// [3] V; `warped` holds 4 rows per neighbour). A luma pixel is kept when its own difference
+// is at most LUMA_THRESHOLD, a chroma sample when the mean difference over its 2x2 block is.
+static void fuse_rows_i420(const uchar* const* ref, const uchar* const* warped, int count, int width,
+                           ushort* sum, uchar* weight, uchar* const* out) {
+    const int cw = width / 2;
+    ushort* sum_c = sum + 2 * width;        // U then V
+    uchar* weight_c = weight + 2 * width;
+    for (int x = 0; x < width; x++) {
+        sum[x] = ref[0][x];
+        sum[width + x] = ref[1][x];
+        weight[x] = weight[width + x] = 1;
+    }
+    for (int i = 0; i < cw; i++) {
+        sum_c[i] = ref[2][i];
+        sum_c[cw + i] = ref[3][i];
+        weight_c[i] = 1;
+    }
+    for (int k = 0; k < count; k++) {
+        const uchar* const* w = warped + 4 * k;
+        for (int i = 0; i < cw; i++) {
+            int block = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const int x = 2 * i + dx;
+                    const int diff = abs(ref[dy][x] - w[dy][x]);
+                    const int keep = diff <= LUMA_THRESHOLD;
+                    sum[dy * width + x] += keep * w[dy][x];
+                    weight[dy * width + x] += keep;
+                    block += diff;
                 }
             }
+            const int keep = block <= 4 * LUMA_THRESHOLD;
+            sum_c[i] += keep * w[2][i];
+            sum_c[cw + i] += keep * w[3][i];
+            weight_c[i] += keep;
         }
     }
-    
-    // Normalize and convert back to 8-bit
-    for (int i = 0; i < m_height; i++) {
-        for (int j = 0; j < m_width; j++) {
-            float c = m_Counter_adder.at<float>(i, j);
-            if (c > 0) {
-                m_dst_temp.at<Vec3f>(i, j) /= c;
-            }
+    for (int dy = 0; dy < 2; dy++) {
+        for (int x = 0; x < width; x++) {
+            out[dy][x] = saturate_cast<uchar>(sum[dy * width + x] * (1.f / weight[dy * width + x]));
         }
     }
+    for (int i = 0; i < cw; i++) {
+        const float inv = 1.f / weight_c[i];
+        out[2][i] = saturate_cast<uchar>(sum_c[i] * inv);
+        out[3][i] = saturate_cast<uchar>(sum_c[cw + i] * inv);
+    }
+}
+
+// Rows 2j and 2j+1 of the Y plane and row j of the U and V planes of an I420 frame
+template<typename T>
+static void i420_rows(T* data, int width, int height, int j, T** rows) {
+    const size_t luma = size_t(width) * height;
+    rows[0] = data + size_t(2 * j) * width;
+    rows[1] = rows[0] + width;
+    rows[2] = data + luma + size_t(j) * (width / 2);
+    rows[3] = rows[2] + luma / 4;
+}
+
+// Fuses the reference with its `count` warped neighbours into m_denoised, in a single pass
+// over the rows (split across threads) instead of one pass per neighbour and a normalization
+void MotionDenoiser::TargetFrameBuild(int reference, int count) {
+    const Mat& ref = Frame(reference);
+    if (m_layout == FRAME_BGR) {
+        parallel_for_(Range(0, m_height), [&](const Range& rows) {
+            vector<ushort> sum(3 * m_width);
+            vector<uchar> weight(m_width);
+            vector<const uchar*> warped(count);
+            for (int i = rows.start; i < rows.end; i++) {
+                for (int k = 0; k < count; k++) {
+                    warped[k] = m_warped[k].ptr<uchar>(i);
+                }
+                fuse_row(ref.ptr<uchar>(i), warped.data(), count, m_width, sum.data(), weight.data(),
+                         m_denoised.ptr<uchar>(i));
+            }
+        });
+        return;
+    }
     
-    m_dst_temp.convertTo(m_denoised_frames[reference], CV_8UC3);
+    // I420: pairs of luma rows with their chroma rows
+    parallel_for_(Range(0, m_height / 2), [&](const Range& pairs) {
+        vector<ushort> sum(3 * m_width);
+        vector<uchar> weight(2 * m_width + m_width / 2);
+        vector<const uchar*> warped(4 * count);
+        const uchar* ref_rows[4];
+        uchar* out_rows[4];
+        for (int j = pairs.start; j < pairs.end; j++) {
+            for (int k = 0; k < count; k++) {
+                i420_rows<const uchar>(m_warped[k].data, m_width, m_height, j, &warped[4 * k]);
+            }
+            i420_rows<const uchar>(ref.data, m_width, m_height, j, ref_rows);
+            i420_rows<uchar>(m_denoised.data, m_width, m_height, j, out_rows);
+            fuse_rows_i420(ref_rows, warped.data(), count, m_width, sum.data(), weight.data(), out_rows);
+        }
+    });
 }
 
 void MotionDenoiser::Get_optical_flow_img(cv::Mat &motion_X, cv::Mat &motion_Y, 
                                         cv::Mat &optical_flow_img_color, 
                                         cv::Mat &optical_flow_img_arrow) {
-    optical_flow_img_color = Mat::zeros(m_size, CV_8UC3);
-    optical_flow_img_arrow = Mat::zeros(m_size, CV_8UC3);
+    // Color: hue from the direction, saturation from the magnitude (full at 10 pixels),
+    // built for the whole image and converted from HSV at once
+    cartToPolar(motion_X, motion_Y, m_vizMag, m_vizAngle, true);
+    m_vizHSV.resize(3);
+    m_vizAngle.convertTo(m_vizHSV[0], CV_8U, 0.5);  // OpenCV hue range is [0, 180]
+    m_vizMag.convertTo(m_vizHSV[1], CV_8U, 255 / 10.);
+    m_vizHSV[2].create(m_size, CV_8U);
+    m_vizHSV[2].setTo(255);
+    merge(m_vizHSV, m_vizColor);
+    cvtColor(m_vizColor, optical_flow_img_color, COLOR_HSV2BGR);
     
-    for (int i = 0; i < m_height; i++) {
-        for (int j = 0; j < m_width; j++) {
-            float fx = motion_X.at<float>(i, j);
-            float fy = motion_Y.at<float>(i, j);
-            
-            // Compute magnitude and angle
-            float magnitude = sqrt(fx*fx + fy*fy);
-            float angle = atan2(fy, fx) * 180 / M_PI;
-            if (angle < 0) angle += 360;
-            
-            // Convert to color
-            int hue = angle * 2;  // OpenCV hue range is [0, 180]
-            int sat = magnitude * 255 / 10;  // Scale magnitude to [0, 255]
-            if (sat > 255) sat = 255;
-            
-            Vec3b color(hue, sat, 255);
-            cvtColor(Mat(1, 1, CV_8UC3, color), Mat(1, 1, CV_8UC3, color), COLOR_HSV2BGR);
-            optical_flow_img_color.at<Vec3b>(i, j) = color;
-            
-            // Draw arrows for visualization
-            if (i % 20 == 0 && j % 20 == 0 && magnitude > 0.5) {
+    // Draw arrows for visualization (every 20 pixels)
+    optical_flow_img_arrow.create(m_size, CV_8UC3);
+    optical_flow_img_arrow.setTo(Scalar::all(0));
+    for (int i = 0; i < m_height; i += 20) {
+        const float* fx = motion_X.ptr<float>(i);
+        const float* fy = motion_Y.ptr<float>(i);
+        for (int j = 0; j < m_width; j += 20) {
+            if (fx[j] * fx[j] + fy[j] * fy[j] > 0.25f) {
                 Point2f start(j, i);
-                Point2f end(j + fx, i + fy);
+                Point2f end(j + fx[j], i + fy[j]);
                 arrowedLine(optical_flow_img_arrow, start, end, Scalar(0, 0, 255), 1, 8, 0, 0.3);
             }
         }
     }
 }
 
-std::vector<cv::Mat> MotionDenoiser::Execute() {
-    clock_t start = clock();
+const std::vector<std::vector<cv::Mat>>& MotionDenoiser::GetOpticalFlowImages() {
+    // Pairs still in the ring that have not been drawn yet
+    for (int pair = max(m_frameNum - 1 - 2 * N, 0); pair < m_frameNum - 1; pair++) {
+        const int slot = pair % (2 * N);
+        if (m_drawnPair[slot] != pair) {
+            Get_optical_flow_img(FlowX(pair), FlowY(pair), optical_flow_img[0][slot], optical_flow_img[1][slot]);
+            m_drawnPair[slot] = pair;
+        }
+    }
+    return optical_flow_img;
+}
+
+// Recursive mode: where the current frame and the past agree (same test as the window
+// fusion), out = (current + N * past) / (N + 1). Its noise variance settles at 1 / (2N + 1)
+// of the input's, as for the window average; elsewhere the current frame is kept.
+static inline uchar blend(int current, int past, int keep) {
+    return (uchar)((current * (N + 1) + keep * N * (past - current) + (N + 1) / 2) / (N + 1));
+}
+
+static void blend_row(const uchar* current, const uchar* past, int width, uchar* out) {
+    for (int x = 0; x < width; x++) {
+        const uchar* c = current + 3 * x;
+        const uchar* p = past + 3 * x;
+        const int Y = (abs(c[0] - p[0]) + 2 * abs(c[1] - p[1]) + abs(c[2] - p[2])) >> 2;
+        const int keep = Y <= 40;
+        out[3 * x] = blend(c[0], p[0], keep);
+        out[3 * x + 1] = blend(c[1], p[1], keep);
+        out[3 * x + 2] = blend(c[2], p[2], keep);
+    }
+}
+
+// I420 version, with the luma and chroma rules of fuse_rows_i420
+static void blend_rows_i420(const uchar* const* current, const uchar* const* past, int width, uchar* const* out) {
+    for (int i = 0; i < width / 2; i++) {
+        int block = 0;
+        for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                const int x = 2 * i + dx;
+                const int diff = abs(current[dy][x] - past[dy][x]);
+                out[dy][x] = blend(current[dy][x], past[dy][x], diff <= LUMA_THRESHOLD);
+                block += diff;
+            }
+        }
+        const int keep = block <= 4 * LUMA_THRESHOLD;
+        out[2][i] = blend(current[2][i], past[2][i], keep);
+        out[3][i] = blend(current[3][i], past[3][i], keep);
+    }
+}
+
+// Blends frame `current` with the previous output warped onto it (m_warped[0]) into m_denoised
+void MotionDenoiser::Blend(int current) {
+    const Mat& frame = Frame(current);
+    const Mat& past = m_warped[0];
+    if (m_layout == FRAME_BGR) {
+        parallel_for_(Range(0, m_height), [&](const Range& rows) {
+            for (int i = rows.start; i < rows.end; i++) {
+                blend_row(frame.ptr<uchar>(i), past.ptr<uchar>(i), m_width, m_denoised.ptr<uchar>(i));
+            }
+        });
+        return;
+    }
+    parallel_for_(Range(0, m_height / 2), [&](const Range& pairs) {
+        const uchar* frame_rows[4];
+        const uchar* past_rows[4];
+        uchar* out_rows[4];
+        for (int j = pairs.start; j < pairs.end; j++) {
+            i420_rows<const uchar>(frame.data, m_width, m_height, j, frame_rows);
+            i420_rows<const uchar>(past.data, m_width, m_height, j, past_rows);
+            i420_rows<uchar>(m_denoised.data, m_width, m_height, j, out_rows);
+            blend_rows_i420(frame_rows, past_rows, m_width, out_rows);
+        }
+    });
+}
+
+void MotionDenoiser::EmitRecursive(int current) {
+    int64 t0 = getTickCount();
+    int64 t1 = t0;
+    if (current == 0) {
+        Frame(0).copyTo(m_denoised);
+    } else {
+        // The inverse of the last pair's flow goes from this frame to the previous one
+        WarpFrame(m_previous, m_warped[0], BackX(current - 1), BackY(current - 1));
+        t1 = getTickCount();
+        Blend(current);
+    }
+    int64 t2 = getTickCount();
+    
+    const double ms = 1000. / getTickFrequency();
+    printf("Frame %d: warp %.2f ms, blend %.2f ms (recursive)\n", current + 1, (t1 - t0) * ms, (t2 - t1) * ms);
+    
+    m_sink(current, m_denoised);
+    swap(m_denoised, m_previous);
+    m_emitted = current + 1;
+}
+
+void MotionDenoiser::Emit(int reference) {
+    cout << "Processing frame " << reference + 1 << " (" << m_frameNum << " read)" << endl;
+    
+    // Compute absolute motion relative to current frame
+    int64 t0 = getTickCount();
+    AbsoluteMotion(reference);
+    int64 t1 = getTickCount();
+    
+    // Build denoised frame using temporal averaging
+    const int count = WarpNeighbours(reference);
+    int64 t2 = getTickCount();
+    TargetFrameBuild(reference, count);
+    int64 t3 = getTickCount();
     
-    // Step 1: Estimate motion between consecutive frames
-    MotionEstimation();
+    const double ms = 1000. / getTickFrequency();
+    printf("Frame %d: motion %.2f ms, warp %.2f ms, fusion %.2f ms (%d neighbours)\n", reference + 1,
+           (t1 - t0) * ms, (t2 - t1) * ms, (t3 - t2) * ms, count);
     
-    // Step 2: Process each frame
-    for (int i = 0; i < m_frameNum; i++) {
-        cout << "Processing frame " << i + 1 << "/" << m_frameNum << endl;
-        
-        // Compute absolute motion relative to current frame
-        AbsoluteMotion(i);
-        
-        // Build denoised frame using temporal averaging
-        TargetFrameBuild(i);
-        
-        // Reset counter for next frame
-        m_Counter_adder.setTo(1);
+    m_sink(reference, m_denoised);
+    m_emitted = reference + 1;
+}
+
+void MotionDenoiser::SetMotionBackend(std::unique_ptr<MotionBackend> backend) {
+    m_estimator.SetBackend(std::move(backend));
+}
+
+void MotionDenoiser::Push(const cv::Mat& frame) {
+    // The flow previous -> frame goes straight to its slot of the ring (none for the first frame)
+    const int pair = max(m_frameNum - 1, 0);
+    if (m_estimator.Next(frame, FlowX(pair), FlowY(pair))) {
+        cout << "Computed flow for frames " << pair << " -> " << pair + 1 << endl;
+    }
+    AddFrame(frame);
+}
+
+void MotionDenoiser::Push(const cv::Mat& frame, const cv::Mat& flow_x, const cv::Mat& flow_y) {
+    if (m_frameNum > 0) {
+        const int pair = m_frameNum - 1;
+        flow_x.copyTo(FlowX(pair));
+        flow_y.copyTo(FlowY(pair));
+    }
+    AddFrame(frame);
+}
+
+void MotionDenoiser::AddFrame(const cv::Mat& frame) {
+    if (frame.size() != m_frames[0].size() || frame.type() != m_frames[0].type()) {
+        throw runtime_error("Frame size or type differs from the first frame");
     }
     
-    clock_t end = clock();
-    double time_per_frame = double(end - start) / CLOCKS_PER_SEC / m_frameNum;
-    cout << "Average processing time per frame: " << time_per_frame << " seconds" << endl;
+    // The slot of the new frame held frame m_frameNum - 2N - 1, no longer in any window
+    frame.copyTo(Frame(m_frameNum));
+    m_frameNum++;
+    if (m_frameNum > 1) {
+        InvertFlow(m_frameNum - 2);
+    }
     
-    return m_denoised_frames;
-}
\ No newline at end of file
+    if (m_mode == DENOISE_RECURSIVE) {
+        EmitRecursive(m_frameNum - 1);
+    } else if (m_frameNum - 1 - N >= 0) {
+        // The window of frame m_frameNum - 1 - N is complete
+        Emit(m_frameNum - 1 - N);
+    }
+}
+
+void MotionDenoiser::Finish() {
+    while (m_emitted < m_frameNum) {
+        Emit(m_emitted);
+    }
+    
+    clock_t end = clock();
+    if (m_frameNum > 0) {
+        double time_per_frame = double(end - m_start) / CLOCKS_PER_SEC / m_frameNum;
+        cout << "Average processing time per frame: " << time_per_frame << " seconds" << endl;
+    }
+}
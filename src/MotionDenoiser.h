@@ -2,48 +2,134 @@
 #define __MotionDenoiser__
 
 #include <opencv2/opencv.hpp>
+#include <functional>
 #include <vector>
 #include "time.h"
+#include "MotionBackend.h"
 
 #define N 4  // Temporal window size for denoising
 #define COLOR 1
 #define ARROW 1
 
+// Layout of the frames given to the denoiser
+enum FrameLayout {
+    FRAME_BGR,      // CV_8UC3
+    FRAME_I420      // CV_8UC1 of (3h/2) x w: the Y plane, then the U and V planes
+};
+
+// How each frame is denoised
+enum DenoiseMode {
+    DENOISE_WINDOW,     // average of the frame and its 2*N aligned neighbours (N frames of delay)
+    DENOISE_RECURSIVE   // blend of the frame and the previous output aligned with it (no delay)
+};
+
+// Pairwise motion of a stream of frames: the flow of each frame from the previous one
+class MotionEstimator {
+public:
+    // Null: DIS with its medium preset
+    explicit MotionEstimator(std::unique_ptr<MotionBackend> backend = nullptr);
+
+    // Flow previous frame -> frame (X and Y components); false for the first frame. I420
+    // frames are estimated on their Y plane.
+    bool Next(const cv::Mat& frame, cv::Mat& flow_x, cv::Mat& flow_y);
+
+    // Flow of one pair of gray frames. Pairs are independent: each thread estimating
+    // pairs concurrently needs its own MotionEstimator, as backends keep per-call state.
+    void Estimate(const cv::Mat& prev_gray, const cv::Mat& gray, cv::Mat& flow_x, cv::Mat& flow_y);
+
+    void SetBackend(std::unique_ptr<MotionBackend> backend);
+
+private:
+    std::unique_ptr<MotionBackend> m_backend;
+    cv::Mat m_gray, m_prev_gray;
+};
+
+// Streaming denoiser: frames are pushed one at a time and only the last 2*N+1 frames and
+// the 2*N flows between them are kept, so memory does not depend on the length of the clip.
+// Frame r is denoised (and handed to the sink) as soon as frame r+N arrives; the last N
+// frames are flushed by Finish().
+// In recursive mode each frame is blended with the previous output, warped with one flow,
+// and handed to the sink right away: one warp per frame whatever N.
+// I420 frames are fused natively: the rejection weights come from Y, and the chroma planes
+// are warped at their own resolution with the motion averaged over 2x2 blocks.
 class MotionDenoiser {
+public:
+    typedef std::function<void(int index, const cv::Mat& denoised)> FrameSink;
+
 private:
     int m_height;
     int m_width;
-    int m_frameNum;
+    int m_frameNum;     // frames pushed so far
+    int m_emitted;      // frames handed to the sink so far
     cv::Size m_size;
-    
-    std::vector<cv::Mat> m_frames;  // Input frames
-    std::vector<cv::Mat> m_denoised_frames;  // Output frames
-    std::vector<cv::Mat> map_X, map_Y;  // Optical flow maps
-    std::vector<cv::Mat> temp_map_X, temp_map_Y;  // Temporary flow maps
-    std::vector<std::vector<cv::Mat>> optical_flow_img;  // Flow visualization
-
-    cv::Mat m_mask;
-    cv::Mat m_dst_temp;
-    cv::Mat m_diff;
-    cv::Mat m_temp;
+    FrameLayout m_layout;
+    DenoiseMode m_mode;
+    FrameSink m_sink;
+    MotionEstimator m_estimator;
+    clock_t m_start;
+
+    std::vector<cv::Mat> m_frames;  // Ring of input frames, frame i in slot i % (2*N+1)
+    std::vector<cv::Mat> map_X, map_Y;  // Ring of optical flow maps, pair i -> i+1 in slot i % (2*N)
+    std::vector<cv::Mat> back_X, back_Y;  // Their inverses (i+1 -> i, on the grid of i+1), same slots
+    std::vector<cv::Mat> temp_map_X, temp_map_Y;  // Accumulated motion reference -> neighbours
+    std::vector<std::vector<cv::Mat>> optical_flow_img;  // Flow visualization, same slots as the flows
+    std::vector<int> m_drawnPair;   // pair drawn in each slot of optical_flow_img, -1 if none
+    cv::Mat m_vizMag, m_vizAngle, m_vizColor;
+    std::vector<cv::Mat> m_vizHSV;
+
+    cv::Mat m_denoised;
+    cv::Mat m_previous;     // Previous output (recursive mode)
+    std::vector<cv::Mat> m_warped;  // Neighbours aligned with the reference
     cv::Mat m_mapedX, m_mapedY;
-    cv::Mat m_Counter_adder;
+    cv::Mat m_warpX, m_warpY;
     cv::Mat formatX, formatY;
+    cv::Mat m_halfX, m_halfY, m_halfMapX, m_halfMapY;  // Chroma motion and maps (I420)
+    cv::Mat formatHalfX, formatHalfY;
 
 private:
-    void MotionEstimation();
+    cv::Mat& Frame(int i) { return m_frames[i % (2 * N + 1)]; }
+    cv::Mat& FlowX(int i) { return map_X[i % (2 * N)]; }
+    cv::Mat& FlowY(int i) { return map_Y[i % (2 * N)]; }
+    cv::Mat& BackX(int i) { return back_X[i % (2 * N)]; }
+    cv::Mat& BackY(int i) { return back_Y[i % (2 * N)]; }
+
+    void AddFrame(const cv::Mat& frame);
+    void InvertFlow(int pair);
+    void Compose(const cv::Mat& acc_x, const cv::Mat& acc_y, const cv::Mat& flow_x, const cv::Mat& flow_y,
+                 cv::Mat& dst_x, cv::Mat& dst_y);
     void AbsoluteMotion(int reference);
-    void TargetFrameBuild(int reference);
-    void Get_optical_flow_img(cv::Mat &motion_X, cv::Mat &motion_Y, 
-                            cv::Mat &optical_flow_img_color, 
+    void WarpFrame(const cv::Mat& src, cv::Mat& dst, const cv::Mat& motion_x, const cv::Mat& motion_y);
+    int WarpNeighbours(int reference);
+    void TargetFrameBuild(int reference, int count);
+    void Emit(int reference);
+    void Blend(int current);
+    void EmitRecursive(int current);
+    void Get_optical_flow_img(cv::Mat &motion_X, cv::Mat &motion_Y,
+                            cv::Mat &optical_flow_img_color,
                             cv::Mat &optical_flow_img_arrow);
 
 public:
-    MotionDenoiser(const std::vector<cv::Mat>& frames);
-    std::vector<cv::Mat> Execute();
-    const std::vector<std::vector<cv::Mat>>& GetOpticalFlowImages() const { 
-        return optical_flow_img; 
-    }
+    // `size` is the size of the picture (the Y plane for I420, which needs it even)
+    MotionDenoiser(cv::Size size, FrameSink sink, FrameLayout layout = FRAME_BGR,
+                   DenoiseMode mode = DENOISE_WINDOW);
+
+    // Adds the next frame (8 bits, in the layout given to the constructor) and denoises the
+    // frame N places before it (this one in recursive mode)
+    void Push(const cv::Mat& frame);
+
+    // Same, with the flow previous frame -> frame already computed (ignored for the first frame)
+    void Push(const cv::Mat& frame, const cv::Mat& flow_x, const cv::Mat& flow_y);
+
+    // Motion of the frames given by Push(frame) from now on (see CreateMotionBackend)
+    void SetMotionBackend(std::unique_ptr<MotionBackend> backend);
+
+    // Denoises the frames still waiting for their successors (end of the clip)
+    void Finish();
+
+    // [0] color and [1] arrow images of the flows in the ring (slot i % (2*N) for pair
+    // i -> i+1), drawn now for the pairs that arrived since the last call: runs that never
+    // ask for them do not pay for them
+    const std::vector<std::vector<cv::Mat>>& GetOpticalFlowImages();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,119 +1,297 @@
 #include "VideoIO.h"
+#include <cstring>
 
-vector<cv::Mat> GetFramesFromYUV(const string& filename, double &fps) {
+size_t YUVFormat::FrameBytes() const {
+	const size_t samples = size_t(width) * height * 3 / 2;
+	return layout == YUV_P010 ? 2 * samples : samples;
+}
+
+bool ParseYUVLayout(const string& name, YUVLayout& layout) {
+	if (name == "i420" || name == "yuv420p")
+		layout = YUV_I420;
+	else if (name == "nv12")
+		layout = YUV_NV12;
+	else if (name == "p010")
+		layout = YUV_P010;
+	else
+		return false;
+	return true;
+}
+
+static bool check_format(const YUVFormat& format) {
+	if (format.width <= 0 || format.height <= 0 || format.width % 2 || format.height % 2) {
+		cerr << "YUV 4:2:0 frames need an even, positive size (got " << format.width << "x"
+			 << format.height << ")" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool YUVReader::Open(const string& filename, const YUVFormat& format) {
 	printf("Reading YUV file: %s\n", filename.c_str());
-	vector<cv::Mat> frames;
-	ifstream file(filename, ios::binary);
-	
-	if (!file.is_open()) {
+	if (!check_format(format))
+		return false;
+	m_file.open(filename, ios::binary);
+	if (!m_file.is_open()) {
 		cerr << "Could not open YUV file: " << filename << endl;
-		return frames;
+		return false;
 	}
 
-	// Set default fps for YUV (can be passed as parameter if needed)
-	fps = 30.0;
-
-	// Buffer for one frame
-	unsigned char* yuv_buffer = new unsigned char[FRAME_SIZE];
-
-	// Read frames until end of file
-	while (file.read(reinterpret_cast<char*>(yuv_buffer), FRAME_SIZE)) {
-		// Convert YUV to BGR
-		cv::Mat bgr_frame = yuv420p_to_bgr(yuv_buffer);
-		frames.push_back(bgr_frame.clone());
-		
-		// Print first few bytes for debugging
-		if (frames.size() == 1) {
-			printf("First frame Y plane first 10 bytes: ");
-			for (int i = 0; i < 10; i++) {
-				printf("%02x ", yuv_buffer[i]);
-			}
-			printf("\n");
+	m_format = format;
+	m_buffer.resize(format.FrameBytes());
+	m_frames = 0;
+	return true;
+}
+
+bool YUVReader::ReadRaw(unsigned char* dst) {
+	if (!m_file.read(reinterpret_cast<char*>(dst), m_buffer.size()))
+		return false;
+
+	// Print first few bytes for debugging
+	if (++m_frames == 1) {
+		printf("First frame Y plane first 10 bytes: ");
+		for (int i = 0; i < 10; i++) {
+			printf("%02x ", dst[i]);
 		}
+		printf("\n");
 	}
+	return true;
+}
 
-	delete[] yuv_buffer;
-	file.close();
-	printf("YUV file read complete. Total frames: %zu\n", frames.size());
-	return frames;
+bool YUVReader::Read(cv::Mat& bgr_frame) {
+	if (!ReadRaw(m_buffer.data()))
+		return false;
+	yuv420_to_bgr(m_buffer.data(), m_format, bgr_frame, m_scratch);
+	return true;
 }
 
-void WriteFramesToYUV(const vector<cv::Mat>& frames, const string& filename) {
-	ofstream file(filename, ios::binary);
-	if (!file.is_open()) {
+bool YUVReader::ReadI420(cv::Mat& i420_frame) {
+	i420_frame.create(m_format.height * 3 / 2, m_format.width, CV_8UC1);
+	if (m_format.layout == YUV_I420)	// the file holds the frame as it is
+		return ReadRaw(i420_frame.data);
+	if (!ReadRaw(m_buffer.data()))
+		return false;
+	yuv420_to_i420(m_buffer.data(), m_format, i420_frame);
+	return true;
+}
+
+bool YUVWriter::Open(const string& filename, const YUVFormat& format) {
+	if (!check_format(format))
+		return false;
+	m_file.open(filename, ios::binary);
+	if (!m_file.is_open()) {
 		cerr << "Could not create output YUV file: " << filename << endl;
+		return false;
+	}
+	m_format = format;
+	m_buffer.resize(format.FrameBytes());
+	m_frames = 0;
+	return true;
+}
+
+void YUVWriter::Write(const cv::Mat& bgr_frame) {
+	bgr_to_yuv420(bgr_frame, m_format, m_buffer.data());
+	WriteRaw(m_buffer.data());
+}
+
+void YUVWriter::WriteI420(const cv::Mat& i420_frame) {
+	CV_Assert(i420_frame.type() == CV_8UC1 && i420_frame.isContinuous() &&
+		i420_frame.cols == m_format.width && i420_frame.rows == m_format.height * 3 / 2);
+	if (m_format.layout == YUV_I420) {
+		WriteRaw(i420_frame.data);
 		return;
 	}
+	i420_to_yuv420(i420_frame, m_format, m_buffer.data());
+	WriteRaw(m_buffer.data());
+}
 
-	unsigned char* yuv_buffer = new unsigned char[FRAME_SIZE];
-
-	for (size_t i = 0; i < frames.size(); i++) {
-		// Convert BGR to YUV420p
-		bgr_to_yuv420p(frames[i], yuv_buffer);
-		
-		// Write YUV data
-		file.write(reinterpret_cast<char*>(yuv_buffer), FRAME_SIZE);
-		
-		// Print progress
-		if (i % 10 == 0) {
-			printf("Written frame %zu/%zu\n", i, frames.size());
-		}
+void YUVWriter::WriteRaw(const unsigned char* src) {
+	// Write YUV data
+	m_file.write(reinterpret_cast<const char*>(src), m_buffer.size());
+
+	// Print progress
+	if (m_frames % 10 == 0) {
+		printf("Written frame %d\n", m_frames);
+	}
+	m_frames++;
+}
+
+vector<cv::Mat> GetFramesFromYUV(const string& filename, const YUVFormat& format) {
+	vector<cv::Mat> frames;
+	YUVReader reader;
+	if (!reader.Open(filename, format))
+		return frames;
+
+	cv::Mat bgr_frame;
+	while (reader.Read(bgr_frame)) {
+		frames.push_back(bgr_frame);
+		bgr_frame = cv::Mat();
 	}
 
-	delete[] yuv_buffer;
-	file.close();
+	printf("YUV file read complete. Total frames: %zu\n", frames.size());
+	return frames;
+}
+
+void WriteFramesToYUV(const vector<cv::Mat>& frames, const string& filename, const YUVFormat& format) {
+	YUVWriter writer;
+	if (!writer.Open(filename, format))
+		return;
+
+	for (size_t i = 0; i < frames.size(); i++)
+		writer.Write(frames[i]);
+
 	printf("All frames written to YUV file\n");
 }
 
-cv::Mat yuv420p_to_bgr(unsigned char* yuv_buffer) {
-	// Create Y plane (full resolution)
-	cv::Mat y_plane(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, yuv_buffer);
-	
-	// Create U plane (quarter resolution)
-	cv::Mat u_plane(FRAME_HEIGHT/2, FRAME_WIDTH/2, CV_8UC1, 
-				   yuv_buffer + FRAME_WIDTH*FRAME_HEIGHT);
-	
-	// Create V plane (quarter resolution)
-	cv::Mat v_plane(FRAME_HEIGHT/2, FRAME_WIDTH/2, CV_8UC1, 
-				   yuv_buffer + FRAME_WIDTH*FRAME_HEIGHT + (FRAME_WIDTH*FRAME_HEIGHT)/4);
-
-	// Resize U and V planes to full resolution
-	cv::Mat u_resized, v_resized;
-	cv::resize(u_plane, u_resized, cv::Size(FRAME_WIDTH, FRAME_HEIGHT));
-	cv::resize(v_plane, v_resized, cv::Size(FRAME_WIDTH, FRAME_HEIGHT));
-
-	// Merge YUV planes
-	vector<cv::Mat> yuv_planes = {y_plane, u_resized, v_resized};
-	cv::Mat yuv;
-	cv::merge(yuv_planes, yuv);
-
-	// Convert to BGR
-	cv::Mat bgr_frame;
-	cv::cvtColor(yuv, bgr_frame, cv::COLOR_YUV2BGR);
-	return bgr_frame;
+// 8-bit value of sample i of a P010 buffer
+static inline unsigned char p010_sample(const unsigned char* buffer, size_t i) {
+	const int v = (buffer[2 * i] | buffer[2 * i + 1] << 8) >> 6;
+	return (unsigned char)min((v + 2) >> 2, 255);
 }
 
-void bgr_to_yuv420p(const cv::Mat& bgr_frame, unsigned char* yuv_buffer) {
-	// Convert BGR to YUV
-	cv::Mat yuv;
-	cv::cvtColor(bgr_frame, yuv, cv::COLOR_BGR2YUV);
+void yuv420_to_bgr(const unsigned char* yuv_buffer, const YUVFormat& format, cv::Mat& bgr_frame,
+	vector<unsigned char>& scratch) {
+	const int w = format.width, h = format.height;
+	const unsigned char* samples = yuv_buffer;
+
+	// P010: same layout as NV12, rounded to 8 bits
+	if (format.layout == YUV_P010) {
+		const size_t n = size_t(w) * h * 3 / 2;
+		scratch.resize(n);
+		for (size_t i = 0; i < n; i++)
+			scratch[i] = p010_sample(yuv_buffer, i);
+		samples = scratch.data();
+	}
 
-	// Split into planes
-	vector<cv::Mat> yuv_planes;
-	cv::split(yuv, yuv_planes);
+	// The planes as one (3h/2) x w image, which cvtColor converts directly
+	const cv::Mat yuv(h * 3 / 2, w, CV_8UC1, const_cast<unsigned char*>(samples));
+	cv::cvtColor(yuv, bgr_frame, format.layout == YUV_I420 ? cv::COLOR_YUV2BGR_I420 : cv::COLOR_YUV2BGR_NV12);
+}
 
-	// Copy Y plane (full resolution)
-	yuv_planes[0].copyTo(cv::Mat(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC1, yuv_buffer));
+// BT.601 video range, 8 fractional bits; `bits` is the output depth (8 or 10)
+static inline int luma(int r, int g, int b, int bits) {
+	const int shift = 16 - bits;
+	return ((66 * r + 129 * g + 25 * b + (1 << (shift - 1))) >> shift) + (16 << (bits - 8));
+}
 
-	// Downsample and copy U plane
-	cv::Mat u_small;
-	cv::resize(yuv_planes[1], u_small, cv::Size(FRAME_WIDTH/2, FRAME_HEIGHT/2));
-	u_small.copyTo(cv::Mat(FRAME_HEIGHT/2, FRAME_WIDTH/2, CV_8UC1, 
-						  yuv_buffer + FRAME_WIDTH*FRAME_HEIGHT));
+// Same, from the sums of the four pixels of a 2x2 block (cvtColor takes the chroma of
+// the top-left pixel only, which aliases)
+static inline void chroma(int r4, int g4, int b4, int bits, int& u, int& v) {
+	const int shift = 18 - bits;
+	const int round = 1 << (shift - 1);
+	u = ((-38 * r4 - 74 * g4 + 112 * b4 + round) >> shift) + (128 << (bits - 8));
+	v = ((112 * r4 - 94 * g4 - 18 * b4 + round) >> shift) + (128 << (bits - 8));
+}
 
-	// Downsample and copy V plane
-	cv::Mat v_small;
-	cv::resize(yuv_planes[2], v_small, cv::Size(FRAME_WIDTH/2, FRAME_HEIGHT/2));
-	v_small.copyTo(cv::Mat(FRAME_HEIGHT/2, FRAME_WIDTH/2, CV_8UC1, 
-						  yuv_buffer + FRAME_WIDTH*FRAME_HEIGHT + (FRAME_WIDTH*FRAME_HEIGHT)/4));
+static inline void put16(unsigned char* p, int value10) {
+	const int v = value10 << 6;
+	p[0] = (unsigned char)(v & 0xff);
+	p[1] = (unsigned char)(v >> 8);
+}
+
+void bgr_to_yuv420(const cv::Mat& bgr_frame, const YUVFormat& format, unsigned char* yuv_buffer) {
+	CV_Assert(bgr_frame.type() == CV_8UC3 && bgr_frame.cols == format.width && bgr_frame.rows == format.height);
+	const int w = format.width, h = format.height;
+	const size_t luma_samples = size_t(w) * h;
+	const int bits = format.layout == YUV_P010 ? 10 : 8;
+
+	// One pass over pairs of rows: the luma of the 4 pixels of every 2x2 block and its chroma
+	cv::parallel_for_(cv::Range(0, h / 2), [&](const cv::Range& pairs) {
+		for (int j = pairs.start; j < pairs.end; j++) {
+			const unsigned char* row[2] = {bgr_frame.ptr<unsigned char>(2 * j), bgr_frame.ptr<unsigned char>(2 * j + 1)};
+			for (int i = 0; i < w / 2; i++) {
+				int r4 = 0, g4 = 0, b4 = 0;
+				for (int dy = 0; dy < 2; dy++) {
+					for (int dx = 0; dx < 2; dx++) {
+						const unsigned char* p = row[dy] + 3 * (2 * i + dx);
+						const int y = luma(p[2], p[1], p[0], bits);
+						const size_t at = size_t(2 * j + dy) * w + 2 * i + dx;
+						if (bits == 8)
+							yuv_buffer[at] = (unsigned char)y;
+						else
+							put16(yuv_buffer + 2 * at, y);
+						r4 += p[2];
+						g4 += p[1];
+						b4 += p[0];
+					}
+				}
+
+				int u, v;
+				chroma(r4, g4, b4, bits, u, v);
+				const size_t c = size_t(j) * (w / 2) + i;
+				switch (format.layout) {
+				case YUV_I420:
+					yuv_buffer[luma_samples + c] = (unsigned char)u;
+					yuv_buffer[luma_samples + luma_samples / 4 + c] = (unsigned char)v;
+					break;
+				case YUV_NV12:
+					yuv_buffer[luma_samples + 2 * c] = (unsigned char)u;
+					yuv_buffer[luma_samples + 2 * c + 1] = (unsigned char)v;
+					break;
+				case YUV_P010:
+					put16(yuv_buffer + 2 * (luma_samples + 2 * c), u);
+					put16(yuv_buffer + 2 * (luma_samples + 2 * c + 1), v);
+					break;
+				}
+			}
+		}
+	});
+}
+
+void yuv420_to_i420(const unsigned char* yuv_buffer, const YUVFormat& format, cv::Mat& i420_frame) {
+	const size_t luma_samples = size_t(format.width) * format.height;
+	const size_t chroma_samples = luma_samples / 4;
+	i420_frame.create(format.height * 3 / 2, format.width, CV_8UC1);
+	unsigned char* y = i420_frame.data;
+	unsigned char* u = y + luma_samples;
+	unsigned char* v = u + chroma_samples;
+	switch (format.layout) {
+	case YUV_I420:
+		memcpy(y, yuv_buffer, luma_samples + 2 * chroma_samples);
+		break;
+	case YUV_NV12:
+		memcpy(y, yuv_buffer, luma_samples);
+		for (size_t i = 0; i < chroma_samples; i++) {
+			u[i] = yuv_buffer[luma_samples + 2 * i];
+			v[i] = yuv_buffer[luma_samples + 2 * i + 1];
+		}
+		break;
+	case YUV_P010:
+		for (size_t i = 0; i < luma_samples; i++)
+			y[i] = p010_sample(yuv_buffer, i);
+		for (size_t i = 0; i < chroma_samples; i++) {
+			u[i] = p010_sample(yuv_buffer, luma_samples + 2 * i);
+			v[i] = p010_sample(yuv_buffer, luma_samples + 2 * i + 1);
+		}
+		break;
+	}
+}
+
+void i420_to_yuv420(const cv::Mat& i420_frame, const YUVFormat& format, unsigned char* yuv_buffer) {
+	const size_t luma_samples = size_t(format.width) * format.height;
+	const size_t chroma_samples = luma_samples / 4;
+	const unsigned char* y = i420_frame.data;
+	const unsigned char* u = y + luma_samples;
+	const unsigned char* v = u + chroma_samples;
+	switch (format.layout) {
+	case YUV_I420:
+		memcpy(yuv_buffer, y, luma_samples + 2 * chroma_samples);
+		break;
+	case YUV_NV12:
+		memcpy(yuv_buffer, y, luma_samples);
+		for (size_t i = 0; i < chroma_samples; i++) {
+			yuv_buffer[luma_samples + 2 * i] = u[i];
+			yuv_buffer[luma_samples + 2 * i + 1] = v[i];
+		}
+		break;
+	case YUV_P010:
+		// 8 bits to 10 (v << 2), at the top of the 16-bit sample
+		for (size_t i = 0; i < luma_samples; i++)
+			put16(yuv_buffer + 2 * i, y[i] << 2);
+		for (size_t i = 0; i < chroma_samples; i++) {
+			put16(yuv_buffer + 2 * (luma_samples + 2 * i), u[i] << 2);
+			put16(yuv_buffer + 2 * (luma_samples + 2 * i + 1), v[i] << 2);
+		}
+		break;
+	}
 }
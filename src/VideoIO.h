@@ -5,15 +5,73 @@
 
 using namespace std;
 
-// New YUV frame size constants
-#define FRAME_WIDTH 1280
-#define FRAME_HEIGHT 720
-// YUV420 format: Y plane (WxH) + U plane (W/2 x H/2) + V plane (W/2 x H/2)
-#define FRAME_SIZE (FRAME_WIDTH * FRAME_HEIGHT + (FRAME_WIDTH * FRAME_HEIGHT / 2))
-
-vector<cv::Mat> GetFramesFromYUV(const string& filename, double &fps);
-void WriteFramesToYUV(const vector<cv::Mat>& frames, const string& filename);
-
-// Helper functions for YUV conversion
-cv::Mat yuv420p_to_bgr(unsigned char* yuv_buffer);
-void bgr_to_yuv420p(const cv::Mat& bgr_frame, unsigned char* yuv_buffer);
\ No newline at end of file
+// Sample layouts of raw 4:2:0 YUV files
+enum YUVLayout {
+	YUV_I420,	// Y plane, then the U and V planes (yuv420p)
+	YUV_NV12,	// Y plane, then one plane of interleaved U,V
+	YUV_P010	// NV12 with 16-bit little-endian samples, the 10 significant bits on top
+};
+
+// Geometry, rate and layout of a raw YUV file (none of them is stored in the file)
+struct YUVFormat {
+	int width = 1280;
+	int height = 720;
+	double fps = 30;
+	YUVLayout layout = YUV_I420;
+
+	size_t FrameBytes() const;
+};
+
+// "i420" (or "yuv420p"), "nv12" or "p010"; false if unknown
+bool ParseYUVLayout(const string& name, YUVLayout& layout);
+
+// Reads a YUV file one frame at a time, so only the frame being decoded is in memory
+class YUVReader {
+public:
+	bool Open(const string& filename, const YUVFormat& format);
+	// Next frame as BGR (reusing bgr_frame if it has the right size); false at the end of the file
+	bool Read(cv::Mat& bgr_frame);
+	// Same, as an I420 image of (3h/2) x w, with no colour conversion
+	bool ReadI420(cv::Mat& i420_frame);
+	int FramesRead() const { return m_frames; }
+
+private:
+	bool ReadRaw(unsigned char* dst);
+
+	ifstream m_file;
+	YUVFormat m_format;
+	vector<unsigned char> m_buffer, m_scratch;
+	int m_frames = 0;
+};
+
+// Writes BGR frames to a YUV file as they come
+class YUVWriter {
+public:
+	bool Open(const string& filename, const YUVFormat& format);
+	void Write(const cv::Mat& bgr_frame);
+	void WriteI420(const cv::Mat& i420_frame);
+	int FramesWritten() const { return m_frames; }
+
+private:
+	void WriteRaw(const unsigned char* src);
+
+	ofstream m_file;
+	YUVFormat m_format;
+	vector<unsigned char> m_buffer;
+	int m_frames = 0;
+};
+
+// Whole-file versions (every frame in memory)
+vector<cv::Mat> GetFramesFromYUV(const string& filename, const YUVFormat& format);
+void WriteFramesToYUV(const vector<cv::Mat>& frames, const string& filename, const YUVFormat& format);
+
+// Conversions between one frame of the given format and BGR, both single pass (P010 is
+// narrowed to 8 bits in `scratch` first). BT.601 video range, chroma shared by 2x2 blocks.
+void yuv420_to_bgr(const unsigned char* yuv_buffer, const YUVFormat& format, cv::Mat& bgr_frame,
+	vector<unsigned char>& scratch);
+void bgr_to_yuv420(const cv::Mat& bgr_frame, const YUVFormat& format, unsigned char* yuv_buffer);
+
+// Between one frame of the given format and an I420 image ((3h/2) x w, 8 bits): planes copied,
+// chroma (de)interleaved and P010 samples rounded to 8 bits or widened
+void yuv420_to_i420(const unsigned char* yuv_buffer, const YUVFormat& format, cv::Mat& i420_frame);
+void i420_to_yuv420(const cv::Mat& i420_frame, const YUVFormat& format, unsigned char* yuv_buffer);
@@ -0,0 +1,195 @@
+#include "VideoPipeline.h"
+#include "MotionDenoiser.h"
+#include "VideoIO.h"
+#include <map>
+#include <thread>
+
+using namespace std;
+using namespace cv;
+
+static double seconds_since(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+VideoPipeline::VideoPipeline(size_t queue_depth, int flow_threads, FrameLayout layout, DenoiseMode mode,
+                             const string& backend)
+    : m_layout(layout), m_mode(mode), m_backend(backend), m_decoded(queue_depth), m_flowed(queue_depth), m_denoised(queue_depth) {
+    m_stats[0].name = "decode";
+    m_stats[1].name = "flow";
+    m_stats[1].threads = max(flow_threads, 1);
+    m_stats[2].name = "fuse";
+    m_stats[3].name = "encode";
+}
+
+bool VideoPipeline::Run(const string& input_yuv, const string& output_yuv, const YUVFormat& format) {
+    YUVReader reader;
+    YUVWriter writer;
+    Mat first;
+    if (!reader.Open(input_yuv, format) || !ReadFrame(reader, first)) {
+        cerr << "Failed to read input YUV file" << endl;
+        return false;
+    }
+    if (!writer.Open(output_yuv, format)) {
+        return false;
+    }
+    cout << "Streaming " << format.width << "x" << format.height << (m_layout == FRAME_I420 ? " I420" : " BGR")
+         << " frames at " << format.fps << " fps through " << m_decoded.Capacity()
+         << "-frame queues, " << m_stats[1].threads << " flow threads" << endl;
+
+    auto t0 = chrono::steady_clock::now();
+    thread decode(&VideoPipeline::Decode, this, ref(reader), first);
+    vector<thread> flow;
+    for (int t = 0; t < m_stats[1].threads; t++) {
+        flow.emplace_back(&VideoPipeline::Flow, this);
+    }
+    thread fuse(&VideoPipeline::Fuse, this);
+    Encode(writer);
+    decode.join();
+    for (thread& worker : flow) {
+        worker.join();
+    }
+    fuse.join();
+    m_wall = seconds_since(t0);
+    return true;
+}
+
+bool VideoPipeline::ReadFrame(YUVReader& reader, Mat& frame) {
+    return m_layout == FRAME_I420 ? reader.ReadI420(frame) : reader.Read(frame);
+}
+
+void VideoPipeline::Decode(YUVReader& reader, Mat first) {
+    PipelineItem item;
+    item.frame = first;
+    Mat prev_gray;
+    for (int index = 0;; index++) {
+        auto t0 = chrono::steady_clock::now();
+        item.index = index;
+        if (m_layout == FRAME_I420) {
+            item.frame.rowRange(0, item.frame.rows * 2 / 3).copyTo(item.gray);
+        } else {
+            cvtColor(item.frame, item.gray, COLOR_BGR2GRAY);
+        }
+        item.prev_gray = prev_gray;     // shared with the previous item, not copied
+        prev_gray = item.gray;
+        m_stats[0].busy += seconds_since(t0);
+        m_decoded.Push(move(item));
+        m_stats[0].frames++;
+
+        t0 = chrono::steady_clock::now();
+        item = PipelineItem();
+        item.frame = m_pool.Get();
+        const bool more = ReadFrame(reader, item.frame);
+        m_stats[0].busy += seconds_since(t0);
+        if (!more) {
+            break;
+        }
+    }
+    m_decoded.Close();
+}
+
+void VideoPipeline::Flow() {
+    // Workers split the cores, or FALDOI's OpenMP teams would oversubscribe them
+    int threads = max((int)thread::hardware_concurrency() / m_stats[1].threads, 1);
+    MotionEstimator estimator(CreateMotionBackend(m_backend, threads));
+    PipelineItem item;
+    int frames = 0;
+    double busy = 0;
+    while (m_decoded.Pop(item)) {
+        auto t0 = chrono::steady_clock::now();
+        if (!item.prev_gray.empty()) {
+            estimator.Estimate(item.prev_gray, item.gray, item.flow_x, item.flow_y);
+        }
+        item.gray.release();
+        item.prev_gray.release();
+        busy += seconds_since(t0);
+        frames++;
+        m_flowed.Push(move(item));
+    }
+
+    // The last worker out closes the queue
+    lock_guard<mutex> guard(m_stats_lock);
+    m_stats[1].frames += frames;
+    m_stats[1].busy += busy;
+    if (++m_flow_done == m_stats[1].threads) {
+        m_flowed.Close();
+    }
+}
+
+void VideoPipeline::Fuse() {
+    // The sink runs inside Push/Finish: the time it blocks on a full output queue is not work
+    double blocked = 0;
+    auto sink = [this, &blocked](int index, const Mat& denoised) {
+        auto t0 = chrono::steady_clock::now();
+        PipelineItem out;
+        out.index = index;
+        out.frame = m_pool.Get();
+        denoised.copyTo(out.frame);
+        m_denoised.Push(move(out));
+        m_stats[2].frames++;
+        blocked += seconds_since(t0);
+    };
+
+    // The flow workers finish out of order: frames wait here until their predecessors arrive
+    // (a handful at most, since the workers take the frames in order and take similar times)
+    unique_ptr<MotionDenoiser> denoiser;
+    map<int, PipelineItem> pending;
+    int next = 0;
+    PipelineItem item;
+    auto t0 = chrono::steady_clock::now();
+    double waiting = 0;
+    while (true) {
+        auto t1 = chrono::steady_clock::now();
+        const bool more = m_flowed.Pop(item);
+        waiting += seconds_since(t1);
+        if (!more) {
+            break;
+        }
+        const int index = item.index;
+        pending[index] = move(item);
+        for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it), next++) {
+            if (!denoiser) {
+                const Mat& frame = it->second.frame;
+                const Size size = m_layout == FRAME_I420 ? Size(frame.cols, frame.rows * 2 / 3) : frame.size();
+                denoiser.reset(new MotionDenoiser(size, sink, m_layout, m_mode));
+            }
+            denoiser->Push(it->second.frame, it->second.flow_x, it->second.flow_y);
+            m_pool.Put(it->second.frame);
+        }
+    }
+    if (denoiser) {
+        denoiser->Finish();
+    }
+    m_stats[2].busy = seconds_since(t0) - waiting - blocked;
+    m_denoised.Close();
+}
+
+void VideoPipeline::Encode(YUVWriter& writer) {
+    PipelineItem item;
+    while (m_denoised.Pop(item)) {
+        auto t0 = chrono::steady_clock::now();
+        if (m_layout == FRAME_I420) {
+            writer.WriteI420(item.frame);
+        } else {
+            writer.Write(item.frame);
+        }
+        m_pool.Put(item.frame);
+        m_stats[3].busy += seconds_since(t0);
+        m_stats[3].frames++;
+    }
+}
+
+void VideoPipeline::PrintStats() const {
+    const int frames = m_stats[3].frames;
+    printf("(video_denoiser) %d frames in %.3fs: %.2f fps\n", frames, m_wall, m_wall > 0 ? frames / m_wall : 0.0);
+    for (const StageStats& s : m_stats) {
+        printf("(video_denoiser) stage %-6s: %d thread(s), %d frames, busy %.3fs (%.1f%% utilization)\n", s.name,
+               s.threads, s.frames, s.busy, m_wall > 0 ? 100 * s.busy / (m_wall * s.threads) : 0.0);
+    }
+    const StageQueue<PipelineItem>* queues[3] = {&m_decoded, &m_flowed, &m_denoised};
+    for (int q = 0; q < 3; q++) {
+        printf("(video_denoiser) queue %s -> %s: depth max %zu/%zu, mean %.2f; producer blocked %.3fs, "
+               "consumer starved %.3fs\n", m_stats[q].name, m_stats[q + 1].name, queues[q]->MaxDepth(),
+               queues[q]->Capacity(), queues[q]->MeanDepth(), queues[q]->PushWaitSeconds(),
+               queues[q]->PopWaitSeconds());
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef __VideoPipeline__
+#define __VideoPipeline__
+
+#include <opencv2/opencv.hpp>
+#include "MotionDenoiser.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class YUVReader;
+class YUVWriter;
+struct YUVFormat;
+
+// Frame travelling through the pipeline (the flow is previous frame -> frame, empty for the
+// first). The decoder converts every frame to gray once and hands it to both pairs that use it.
+struct PipelineItem {
+    int index;
+    cv::Mat frame;
+    cv::Mat gray, prev_gray;
+    cv::Mat flow_x, flow_y;
+};
+
+// Bounded FIFO between two stages. A full queue blocks the producer and an empty one the
+// consumer; the time both spend blocked and the depth seen by every push tell which side
+// is the bottleneck.
+template<typename T>
+class StageQueue {
+public:
+    explicit StageQueue(size_t capacity) : m_capacity(capacity) {}
+
+    // Blocks while the queue is full
+    void Push(T item) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_not_full.wait(guard, [this] { return m_items.size() < m_capacity; });
+        m_push_wait += Seconds(t0);
+        m_items.push_back(std::move(item));
+        m_pushes++;
+        m_depth_sum += m_items.size();
+        m_max_depth = std::max(m_max_depth, m_items.size());
+        m_not_empty.notify_one();
+    }
+
+    // Blocks while the queue is empty; false once it is closed and drained
+    bool Pop(T& item) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_not_empty.wait(guard, [this] { return m_closed || !m_items.empty(); });
+        m_pop_wait += Seconds(t0);
+        if (m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    // No more pushes: the consumer drains what is left
+    void Close() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+
+    size_t Capacity() const { return m_capacity; }
+    size_t MaxDepth() const { return m_max_depth; }
+    double MeanDepth() const { return m_pushes ? double(m_depth_sum) / m_pushes : 0; }
+    double PushWaitSeconds() const { return m_push_wait; }
+    double PopWaitSeconds() const { return m_pop_wait; }
+
+private:
+    static double Seconds(std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_not_full, m_not_empty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    bool m_closed = false;
+
+    size_t m_pushes = 0, m_depth_sum = 0, m_max_depth = 0;
+    double m_push_wait = 0, m_pop_wait = 0;
+};
+
+// Frames given back by the last stage using them. Decoding and fusion take their output
+// frames from here, so a steady run allocates no frame buffers.
+class FramePool {
+public:
+    // A released frame, or an empty one to be allocated by the caller
+    cv::Mat Get() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_frames.empty()) {
+            return cv::Mat();
+        }
+        cv::Mat frame = m_frames.back();
+        m_frames.pop_back();
+        return frame;
+    }
+
+    void Put(cv::Mat& frame) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_frames.push_back(frame);
+        frame = cv::Mat();
+    }
+
+private:
+    std::mutex m_lock;
+    std::vector<cv::Mat> m_frames;
+};
+
+// video_denoiser as four concurrent stages: YUV decode -> pairwise flow -> temporal fusion
+// (MotionDenoiser) -> YUV encode, joined by queues of `queue_depth` frames. I/O overlaps
+// with the computation and memory stays bounded by the queues plus the denoiser's window.
+// The flow stage is a pool of `flow_threads` workers, each estimating whole pairs with its
+// own MotionEstimator on a `backend` (a CreateMotionBackend name) and an equal share of the
+// cores for backends that parallelise each pair; the fusion stage puts the pairs back in
+// order. With FRAME_I420 the frames stay in YUV from the input file to the output file.
+class VideoPipeline {
+public:
+    VideoPipeline(size_t queue_depth, int flow_threads, FrameLayout layout = FRAME_BGR,
+                  DenoiseMode mode = DENOISE_WINDOW, const std::string& backend = "dis_medium");
+
+    // Both files in `format`. False if the input cannot be read (or holds no frame) or the
+    // output cannot be created.
+    bool Run(const std::string& input_yuv, const std::string& output_yuv, const YUVFormat& format);
+
+    // Frames per second, busy time and utilization of every stage, queue depths and waits
+    void PrintStats() const;
+
+private:
+    struct StageStats {
+        const char* name;
+        int threads = 1;
+        int frames = 0;
+        double busy = 0;    // seconds spent working (not blocked on a queue), all threads
+    };
+
+    bool ReadFrame(YUVReader& reader, cv::Mat& frame);
+    void Decode(YUVReader& reader, cv::Mat first);
+    void Flow();
+    void Fuse();
+    void Encode(YUVWriter& writer);
+
+    FrameLayout m_layout;
+    DenoiseMode m_mode;
+    std::string m_backend;
+    StageQueue<PipelineItem> m_decoded, m_flowed, m_denoised;
+    FramePool m_pool;
+    StageStats m_stats[4];
+    std::mutex m_stats_lock;    // flow workers add their counters at the end
+    int m_flow_done = 0;
+    double m_wall = 0;
+};
+
+#endif
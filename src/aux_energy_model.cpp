@@ -117,7 +117,8 @@ void nltv_ini_dual_variables(
         const int n_d,
         const int radius,
         DualVariables *p,
-        DualVariables *q
+        DualVariables *q,
+        const float *weights
         ) {
     int size = w*h;
     for (int i = 0; i < size; i++)
@@ -154,7 +155,8 @@ void nltv_ini_dual_variables(
                             p[pos].api[it] = q[pos].api[it] = i+l;
                             p[pos].apj[it] = q[pos].apj[it] = j+k;
                             p[pos].rp[it] = q[pos].rp[it] = n_d - (it + 1);
-                            float wp = sqrt(get_weight(a, w, h, i, j, l, k, pd));
+                            float wp = weights ? weights[it*size + pos]
+                                               : sqrt(get_weight(a, w, h, i, j, l, k, pd));
                             p[pos].wp[it] = q[pos].wp[it] = wp;
                             wt += wp;
                             assert(p[pos].api[it] == q[pos].api[it]);
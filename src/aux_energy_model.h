@@ -29,7 +29,8 @@
                 const int n_d,
                 const int radius,
                 DualVariables *p,
-                DualVariables *q
+                DualVariables *q,
+                const float *weights  // n_d planes of precomputed wp (then `a` is not used) or nullptr
   );
 
  void non_local_divergence(
@@ -9,12 +9,14 @@
 #ifndef AUX_PARTITIONS
 #define AUX_PARTITIONS
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
 #include "aux_partitions.h"
 #include "energy_structures.h"
 #include "energy_model.h"
+#include "numa_utils.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////LOCAL PARTITION INTO SUBIMAGES////////////////////////////////
@@ -99,12 +101,6 @@ void  init_subimage_partitions(const float *i0, const float *i1, const float *i_
         t_pdata->height = sub_h[p];
         t_pdata->off_x = off_x[p];
         t_pdata->off_y = off_y[p];
-        t_pdata->oft0 = new float[sub_w[p] * sub_h[p] * 2];
-        t_pdata->oft1 = new float[sub_w[p] * sub_h[p] * 2];
-        t_pdata->ene_Go = new float[sub_w[p] * sub_h[p]];
-        t_pdata->ene_Ba = new float[sub_w[p] * sub_h[p]];
-        t_pdata->occ_Go = new float[sub_w[p] * sub_h[p]];
-        t_pdata->occ_Ba = new float[sub_w[p] * sub_h[p]];
         t_pdata->sal_go = sal_go;
         t_pdata->sal_ba = sal_ba;
 
@@ -121,7 +117,9 @@ void  init_subimage_partitions(const float *i0, const float *i1, const float *i_
     }
     assert(total_size == w_src * h_src);
 
-    for (unsigned p = 0; p < num_partitions; p++) {
+    // Every partition is filled by one thread; in per-socket mode (split_img == 2) it is the
+    // socket that will grow it, so its buffers are first-touched on the right node
+    auto fill_partition = [&](const int p) {
         int size = p_data->at(p)->width * p_data->at(p)->height;
         int size2 = size * n_channels;
         auto *i0_p = new float[size2];
@@ -198,6 +196,25 @@ void  init_subimage_partitions(const float *i0, const float *i1, const float *i_
         // Prepare auxiliar stuff
         prepare_stuff(&p_data->at(p)->stuffGo, &p_data->at(p)->ofGo, &p_data->at(p)->stuffBa, &p_data->at(p)->ofBa,
                       i0_p, i1_p, i_1_p, i2_p, params.pd, &i0n_dum, &i1n_dum, &i_1n_dum, &i2n_dum, sub_w[p], sub_h[p]);
+
+        // Planes image_to_partitions copies into at every local iteration
+        p_data->at(p)->oft0 = new float[size * 2]();
+        p_data->at(p)->oft1 = new float[size * 2]();
+        p_data->at(p)->ene_Go = new float[size]();
+        p_data->at(p)->ene_Ba = new float[size]();
+        p_data->at(p)->occ_Go = new float[size]();
+        p_data->at(p)->occ_Ba = new float[size]();
+    };
+
+    if (params.split_img == 2) {
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        for (int p : numa_socket_tasks(num_partitions, 1))
+            fill_partition(p);
+    } else {
+        for (int p = 0; p < num_partitions; p++)
+            fill_partition(p);
     }
 
     // TODO: merge fwd and bwd into one block of code (if possible)
@@ -2058,29 +2075,11 @@ void image_to_partitions(float *oft0, float *oft1, float *ene_Go, float *ene_Ba,
                          SpecificOFStuff *stuffBa, pq_cand &queue_Go, pq_cand &queue_Ba, const int n_partitions,
                          const int w_src, const int h_src, std::vector<PartitionData*> *p_data, bool img_to_part)
 {
-    // Update variables
+    // Every pixel of a partition is copied in either direction, so the partition planes
+    // (allocated once by init_subimage_partitions) are overwritten in place. Partitions are
+    // disjoint: in per-socket mode (split_img == 2) each socket copies its own ones.
     int n_channels = 2;
-    for (unsigned p = 0; p < n_partitions; p++) {
-        int size = p_data->at(p)->width * p_data->at(p)->height;
-        int size2 = size * n_channels;
-
-        // Define temporal variables and initialise them with the same default values as 'prepare_data_for_growing'
-        auto *ene_Go_p = new float[size];
-        auto *ene_Ba_p = new float[size];
-        auto *occ_Go_p = new float[size];
-        auto *occ_Ba_p = new float[size];
-        auto *oft0_p = new float[size2];
-        auto *oft1_p = new float[size2];
-        std::fill_n(ene_Go_p, size, INFINITY);
-        std::fill_n(ene_Ba_p, size, INFINITY);
-        std::fill_n(oft0_p, size2, NAN);
-        std::fill_n(oft1_p, size2, NAN);
-        // Leave occ as is if they are being computed
-        if (ofGo->params.val_method < 8) {
-            std::fill_n(occ_Go_p, size, 0);
-            std::fill_n(occ_Ba_p, size, 0);
-        }
-
+    auto update_partition = [&](const int p) {
         for (int k = 0; k < n_channels; k++)
             for (int j = 0; j < p_data->at(p)->height; j++)
                 for (int i = 0; i < p_data->at(p)->width; i++) {
@@ -2093,17 +2092,17 @@ void image_to_partitions(float *oft0, float *oft1, float *ene_Go, float *ene_Ba,
                     if (img_to_part) {
                         if (k < n_channels - 1) {
                             // Update everything here
-                            ene_Go_p[m] = ene_Go[idx];
-                            ene_Ba_p[m] = ene_Ba[idx];
-                            occ_Go_p[m] = occ_Go[idx];
-                            occ_Ba_p[m] = occ_Ba[idx];
-                            oft0_p[m] = oft0[idx];
-                            oft1_p[m] = oft1[idx];
+                            p_data->at(p)->ene_Go[m] = ene_Go[idx];
+                            p_data->at(p)->ene_Ba[m] = ene_Ba[idx];
+                            p_data->at(p)->occ_Go[m] = occ_Go[idx];
+                            p_data->at(p)->occ_Ba[m] = occ_Ba[idx];
+                            p_data->at(p)->oft0[m] = oft0[idx];
+                            p_data->at(p)->oft1[m] = oft1[idx];
 
                         } else {
                             // Only update variables with more than a channel
-                            oft0_p[m] = oft0[idx];
-                            oft1_p[m] = oft1[idx];
+                            p_data->at(p)->oft0[m] = oft0[idx];
+                            p_data->at(p)->oft1[m] = oft1[idx];
                         }
                     } else {
                         if (k < n_channels - 1) {
@@ -2121,17 +2120,23 @@ void image_to_partitions(float *oft0, float *oft1, float *ene_Go, float *ene_Ba,
                     }
                     update_partitions_structures(ofGo, ofBa, stuffGo, stuffBa, p_data->at(p), k, idx, m, img_to_part);
                 }
+    };
 
+    if (ofGo->params.split_img == 2) {
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        for (int p : numa_socket_tasks(n_partitions, 1))
+            update_partition(p);
+    } else {
+        for (int p = 0; p < n_partitions; p++)
+            update_partition(p);
+    }
+
+    for (int p = 0; p < n_partitions; p++) {
         if (img_to_part) {
-            p_data->at(p)->ene_Go = ene_Go_p;
-            p_data->at(p)->ene_Ba = ene_Ba_p;
-            p_data->at(p)->occ_Go = occ_Go_p;
-            p_data->at(p)->occ_Ba = occ_Ba_p;
-            p_data->at(p)->oft0 = oft0_p;
-            p_data->at(p)->oft1 = oft1_p;
             p_data->at(p)->ofGo.params = ofGo->params;
             p_data->at(p)->ofBa.params = ofBa->params;
-
         } else {
             ofGo->params = p_data->at(p)->ofGo.params;
             ofBa->params = p_data->at(p)->ofBa.params;
@@ -0,0 +1,82 @@
+#include "convergence.h"
+
+#include <cstdio>
+
+ConvergenceMonitor::ConvergenceMonitor(int max_iter, float rel_tol, int check_every, bool track_energy)
+        : max_iter(max_iter), rel_tol(rel_tol), check_every(check_every),
+          track_energy(track_energy || rel_tol > 0), cur_warp(0),
+          last_energy(NAN), last_rel(NAN), small_decreases(0), energy_stop(false) {}
+
+void ConvergenceMonitor::start_warp(const char *solver, int warp) {
+    cur_solver = solver;
+    cur_warp = warp;
+    last_energy = NAN;
+    last_rel = NAN;
+    small_decreases = 0;
+    energy_stop = false;
+    warp_start = std::chrono::system_clock::now();
+}
+
+void ConvergenceMonitor::end_warp(int n, float err, float tol) {
+    std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - warp_start;
+    WarpConvergence rec;
+    rec.solver = cur_solver;
+    rec.warp = cur_warp;
+    rec.iterations = n;
+    rec.error = err;
+    rec.energy = last_energy;
+    rec.rel_decrease = last_rel;
+    if (energy_stop)
+        rec.stop = "energy";
+    else if (err <= tol * tol)
+        rec.stop = "tol";
+    else
+        rec.stop = "max_iter";
+    rec.seconds = elapsed.count();
+    trace.push_back(rec);
+}
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// JSON has no NaN, so unevaluated values are written as null
+static void print_json_number(FILE *fd, double x) {
+    if (std::isfinite(x))
+        fprintf(fd, "%.9g", x);
+    else
+        fprintf(fd, "null");
+}
+
+bool ConvergenceMonitor::write(const std::string &path) const {
+    FILE *fd = fopen(path.c_str(), "w");
+    if (!fd) {
+        fprintf(stderr, "ERROR: could not open %s to write the convergence trace\n", path.c_str());
+        return false;
+    }
+
+    if (ends_with(path, ".json")) {
+        fprintf(fd, "{\"max_iter\": %d, \"rel_tol\": %g, \"check_every\": %d, \"warps\": [\n",
+                max_iter, rel_tol, check_every);
+        for (size_t k = 0; k < trace.size(); k++) {
+            const WarpConvergence &r = trace[k];
+            fprintf(fd, "  {\"solver\": \"%s\", \"warp\": %d, \"iterations\": %d, \"error\": ",
+                    r.solver.c_str(), r.warp, r.iterations);
+            print_json_number(fd, r.error);
+            fprintf(fd, ", \"energy\": ");
+            print_json_number(fd, r.energy);
+            fprintf(fd, ", \"rel_decrease\": ");
+            print_json_number(fd, r.rel_decrease);
+            fprintf(fd, ", \"stop\": \"%s\", \"seconds\": %.6f}%s\n",
+                    r.stop.c_str(), r.seconds, k + 1 < trace.size() ? "," : "");
+        }
+        fprintf(fd, "]}\n");
+    } else {
+        fprintf(fd, "solver,warp,iterations,error,energy,rel_decrease,stop,seconds\n");
+        for (const WarpConvergence &r : trace)
+            fprintf(fd, "%s,%d,%d,%.9g,%.9g,%.9g,%s,%.6f\n", r.solver.c_str(), r.warp, r.iterations,
+                    r.error, r.energy, r.rel_decrease, r.stop.c_str(), r.seconds);
+    }
+    fclose(fd);
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "parameters.h"
+
+/// Per-warp convergence telemetry and stopping rules for the global minimisation.
+/// Every global solver runs `while (err > tol*tol && n < max_iter)` per warp; the monitor
+/// adds a relative-energy-decrease rule on top and records how each warp finished.
+/// The rule needs the energy the solver minimises: only tvl2OF (methods 0 and 1) uses it.
+/// The NLTV and CSAD solvers trace the linearised TV-L1 energy as a proxy and ignore rel_tol.
+
+// How one warp of a global solver terminated
+struct WarpConvergence {
+    std::string solver;
+    int warp;
+    int iterations;
+    float error;            // last primal update error (err_D)
+    double energy;          // last evaluated energy (NAN if never evaluated)
+    double rel_decrease;    // last relative energy decrease (NAN if fewer than two evaluations)
+    std::string stop;       // "tol", "energy" or "max_iter"
+    double seconds;
+};
+
+class ConvergenceMonitor {
+public:
+    ConvergenceMonitor(int max_iter, float rel_tol, int check_every, bool track_energy);
+
+    // Resets the per-warp state; call before the iteration loop of each warp
+    void start_warp(const char *solver, int warp);
+
+    // Evaluates `energy()` every `check_every` iterations (only if energy is tracked)
+    // and returns true once it has decreased by less than `rel_tol` (but not increased:
+    // primal-dual updates are not monotone) for PAR_DEFAULT_ENERGY_STOPS checks in a row
+    template <class EnergyFn>
+    bool energy_converged(int n, EnergyFn energy) {
+        if (!trace_energy(n, energy))
+            return false;
+        if (rel_tol > 0 && last_rel >= 0 && last_rel < rel_tol)
+            small_decreases++;
+        else
+            small_decreases = 0;
+        energy_stop = small_decreases >= PAR_DEFAULT_ENERGY_STOPS;
+        return energy_stop;
+    }
+
+    // Same evaluation, for the trace only (energies that are not the one being minimised);
+    // true if the energy was evaluated at this iteration
+    template <class EnergyFn>
+    bool trace_energy(int n, EnergyFn energy) {
+        if (!track_energy || check_every <= 0 || n % check_every != 0)
+            return false;
+        const double e = energy();
+        if (!std::isnan(last_energy))
+            last_rel = (last_energy - e) / std::fmax(std::fabs(last_energy), 1e-12);
+        last_energy = e;
+        return true;
+    }
+
+    // Records the outcome of the warp that has just finished
+    void end_warp(int n, float err, float tol);
+
+    // Writes all the records; JSON if `path` ends in ".json", CSV otherwise
+    bool write(const std::string &path) const;
+
+    const std::vector<WarpConvergence> &records() const { return trace; }
+
+    int max_iter;
+    float rel_tol;
+    int check_every;
+    bool track_energy;
+
+private:
+    std::vector<WarpConvergence> trace;
+    std::string cur_solver;
+    int cur_warp;
+    double last_energy;
+    double last_rel;
+    int small_decreases;    // consecutive checks with 0 <= last_rel < rel_tol
+    bool energy_stop;
+    std::chrono::system_clock::time_point warp_start;
+};
+
+#endif // CONVERGENCE_H
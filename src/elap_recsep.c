@@ -212,6 +212,8 @@ void elap_recursive(float *out, float *in, int w, int h,
 		zoom_out_by_factor_two(ins, ws, hs, in, w, h);
 		elap_recursive(outs, ins, ws, hs, timestep, niter, scale - 1);
 		zoom_in_by_factor_two(init, w, h, outs, ws, hs);
+		free(ins);
+		free(outs);
 
     } else {
 		for (int i = 0 ; i < w*h; i++)
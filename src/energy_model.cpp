@@ -18,12 +18,15 @@
 extern "C" {
 #include "bicubic_interpolation.h"
 #include "mask.h"
+#include "image_kernels.h"
 }
 
 #include "utils.h"
 #include "energy_structures.h"
 #include "aux_energy_model.h"
 #include "energy_model.h"
+#include "numa_utils.h"
+#include "preprocess_cache.h"
 
 //Models
 #include "tvl2_model.h"
@@ -43,47 +46,112 @@ extern "C" {
 
 
 void rgb_to_gray(const float *in, const int w, const int h, float *out) {
-    const int size = w * h;
+    par_rgb_to_gray(in, w, h, out);
+}
 
-    for (int i = 0; i < size; i++) {
 
-        out[i] = .299 * in[i] + .587 * in[size + i] + .114 * in[2 * size + i];
+// Non-normalized images are assumed
+void rgb_to_lab(const float *in, int size, float *out) {
+    par_rgb_to_lab(in, size, out);
+}
 
-    }
 
-}
+// Gray, normalized (jointly) and smoothed versions of i0 and i1 in a_tmp and b_tmp,
+// with their centered gradients (a_tmp => ax, ay; b_tmp => bx, by)
+static void prepare_gray_pair(
+        const float *i0,
+        const float *i1,
+        const int pd,
+        const int w,
+        const int h,
+        float *a_tmp,
+        float *b_tmp,
+        float *ax,
+        float *ay,
+        float *bx,
+        float *by
+) {
+    PreprocessCache &cache = preprocess_cache();
+    uint64_t key = 0;
+    if (cache.enabled()) {
+        char tag[64];
+        snprintf(tag, sizeof(tag), "local-gray-pair sigma=%g", (double) PRESMOOTHING_SIGMA);
+        key = cache.key(tag, {{i0, (size_t) w*h*pd}, {i1, (size_t) w*h*pd}}, w, h);
+        if (cache.load(key, w, h, {a_tmp, b_tmp, ax, ay, bx, by}))
+            return;
+    }
 
-float pow2(const float f) { return f * f; }
+    if (pd!=1)
+    {
+        rgb_to_gray(i0, w, h, a_tmp);
+        rgb_to_gray(i1, w, h, b_tmp);
+    }
+    else
+    {
+        memcpy(a_tmp,i0,w*h*sizeof(float));
+        memcpy(b_tmp,i1,w*h*sizeof(float));
+    }
+    // normalize the images between 0 and 255
+    image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
+    par_gaussian_centered_gradient(a_tmp, ax, ay, w, h, PRESMOOTHING_SIGMA);
+    par_gaussian_centered_gradient(b_tmp, bx, by, w, h, PRESMOOTHING_SIGMA);
 
+    if (cache.enabled())
+        cache.store(key, w, h, {a_tmp, b_tmp, ax, ay, bx, by});
+}
 
-// Non-normalized images are assumed
-void rgb_to_lab(const float *in, int size, float *out) {
 
-    const float T = 0.008856;
-    const float color_attenuation = 1.5f;
-    for (int i = 0; i < size; i++) {
-
-        const float r = in[i] / 255.f;
-        const float g = in[i + size] / 255.f;
-        const float b = in[i + 2 * size] / 255.f;
-        float X = 0.412453 * r + 0.357580 * g + 0.180423 * b;
-        float Y = 0.212671 * r + 0.715160 * g + 0.072169 * b;
-        float Z = 0.019334 * r + 0.119193 * g + 0.950227 * b;
-        X /= 0.950456;
-        Z /= 1.088754;
-        float Y3 = pow(Y, 1. / 3);
-        float fX = X > T ? pow(X, 1. / 3) : 7.787 * X + 16 / 116.;
-        float fY = Y > T ? Y3 : 7.787 * Y + 16 / 116.;
-        float fZ = Z > T ? pow(Z, 1. / 3) : 7.787 * Z + 16 / 116.;
-        float L = Y > T ? 116 * Y3 - 16.0 : 903.3 * Y;
-        float A = 500 * (fX - fY);
-        float B = 200 * (fY - fZ);
-        // Correct L*a*b*: dark area or light area have less reliable colors
-        float correct_lab = exp(-color_attenuation * pow2(pow2(L / 100) - 0.6));
-        out[i] = L;
-        out[i + size] = A * correct_lab;
-        out[i + 2 * size] = B * correct_lab;
+// Non-local dual variables of both directions from the L*a*b* version of i0.
+// Only the weights depend on the image: they are what the cache keeps (n_d planes, wt is
+// their sum and is rebuilt on load)
+static void prepare_nltv_dual(
+        const float *i0,
+        const int pd,
+        const int w,
+        const int h,
+        DualVariables *p1,
+        DualVariables *q1,
+        DualVariables *p2,
+        DualVariables *q2
+) {
+    const int n_d = NL_DUAL_VAR;
+    const int radius = NL_BETA;
+    const int size = w*h;
+    PreprocessCache &cache = preprocess_cache();
+
+    if (cache.enabled()) {
+        char tag[96];
+        snprintf(tag, sizeof(tag), "nltv-weights beta=%d intensity=%g n_d=%d pd=%d",
+                 NL_BETA, (double) NL_INTENSITY, n_d, pd);
+        const uint64_t key = cache.key(tag, {{i0, (size_t) size*pd}}, w, h);
+
+        std::vector<float> weights((size_t) n_d * size);
+        std::vector<float *> planes(n_d);
+        for (int k = 0; k < n_d; k++)
+            planes[k] = weights.data() + (size_t) k * size;
+
+        if (!cache.load(key, w, h, planes)) {
+            auto *alb = new float[w*h*pd];
+            cached_rgb_to_lab(i0, w, h, pd, alb);
+            nltv_ini_dual_variables(alb, pd, w, h, n_d, radius, p1, q1, nullptr);
+            delete [] alb;
+            for (int i = 0; i < size; i++)
+                for (int k = 0; k < n_d; k++)
+                    planes[k][i] = p1[i].wp[k];
+            cache.store(key, w, h, std::vector<const float *>(planes.begin(), planes.end()));
+        } else {
+            nltv_ini_dual_variables(nullptr, pd, w, h, n_d, radius, p1, q1, weights.data());
+        }
+    } else {
+        auto *alb = new float[w*h*pd];
+        cached_rgb_to_lab(i0, w, h, pd, alb);
+        nltv_ini_dual_variables(alb, pd, w, h, n_d, radius, p1, q1, nullptr);
+        delete [] alb;
     }
+
+    // Both directions use the weights of I0
+    std::copy(p1, p1 + size, p2);
+    std::copy(q1, q1 + size, q2);
 }
 
 
@@ -156,6 +224,17 @@ BilateralFilterData *init_weights_bilateral(
     return Filter_data;
 }
 
+void free_weights_bilateral(
+        BilateralFilterData *filter_data,
+        int w,
+        int h) {
+
+    for (int ij = 0; ij < w * h; ij++)
+        delete[] filter_data->weights_filtering[ij].weight;
+    delete[] filter_data->weights_filtering;
+    delete[] filter_data;
+}
+
 
 // Initialization of Optical Flow data for global method
 OpticalFlowData init_Optical_Flow_Data(
@@ -164,11 +243,13 @@ OpticalFlowData init_Optical_Flow_Data(
     int w = params.w;
     int h = params.h;
     OpticalFlowData of{};
-    of.u1 = new float[w * h * 2];
+    // Whole-image buffers of the global step, first-touched by the threads that iterate on them
+    // (global_faldoi only: the local step uses the overload below)
+    of.u1 = numa_alloc_image(w * h, 2);
     of.u2 = of.u1 + w * h;
-    of.u1_ba = new float[w * h * 2];
+    of.u1_ba = numa_alloc_image(w * h, 2);
     of.u2_ba = of.u1_ba + w * h;
-    of.chi = new float[w * h];
+    of.chi = numa_alloc_image(w * h);
     of.params = params;
     return of;
 }
@@ -182,16 +263,19 @@ OpticalFlowData init_Optical_Flow_Data(
 ) {
     //int w = params.w;
     //int h = params.h;
+    // Zeroed by the calling thread alone. For split_img partitions that is the thread filling
+    // the partition, nested in a parallel region where numa_alloc_image could not split the
+    // touch anyway, and in per-socket mode it belongs to the socket that grows the partition.
     OpticalFlowData of{};
-    of.u1 = new float[w * h * 2];
+    of.u1 = new float[w * h * 2]();
     of.u2 = of.u1 + w * h;
-    of.u1_ba = new float[w * h * 2];
+    of.u1_ba = new float[w * h * 2]();
     of.u2_ba = of.u1_ba + w * h;
-    of.u1_filter = new float[w * h * 2];
+    of.u1_filter = new float[w * h * 2]();
     of.u2_filter = of.u1_filter + w * h;
-    of.chi = new float[w * h];
-    of.fixed_points = new int[w * h];
-    of.trust_points = new int[w * h];
+    of.chi = new float[w * h]();
+    of.fixed_points = new int[w * h]();
+    of.trust_points = new int[w * h]();
     of.saliency = saliency;
     of.params = params;
     of.params.w = w;
@@ -300,43 +384,14 @@ void prepare_stuff(
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
 
-            auto *alb = new float[w*h*pd];
-            auto *blb = new float[w*h*pd];
-
-            int n_d = NL_DUAL_VAR;
-            int radius = NL_BETA;
-
-            rgb_to_lab(i0, w*h, alb);
-            rgb_to_lab(i0, w*h, blb);
-            // std::printf("W:%d x H:%d\n Neir:%d, radius:%d\n",w,h,n_d,radius);
-            nltv_ini_dual_variables(alb, pd, w, h, n_d, radius,
-                                    ofStuff1->nltvl1.p, ofStuff1->nltvl1.q);
-            nltv_ini_dual_variables(blb, pd, w, h, n_d, radius,
-                                    ofStuff2->nltvl1.p, ofStuff2->nltvl1.q);
-            if (pd!=1)
-            {
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i0, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i0,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->nltvl1.I1x, ofStuff1->nltvl1.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->nltvl1.I1x, ofStuff2->nltvl1.I1y,
-                              w, h);
+            prepare_nltv_dual(i0, pd, w, h, ofStuff1->nltvl1.p, ofStuff1->nltvl1.q,
+                              ofStuff2->nltvl1.p, ofStuff2->nltvl1.q);
+            prepare_gray_pair(i0, i0, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->nltvl1.I1x, ofStuff2->nltvl1.I1y,
+                              ofStuff1->nltvl1.I1x, ofStuff1->nltvl1.I1y);
 
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
-
-            delete [] alb;
-            delete [] blb;
         }
             break;
         case M_TVCSAD:          // TVCSAD
@@ -349,25 +404,9 @@ void prepare_stuff(
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff1->tvcsad.pnei);
             std::printf("2 - Inicializado CSAD\n");
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff2->tvcsad.pnei);
-            if (pd!=1)
-            {
-                // std::printf("Numero canales:%d\n",pd);
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->tvcsad.I1x, ofStuff1->tvcsad.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->tvcsad.I1x, ofStuff2->tvcsad.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->tvcsad.I1x, ofStuff2->tvcsad.I1y,
+                              ofStuff1->tvcsad.I1x, ofStuff1->tvcsad.I1y);
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
             std::printf("Exitting CSAD\n");
@@ -378,49 +417,23 @@ void prepare_stuff(
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
 
-            auto *alb = new float[w*h*pd];
-            auto *blb = new float[w*h*pd];
 
-            int n_d = NL_DUAL_VAR;
-            int radius = NL_BETA;
             int rdt = DT_R;
             int ndt = DT_NEI;
             std::printf("Initializing CSAD\n");
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff1->nltvcsad.pnei);
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff2->nltvcsad.pnei);
 
-            rgb_to_lab(i0, w*h, alb);
-            rgb_to_lab(i0, w*h, blb);
-            // std::printf("W:%d x H:%d\n Neir:%d, radius:%d\n",w,h,n_d,radius);
-            nltv_ini_dual_variables(alb, pd, w, h, n_d, radius,
-                                    ofStuff1->nltvcsad.p, ofStuff1->nltvcsad.q);
-            nltv_ini_dual_variables(blb, pd, w, h, n_d, radius,
-                                    ofStuff2->nltvcsad.p, ofStuff2->nltvcsad.q);
+            prepare_nltv_dual(i0, pd, w, h, ofStuff1->nltvcsad.p, ofStuff1->nltvcsad.q,
+                              ofStuff2->nltvcsad.p, ofStuff2->nltvcsad.q);
             std::printf("Initializing NLTV\n");
-            if (pd!=1)
-            {
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->nltvcsad.I1x, ofStuff1->nltvcsad.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->nltvcsad.I1x, ofStuff2->nltvcsad.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->nltvcsad.I1x, ofStuff2->nltvcsad.I1y,
+                              ofStuff1->nltvcsad.I1x, ofStuff1->nltvcsad.I1y);
 
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
 
-            delete [] alb;
-            delete [] blb;
 
             std::printf("Exitting NLTV_CSAD\n");
 
@@ -437,28 +450,11 @@ void prepare_stuff(
             std::printf("Weights\n");
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
-            if (pd!=1)
-            {
-                // std::printf("Number of channels:%d\n",pd);
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->tvl2w.I1x, ofStuff1->tvl2w.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->tvl2w.I1x, ofStuff2->tvl2w.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->tvl2w.I1x, ofStuff2->tvl2w.I1y,
+                              ofStuff1->tvl2w.I1x, ofStuff1->tvl2w.I1y);
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
-
         }
             break;
         case M_NLTVCSAD_W:      // NLTV-CSAD with weights
@@ -472,49 +468,23 @@ void prepare_stuff(
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
 
-            auto *alb = new float[w*h*pd];
-            auto *blb = new float[w*h*pd];
 
-            int n_d = NL_DUAL_VAR;
-            int radius = NL_BETA;
             int rdt = DT_R;
             int ndt = DT_NEI;
             std::printf("Initializing CSAD\n");
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff1->nltvcsadw.pnei);
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff2->nltvcsadw.pnei);
 
-            rgb_to_lab(i0, w*h, alb);
-            rgb_to_lab(i0, w*h, blb);
-            // std::printf("W:%d x H:%d\n Neir:%d, radius:%d\n",w,h,n_d,radius);
-            nltv_ini_dual_variables(alb, pd, w, h, n_d, radius,
-                                    ofStuff1->nltvcsadw.p, ofStuff1->nltvcsadw.q);
-            nltv_ini_dual_variables(blb, pd, w, h, n_d, radius,
-                                    ofStuff2->nltvcsadw.p, ofStuff2->nltvcsadw.q);
+            prepare_nltv_dual(i0, pd, w, h, ofStuff1->nltvcsadw.p, ofStuff1->nltvcsadw.q,
+                              ofStuff2->nltvcsadw.p, ofStuff2->nltvcsadw.q);
             std::printf("Initializing NLTV\n");
-            if (pd!=1)
-            {
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->nltvcsadw.I1x, ofStuff1->nltvcsadw.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->nltvcsadw.I1x, ofStuff2->nltvcsadw.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->nltvcsadw.I1x, ofStuff2->nltvcsadw.I1y,
+                              ofStuff1->nltvcsadw.I1x, ofStuff1->nltvcsadw.I1y);
 
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
 
-            delete [] alb;
-            delete [] blb;
 
             std::printf("Exitting NLTV_CSAD with weights\n");
 
@@ -529,43 +499,14 @@ void prepare_stuff(
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
 
-            auto *alb = new float[w*h*pd];
-            auto *blb = new float[w*h*pd];
-
-            int n_d = NL_DUAL_VAR;
-            int radius = NL_BETA;
-
-            rgb_to_lab(i0, w*h, alb);
-            rgb_to_lab(i0, w*h, blb);
-            // std::printf("W:%d x H:%d\n Neir:%d, radius:%d\n",w,h,n_d,radius);
-            nltv_ini_dual_variables(alb, pd, w, h, n_d, radius,
-                                    ofStuff1->nltvl1w.p, ofStuff1->nltvl1w.q);
-            nltv_ini_dual_variables(blb, pd, w, h, n_d, radius,
-                                    ofStuff2->nltvl1w.p, ofStuff2->nltvl1w.q);
-            if (pd!=1)
-            {
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->nltvl1w.I1x, ofStuff1->nltvl1w.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->nltvl1w.I1x, ofStuff2->nltvl1w.I1y,
-                              w, h);
+            prepare_nltv_dual(i0, pd, w, h, ofStuff1->nltvl1w.p, ofStuff1->nltvl1w.q,
+                              ofStuff2->nltvl1w.p, ofStuff2->nltvl1w.q);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->nltvl1w.I1x, ofStuff2->nltvl1w.I1y,
+                              ofStuff1->nltvl1w.I1x, ofStuff1->nltvl1w.I1y);
 
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
-
-            delete [] alb;
-            delete [] blb;
         }
             break;
         case M_TVCSAD_W:        // TVCSAD with weights
@@ -582,25 +523,9 @@ void prepare_stuff(
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff1->tvcsadw.pnei);
             std::printf("2 - Initializing CSAD\n");
             csad_ini_pos_nei(w, h, ndt, rdt, ofStuff2->tvcsadw.pnei);
-            if (pd!=1)
-            {
-                // std::printf("Number of channels:%d\n",pd);
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->tvcsadw.I1x, ofStuff1->tvcsadw.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->tvcsadw.I1x, ofStuff2->tvcsadw.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->tvcsadw.I1x, ofStuff2->tvcsadw.I1y,
+                              ofStuff1->tvcsadw.I1x, ofStuff1->tvcsadw.I1y);
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
             std::printf("Exitting CSAD\n");
@@ -630,19 +555,14 @@ void prepare_stuff(
             // Normalize the images between 0 and 255
             image_normalization_4(i0_tmp, i1_tmp, i_1_tmp, i2_tmp, i0_tmp, i1_tmp, i_1_tmp, i2_tmp, w * h);
 
-            // Produce a smoothed version of the images
-            gaussian(i1_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(i2_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(i0_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(i_1_tmp, w, h, PRESMOOTHING_SIGMA);
-
+            // Produce a smoothed version of the images and its derivatives
             //TODO: change the computation of derivatives
             // Check what Onofre meant
-            centered_gradient(i1_tmp, ofStuff1->tvl2_occ.I1x, ofStuff1->tvl2_occ.I1y, w, h);
-            centered_gradient(i_1_tmp, ofStuff1->tvl2_occ.I_1x, ofStuff1->tvl2_occ.I_1y, w, h);
+            par_gaussian_centered_gradient(i1_tmp, ofStuff1->tvl2_occ.I1x, ofStuff1->tvl2_occ.I1y, w, h, PRESMOOTHING_SIGMA);
+            par_gaussian_centered_gradient(i_1_tmp, ofStuff1->tvl2_occ.I_1x, ofStuff1->tvl2_occ.I_1y, w, h, PRESMOOTHING_SIGMA);
 
-            centered_gradient(i0_tmp, ofStuff2->tvl2_occ.I1x, ofStuff2->tvl2_occ.I1y, w, h);
-            centered_gradient(i2_tmp, ofStuff2->tvl2_occ.I_1x, ofStuff2->tvl2_occ.I_1y, w, h);
+            par_gaussian_centered_gradient(i0_tmp, ofStuff2->tvl2_occ.I1x, ofStuff2->tvl2_occ.I1y, w, h, PRESMOOTHING_SIGMA);
+            par_gaussian_centered_gradient(i2_tmp, ofStuff2->tvl2_occ.I_1x, ofStuff2->tvl2_occ.I_1y, w, h, PRESMOOTHING_SIGMA);
 
             // Initialize g (weight)
             // The derivatives are taken from previous computation. Forward: I0, backward: I1
@@ -661,25 +581,9 @@ void prepare_stuff(
         {
             auto *a_tmp = new float[w*h];
             auto *b_tmp = new float[w*h];
-            if (pd!=1)
-            {
-                // std::printf("Number of channels:%d\n",pd);
-                rgb_to_gray(i0, w, h, a_tmp);
-                rgb_to_gray(i1, w, h, b_tmp);
-            }
-            else
-            {
-                memcpy(a_tmp,i0,w*h*sizeof(float));
-                memcpy(b_tmp,i1,w*h*sizeof(float));
-            }
-            // normalize the images between 0 and 255
-            image_normalization(a_tmp, b_tmp, a_tmp, b_tmp, w*h);
-            gaussian(a_tmp, w, h, PRESMOOTHING_SIGMA);
-            gaussian(b_tmp, w, h, PRESMOOTHING_SIGMA);
-            centered_gradient(b_tmp, ofStuff1->tvl2.I1x, ofStuff1->tvl2.I1y,
-                              w, h);
-            centered_gradient(a_tmp, ofStuff2->tvl2.I1x, ofStuff2->tvl2.I1y,
-                              w, h);
+            prepare_gray_pair(i0, i1, pd, w, h, a_tmp, b_tmp,
+                              ofStuff2->tvl2.I1x, ofStuff2->tvl2.I1y,
+                              ofStuff1->tvl2.I1x, ofStuff1->tvl2.I1y);
             *out_i0 = a_tmp;
             *out_i1 = b_tmp;
 
@@ -16,6 +16,7 @@
 ///
 
 BilateralFilterData *init_weights_bilateral(float* i0, int w, int h);
+void free_weights_bilateral(BilateralFilterData *filter_data, int w, int h);
 
 OpticalFlowData init_Optical_Flow_Data(const Parameters& params);
 OpticalFlowData init_Optical_Flow_Data(float *saliency, const Parameters& params, int w, int h);
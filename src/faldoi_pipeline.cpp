@@ -0,0 +1,759 @@
+#include "faldoi_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "parameters.h"
+#include "utils_preprocess.h"
+#include "preprocess_cache.h"
+#include "result_writer.h"
+#include "flow_io.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+extern "C" {
+#include "iio.h"
+#include "lib_sift_anatomy.h"
+#include "lib_keypoint.h"
+#include "lib_matching.h"
+#include "lib_scalespace.h"
+#include "lib_util.h"
+}
+
+using namespace std::chrono;
+
+static double seconds_since(system_clock::time_point t0) {
+    duration<double> d = system_clock::now() - t0;
+    return d.count();
+}
+
+// Value of `v` once printed with "%f" and scanned back, which is what the text files
+// between sift_cli, match_cli and sparse_flow hold
+static float as_printed(float v) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%f", v);
+    return strtof(buf, nullptr);
+}
+
+// Gray image as sift_cli reads it: io_png's Rec. 709 luma (alpha dropped), divided by 256
+static float *sift_gray(const float *in, int w, int h, int pd) {
+    const int size = w * h;
+    auto *x = new float[size];
+    for (int i = 0; i < size; i++) {
+        if (pd >= 3)
+            x[i] = (float) (0.212639005871510 * in[i]
+                            + 0.715168678767756 * in[size + i]
+                            + 0.072192315360734 * in[2 * size + i]);
+        else
+            x[i] = in[i];
+        x[i] /= 256.0;
+    }
+    return x;
+}
+
+// Keypoints and descriptors of one frame, with the values match_cli would read from the
+// output of sift_cli (coordinates with 6 decimals, descriptors truncated to integers)
+static struct sift_keypoints *sift_descriptors(const float *img, int w, int h, int pd, int n_spo) {
+    float *x = sift_gray(img, w, h, pd);
+    struct sift_parameters *p = sift_assign_default_parameters();
+    p->n_spo = n_spo;
+
+    struct sift_keypoints *kk[6];
+    for (int i = 0; i < 6; i++)
+        kk[i] = sift_malloc_keypoints();
+    struct sift_scalespace *ss[4];
+
+    struct sift_keypoints *k = sift_anatomy(x, w, h, p, ss, kk);
+
+    for (int i = 0; i < 6; i++)
+        sift_free_keypoints(kk[i]);
+    for (int i = 0; i < 4; i++)
+        sift_free_scalespace(ss[i]);
+    xfree(p);
+    delete[] x;
+
+    for (int n = 0; n < k->size; n++) {
+        struct keypoint *key = k->list[n];
+        key->x = as_printed(key->x);
+        key->y = as_printed(key->y);
+        key->sigma = as_printed(key->sigma);
+        key->theta = as_printed(key->theta);
+        const int n_descr = key->n_hist * key->n_hist * key->n_ori;
+        for (int d = 0; d < n_descr; d++)
+            key->descr[d] = (float) (int) key->descr[d];
+    }
+    return k;
+}
+
+// Matches of k1 in k2 (match_cli with the relative threshold), reordered like
+// cut_matching_list. SIFT's x is the row, so the list gets "y0 x0 y1 x1"
+static void sift_match(struct sift_keypoints *k1, struct sift_keypoints *k2, float thresh, MatchList &out) {
+    struct sift_keypoints *out_k1 = sift_malloc_keypoints();
+    struct sift_keypoints *out_k2A = sift_malloc_keypoints();
+    struct sift_keypoints *out_k2B = sift_malloc_keypoints();
+
+    matching(k1, k2, out_k1, out_k2A, out_k2B, thresh, 1);
+
+    out.clear();
+    out.reserve(4 * out_k1->size);
+    for (int n = 0; n < out_k1->size; n++) {
+        out.push_back(out_k1->list[n]->y);
+        out.push_back(out_k1->list[n]->x);
+        out.push_back(out_k2A->list[n]->y);
+        out.push_back(out_k2A->list[n]->x);
+    }
+
+    sift_free_keypoints(out_k1);
+    sift_free_keypoints(out_k2A);
+    sift_free_keypoints(out_k2B);
+}
+
+struct sift_keypoints *faldoi_frame_keypoints(
+        const float *img,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt
+) {
+    return sift_descriptors(img, w, h, pd, opt.sift_nspo);
+}
+
+void faldoi_free_keypoints(struct sift_keypoints *k) {
+    sift_free_keypoints(k);
+}
+
+void faldoi_match_keypoints(
+        struct sift_keypoints *k0,
+        struct sift_keypoints *k1,
+        const FaldoiPipelineOptions &opt,
+        MatchList &fwd,
+        MatchList &bwd,
+        FaldoiPipelineTimes *times
+) {
+    auto clk = system_clock::now();
+    auto match_bwd = std::async(std::launch::async, sift_match, k1, k0, opt.match_thresh, std::ref(bwd));
+    sift_match(k0, k1, opt.match_thresh, fwd);
+    match_bwd.get();
+    if (times)
+        times->matching = seconds_since(clk);
+    printf("(faldoi_pipeline) %zu forward and %zu backward matches\n", fwd.size() / 4, bwd.size() / 4);
+}
+
+void faldoi_sift_matches(
+        const float *i0,
+        const float *i1,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt,
+        MatchList &fwd,
+        MatchList &bwd,
+        FaldoiPipelineTimes *times
+) {
+    auto clk = system_clock::now();
+    auto desc_1 = std::async(std::launch::async, sift_descriptors, i1, w, h, pd, opt.sift_nspo);
+    struct sift_keypoints *k0 = sift_descriptors(i0, w, h, pd, opt.sift_nspo);
+    struct sift_keypoints *k1 = desc_1.get();
+    if (times)
+        times->descriptors = seconds_since(clk);
+    printf("(faldoi_pipeline) %d and %d SIFT keypoints\n", k0->size, k1->size);
+
+    faldoi_match_keypoints(k0, k1, opt, fwd, bwd, times);
+
+    sift_free_keypoints(k0);
+    sift_free_keypoints(k1);
+}
+
+void faldoi_pipeline(
+        float *i0,
+        float *i1,
+        float *i_1,
+        float *i2,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt,
+        const MatchList *fwd,
+        const MatchList *bwd,
+        float *out_flow,
+        float *local_flow,
+        float *sim,
+        FaldoiPipelineTimes *times
+) {
+    FaldoiPipelineTimes t;
+    const int size = w * h;
+    const bool four_frames = i_1 && i2;
+
+    // Seeds (given by the caller in the sequence mode, with its own descriptor and matching times)
+    MatchList sift_fwd, sift_bwd;
+    if (!fwd || !bwd) {
+        faldoi_sift_matches(i0, i1, w, h, pd, opt, sift_fwd, sift_bwd, &t);
+        fwd = &sift_fwd;
+        bwd = &sift_bwd;
+    } else if (times) {
+        t.descriptors = times->descriptors;
+        t.matching = times->matching;
+    }
+
+    auto clk = system_clock::now();
+    SeedList go, ba;
+    seeds_from_match_list(*fwd, w, h, go);
+    seeds_from_match_list(*bwd, w, h, ba);
+    t.sparse = seconds_since(clk);
+
+    // Occlusions need I-1 and I2; both steps fall back to TV-l2 coupled otherwise
+    int val_method = opt.method;
+    if (!four_frames && val_method == M_TVL1_OCC) {
+        fprintf(stderr, "Since only two images given, method is changed to TV-l2 coupled\n");
+        val_method = M_TVL1;
+    }
+
+    // Local step (what local_faldoi does with two or four frames and no saliency)
+    clk = system_clock::now();
+    Parameters params = init_params(opt.file_params, LOCAL_STEP);
+    params.w = w;
+    params.h = h;
+    params.pd = pd;
+    params.w_radio = opt.w_radio;
+    params.val_method = val_method;
+    params.iterations_of = opt.local_iters;
+    params.max_iter_patch = opt.patch_iters;
+    params.split_img = opt.split_img;
+    params.h_parts = opt.h_parts;
+    params.v_parts = opt.v_parts;
+    params.epsilon = opt.fb_thresh;
+    params.part_res = opt.partial_res;
+
+    auto *sal0 = new float[size];
+    auto *sal1 = new float[size];
+    std::fill(sal0, sal0 + size, 1.0f);
+    std::fill(sal1, sal1 + size, 1.0f);
+    auto *ene_val = new float[size];
+    auto *occ = new float[size];
+    for (int i = 0; i < 2 * size; i++)
+        out_flow[i] = NAN;
+
+    match_growing_variational(go, ba, i0, i1, four_frames ? i_1 : i0, four_frames ? i2 : i1, sal0, sal1, params,
+                              ene_val, out_flow, occ);
+    t.local = seconds_since(clk);
+
+    if (local_flow)
+        memcpy(local_flow, out_flow, 2 * size * sizeof(float));
+    if (sim)
+        memcpy(sim, ene_val, size * sizeof(float));
+
+    // Global step, initialised with the local flow (the occlusion mask goes through an
+    // integer image between the two executables)
+    if (!opt.local_only) {
+        clk = system_clock::now();
+        params = init_params(opt.file_params, GLOBAL_STEP);
+        params.w = w;
+        params.h = h;
+        params.warps = opt.warps;
+        params.val_method = val_method;
+        params.iterations_of = opt.global_iters;
+        if (val_method == M_TVL1_OCC) {
+            for (int i = 0; i < size; i++)
+                occ[i] = (float) (int) occ[i];
+        }
+        ConvergenceMonitor conv(opt.global_iters, PAR_DEFAULT_REL_TOL_ENERGY, PAR_DEFAULT_ENERGY_CHECK, false);
+
+        global_faldoi_run(i0, i1, four_frames ? i_1 : i1, pd, params, out_flow, occ, conv);
+        t.global = seconds_since(clk);
+    }
+
+    printf("(faldoi_pipeline) descriptors %.3fs, matching %.3fs, seeds %.3fs, "
+           "local %.3fs, global %.3fs\n", t.descriptors, t.matching, t.sparse, t.local, t.global);
+    if (times)
+        *times = t;
+
+    delete[] sal0;
+    delete[] sal1;
+    delete[] ene_val;
+    delete[] occ;
+}
+
+// One decoded frame of the sequence window and its keypoints (computed on first use)
+struct SequenceFrame {
+    int index;
+    float *img;
+    struct sift_keypoints *keys;
+};
+
+// Name of the frame without directory and extension, as the script names its outputs
+static std::string frame_stem(const std::string &filename) {
+    const size_t slash = filename.find_last_of('/');
+    std::string stem = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    const size_t dot = stem.find_last_of('.');
+    return dot == std::string::npos ? stem : stem.substr(0, dot);
+}
+
+int faldoi_sequence(
+        const std::vector<std::string> &filenames,
+        const FaldoiPipelineOptions &opt,
+        const std::string &out_dir,
+        size_t cache_bytes
+) {
+    const int n_frames = filenames.size();
+    if (n_frames < 2) {
+        fprintf(stderr, "ERROR: a sequence needs at least 2 frames (%d given)\n", n_frames);
+        return 1;
+    }
+    preprocess_cache().keep_in_memory(cache_bytes);
+    const bool occlusions = opt.method == M_TVL1_OCC;
+
+    int w = 0, h = 0, pd = 0;
+    std::deque<SequenceFrame> window;
+    int n_loaded = 0, n_described = 0;
+    FaldoiPipelineTimes total;
+    double load_secs = 0;
+
+    // Frame `f` of the window, decoded on first use
+    auto frame = [&](int f) -> SequenceFrame * {
+        for (auto &sf : window)
+            if (sf.index == f)
+                return &sf;
+        auto clk = system_clock::now();
+        int fw, fh, fpd;
+        float *img = iio_read_image_float_split(filenames[f].c_str(), &fw, &fh, &fpd);
+        load_secs += seconds_since(clk);
+        if (!img) {
+            fprintf(stderr, "ERROR: cannot read %s\n", filenames[f].c_str());
+            return nullptr;
+        }
+        if (n_loaded == 0) {
+            w = fw;
+            h = fh;
+            pd = fpd;
+        } else if (fw != w || fh != h || fpd != pd) {
+            fprintf(stderr, "ERROR: input images size mismatch (%s)\n", filenames[f].c_str());
+            free(img);
+            return nullptr;
+        }
+        n_loaded++;
+        window.push_back({f, img, nullptr});
+        return &window.back();
+    };
+
+    int ret = 0;
+    for (int t = 0; t + 1 < n_frames && ret == 0; t++) {
+        // Slide: frames before t-1 are not needed any more
+        while (!window.empty() && window.front().index < t - 1) {
+            free(window.front().img);
+            if (window.front().keys)
+                sift_free_keypoints(window.front().keys);
+            window.pop_front();
+        }
+
+        const bool four_frames = occlusions && t > 0 && t + 2 < n_frames;
+        SequenceFrame *f0 = frame(t);
+        SequenceFrame *f1 = f0 ? frame(t + 1) : nullptr;
+        SequenceFrame *f_1 = four_frames && f1 ? frame(t - 1) : nullptr;
+        SequenceFrame *f2 = four_frames && f1 ? frame(t + 2) : nullptr;
+        if (!f0 || !f1 || (four_frames && (!f_1 || !f2))) {
+            ret = 1;
+            break;
+        }
+        printf("(faldoi_pipeline) pair %d/%d: %s -> %s\n", t + 1, n_frames - 1,
+               filenames[t].c_str(), filenames[t + 1].c_str());
+
+        // Keypoints of I1 are kept for the next pair, where it is I0
+        FaldoiPipelineTimes t_pair;
+        auto clk = system_clock::now();
+        std::future<struct sift_keypoints *> keys_1;
+        if (!f1->keys)
+            keys_1 = std::async(std::launch::async, sift_descriptors, f1->img, w, h, pd, opt.sift_nspo);
+        if (!f0->keys) {
+            f0->keys = sift_descriptors(f0->img, w, h, pd, opt.sift_nspo);
+            n_described++;
+        }
+        if (keys_1.valid()) {
+            f1->keys = keys_1.get();
+            n_described++;
+        }
+        t_pair.descriptors = seconds_since(clk);
+
+        MatchList fwd, bwd;
+        faldoi_match_keypoints(f0->keys, f1->keys, opt, fwd, bwd, &t_pair);
+
+        const int size = w * h;
+        auto *out_flow = new float[2 * size];
+        auto *rg_flow = new float[2 * size];
+        auto *sim = new float[size];
+        faldoi_pipeline(f0->img, f1->img, f_1 ? f_1->img : nullptr, f2 ? f2->img : nullptr, w, h, pd, opt,
+                        &fwd, &bwd, out_flow, rg_flow, sim, &t_pair);
+
+        const std::string base = out_dir + "/" + frame_stem(filenames[t]) + "_sift";
+        // Written while the next pair is computed
+        result_writer().save(base + "_rg.flo", rg_flow, w, h, 2);
+        result_writer().save(base + "_sim.tiff", sim, w, h, 1);
+        result_writer().save(base + "_var.flo", out_flow, w, h, 2);
+        delete[] out_flow;
+        delete[] rg_flow;
+        delete[] sim;
+
+        total.descriptors += t_pair.descriptors;
+        total.matching += t_pair.matching;
+        total.sparse += t_pair.sparse;
+        total.local += t_pair.local;
+        total.global += t_pair.global;
+    }
+
+    for (auto &sf : window) {
+        free(sf.img);
+        if (sf.keys)
+            sift_free_keypoints(sf.keys);
+    }
+
+    result_writer().flush();
+    printf("(faldoi_pipeline) sequence: %d pairs, %d frames decoded and %d described once each\n",
+           n_frames - 1, n_loaded, n_described);
+    printf("(faldoi_pipeline) sequence totals: loading %.3fs, descriptors %.3fs, matching %.3fs, "
+           "seeds %.3fs, local %.3fs, global %.3fs\n", load_secs, total.descriptors, total.matching,
+           total.sparse, total.local, total.global);
+    return ret;
+}
+
+// iio reports decoding errors through a single jump buffer: concurrent jobs decode one at a time
+static std::mutex decode_lock;
+
+// One job of the batch: the pair (or quadruplet) of `list`, run with `threads` OpenMP threads
+static int batch_job(const std::string &list, const std::string &base, const FaldoiPipelineOptions &opt,
+                     int threads) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    std::vector<std::string> filenames;
+    std::ifstream infile(list);
+    std::string line;
+    while (std::getline(infile, line))
+        if (!line.empty())
+            filenames.push_back(line);
+    if (filenames.size() != 2 && filenames.size() != 4) {
+        fprintf(stderr, "ERROR: %s: %zu images given as input (2 or 4 expected)\n", list.c_str(), filenames.size());
+        return 1;
+    }
+
+    std::vector<float *> frames;
+    int w = 0, h = 0, pd = 0;
+    bool ok = true;
+    {
+        std::lock_guard<std::mutex> guard(decode_lock);
+        for (const auto &filename : filenames) {
+            int fw, fh, fpd;
+            float *img = iio_read_image_float_split(filename.c_str(), &fw, &fh, &fpd);
+            if (!img) {
+                fprintf(stderr, "ERROR: %s: cannot read %s\n", list.c_str(), filename.c_str());
+                ok = false;
+                break;
+            }
+            if (frames.empty()) {
+                w = fw;
+                h = fh;
+                pd = fpd;
+            }
+            frames.push_back(img);
+            if (fw != w || fh != h || fpd != pd) {
+                fprintf(stderr, "ERROR: %s: input images size mismatch\n", list.c_str());
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (ok) {
+        const int size = w * h;
+        auto *out_flow = new float[2 * size];
+        auto *rg_flow = new float[2 * size];
+        auto *sim = new float[size];
+        faldoi_pipeline(frames[0], frames[1], frames.size() == 4 ? frames[2] : nullptr,
+                        frames.size() == 4 ? frames[3] : nullptr, w, h, pd, opt, nullptr, nullptr,
+                        out_flow, rg_flow, sim, nullptr);
+        result_writer().save(base + "_rg.flo", rg_flow, w, h, 2);
+        result_writer().save(base + "_sim.tiff", sim, w, h, 1);
+        result_writer().save(base + "_var.flo", out_flow, w, h, 2);
+        delete[] out_flow;
+        delete[] rg_flow;
+        delete[] sim;
+    }
+    for (auto *f : frames)
+        free(f);
+    return ok ? 0 : 1;
+}
+
+int faldoi_batch(
+        const std::vector<std::string> &lists,
+        const FaldoiPipelineOptions &opt,
+        const std::string &out_dir,
+        int thread_budget,
+        int job_threads
+) {
+    const int n_jobs = lists.size();
+    if (n_jobs == 0) {
+        fprintf(stderr, "ERROR: no jobs given\n");
+        return 1;
+    }
+    thread_budget = std::max(thread_budget, 1);
+    // Fewest threads of a job: its forward and backward growings (and descriptors) run side by side
+    const int min_threads = job_threads > 0 ? std::min(job_threads, thread_budget) : std::min(2, thread_budget);
+
+    // Output names: the stem of the job's list (made unique with the job index if needed)
+    std::vector<std::string> bases(n_jobs);
+    for (int j = 0; j < n_jobs; j++) {
+        std::string stem = frame_stem(lists[j]);
+        for (int k = 0; k < j; k++)
+            if (frame_stem(lists[k]) == stem) {
+                stem += "_" + std::to_string(j);
+                break;
+            }
+        bases[j] = out_dir + "/" + stem + "_sift";
+    }
+
+    std::vector<double> latency(n_jobs, 0.0);
+    std::vector<int> threads(n_jobs, 0), status(n_jobs, 0);
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable released;
+    int free_threads = thread_budget;
+
+    auto clk = system_clock::now();
+    for (int j = 0; j < n_jobs; j++) {
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [&] { return free_threads >= min_threads; });
+        // Many jobs left: few threads each; the last ones share whatever is free
+        int k = job_threads > 0 ? min_threads : std::max(min_threads, free_threads / (n_jobs - j));
+        k = std::min(k, free_threads);
+        free_threads -= k;
+        threads[j] = k;
+        guard.unlock();
+
+        workers.emplace_back([&, j, k] {
+            auto t0 = system_clock::now();
+            status[j] = batch_job(lists[j], bases[j], opt, k);
+            latency[j] = seconds_since(t0);
+            printf("(faldoi_pipeline) batch job %d/%d (%s): %d thread(s), %.3fs%s\n", j + 1, n_jobs,
+                   lists[j].c_str(), k, latency[j], status[j] ? ", FAILED" : "");
+            std::lock_guard<std::mutex> done(lock);
+            free_threads += k;
+            released.notify_all();
+        });
+    }
+    for (auto &t : workers)
+        t.join();
+    result_writer().flush();
+    const double wall = seconds_since(clk);
+
+    int failed = 0;
+    double mean = 0, worst = 0;
+    for (int j = 0; j < n_jobs; j++) {
+        failed += status[j] != 0;
+        mean += latency[j] / n_jobs;
+        worst = std::max(worst, latency[j]);
+    }
+    printf("(faldoi_pipeline) batch: %d job(s), %d failed, thread budget %d; %.3fs wall, %.3f pairs/s, "
+           "latency mean %.3fs max %.3fs\n", n_jobs, failed, thread_budget, wall, (n_jobs - failed) / wall, mean,
+           worst);
+    return failed ? 1 : 0;
+}
+
+// Resident memory of the process (bytes), 0 if unknown
+static size_t resident_bytes() {
+    FILE *fd = fopen("/proc/self/statm", "r");
+    if (!fd)
+        return 0;
+    long total = 0, resident = 0;
+    const int n = fscanf(fd, "%ld %ld", &total, &resident);
+    fclose(fd);
+    return n == 2 ? (size_t) resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// Peak resident memory of the process (bytes)
+static size_t peak_resident_bytes() {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? (size_t) ru.ru_maxrss * 1024 : 0;
+}
+
+// The w x h window at (x0, y0) of the planes of a mapped frame, copied into `out`
+static void crop_planes(const MappedImage &img, int x0, int y0, int w, int h, std::vector<float> &out) {
+    const size_t size = (size_t) w * h;
+    out.resize(size * img.channels());
+    for (int c = 0; c < img.channels(); c++)
+        for (int j = 0; j < h; j++)
+            memcpy(out.data() + c * size + (size_t) j * w, img.plane(c) + (size_t) (y0 + j) * img.width() + x0,
+                   w * sizeof(float));
+}
+
+// Matches of `all` with both ends in the w x h window at (x0, y0), in window coordinates
+static void crop_matches(const MatchList &all, int x0, int y0, int w, int h, MatchList &out) {
+    out.clear();
+    for (size_t m = 0; m + 3 < all.size(); m += 4) {
+        const float a = all[m] - x0, b = all[m + 1] - y0, c = all[m + 2] - x0, d = all[m + 3] - y0;
+        if (a >= 0 && a < w && b >= 0 && b < h && c >= 0 && c < w && d >= 0 && d < h)
+            out.insert(out.end(), {a, b, c, d});
+    }
+}
+
+int faldoi_tiled(
+        const std::vector<std::string> &filenames,
+        const FaldoiPipelineOptions &opt,
+        const MatchList *fwd,
+        const MatchList *bwd,
+        const std::string &out_name,
+        const std::string &rg_name,
+        const std::string &sim_name,
+        const std::string &scratch_dir,
+        int tile,
+        int overlap
+) {
+    const int n_frames = filenames.size();
+    auto clk = system_clock::now();
+
+    // Frames go to planar scratch files one at a time and are read back through mappings
+    std::vector<MappedImage> frames(n_frames);
+    std::vector<std::string> scratch;
+    int w = 0, h = 0, pd = 0;
+    int ret = 0;
+    for (int f = 0; f < n_frames && ret == 0; f++) {
+        int fw, fh, fpd;
+        float *img = iio_read_image_float_split(filenames[f].c_str(), &fw, &fh, &fpd);
+        if (!img) {
+            fprintf(stderr, "ERROR: cannot read %s\n", filenames[f].c_str());
+            ret = 1;
+            break;
+        }
+        if (f == 0) {
+            w = fw;
+            h = fh;
+            pd = fpd;
+        }
+        scratch.push_back(scratch_dir + "/faldoi_tile_frame_" + std::to_string(getpid()) + "_" + std::to_string(f)
+                          + ".pfl");
+        const bool same_size = fw == w && fh == h && fpd == pd;
+        const bool spilled = same_size && save_image_planar(scratch.back(), img, fw, fh, fpd);
+        free(img);
+        if (!same_size)
+            fprintf(stderr, "ERROR: input images size mismatch\n");
+        if (!spilled || !frames[f].open(scratch.back()))
+            ret = 1;
+    }
+
+    // Outputs are mapped files too (the final .pfl itself when that is the requested format)
+    struct TiledOutput {
+        std::string name, path;
+        int pd;
+        PlanarFile file;
+    };
+    std::vector<TiledOutput> outputs(3);
+    outputs[0].name = out_name;
+    outputs[0].pd = 2;
+    outputs[1].name = rg_name;
+    outputs[1].pd = 2;
+    outputs[2].name = sim_name;
+    outputs[2].pd = 1;
+    for (int o = 0; o < 3 && ret == 0; o++) {
+        TiledOutput &out = outputs[o];
+        if (out.name.empty())
+            continue;
+        const bool in_place = out.name.size() > 4 && out.name.compare(out.name.size() - 4, 4, ".pfl") == 0;
+        out.path = in_place ? out.name
+                            : scratch_dir + "/faldoi_tile_out_" + std::to_string(getpid()) + "_" + std::to_string(o)
+                              + ".pfl";
+        if (!in_place)
+            scratch.push_back(out.path);
+        if (!out.file.create(out.path, w, h, out.pd)) {
+            fprintf(stderr, "ERROR: cannot create %s\n", out.path.c_str());
+            ret = 1;
+        }
+    }
+    printf("(faldoi_pipeline) tiled: %dx%d frames spilled to %s in %.3fs\n", w, h, scratch_dir.c_str(),
+           seconds_since(clk));
+
+    // Tiles: a `tile` x `tile` core, processed with `overlap` more pixels on every side
+    tile = std::max(tile, 1);
+    overlap = std::max(overlap, 0);
+    const int tiles_x = (w + tile - 1) / tile;
+    const int tiles_y = (h + tile - 1) / tile;
+    std::vector<std::vector<float>> crops(n_frames);
+    std::vector<float> out_flow, rg_flow, sim;
+    MatchList tile_fwd, tile_bwd;
+    FaldoiPipelineTimes total;
+    for (int ty = 0; ty < tiles_y && ret == 0; ty++)
+        for (int tx = 0; tx < tiles_x; tx++) {
+            auto t0 = system_clock::now();
+            const int cx0 = tx * tile, cy0 = ty * tile;
+            const int cx1 = std::min(w, cx0 + tile), cy1 = std::min(h, cy0 + tile);
+            const int x0 = std::max(0, cx0 - overlap), y0 = std::max(0, cy0 - overlap);
+            const int tw = std::min(w, cx1 + overlap) - x0, th = std::min(h, cy1 + overlap) - y0;
+            const size_t tsize = (size_t) tw * th;
+
+            for (int f = 0; f < n_frames; f++)
+                crop_planes(frames[f], x0, y0, tw, th, crops[f]);
+            if (fwd && bwd) {
+                crop_matches(*fwd, x0, y0, tw, th, tile_fwd);
+                crop_matches(*bwd, x0, y0, tw, th, tile_bwd);
+            }
+            out_flow.resize(2 * tsize);
+            rg_flow.resize(2 * tsize);
+            sim.resize(tsize);
+
+            FaldoiPipelineTimes t;
+            faldoi_pipeline(crops[0].data(), crops[1].data(), n_frames == 4 ? crops[2].data() : nullptr,
+                            n_frames == 4 ? crops[3].data() : nullptr, tw, th, pd, opt,
+                            fwd && bwd ? &tile_fwd : nullptr, fwd && bwd ? &tile_bwd : nullptr,
+                            out_flow.data(), rg_flow.data(), sim.data(), &t);
+
+            // Only the core goes to the output: its overlap belongs to the neighbouring tiles
+            const float *results[3] = {out_flow.data(), rg_flow.data(), sim.data()};
+            for (int o = 0; o < 3; o++) {
+                if (outputs[o].name.empty())
+                    continue;
+                for (int c = 0; c < outputs[o].pd; c++)
+                    for (int j = cy0; j < cy1; j++)
+                        memcpy(outputs[o].file.plane(c) + (size_t) j * w + cx0,
+                               results[o] + c * tsize + (size_t) (j - y0) * tw + (cx0 - x0),
+                               (cx1 - cx0) * sizeof(float));
+            }
+
+            total.descriptors += t.descriptors;
+            total.matching += t.matching;
+            total.sparse += t.sparse;
+            total.local += t.local;
+            total.global += t.global;
+            printf("(faldoi_pipeline) tile %d/%d [%d,%d)x[%d,%d) (%dx%d with the overlap): %.3fs, resident %.1f MB,"
+                   " peak %.1f MB\n", ty * tiles_x + tx + 1, tiles_x * tiles_y, cx0, cx1, cy0, cy1, tw, th,
+                   seconds_since(t0), resident_bytes() / 1048576.0, peak_resident_bytes() / 1048576.0);
+        }
+
+    // Other formats are written from the mappings, then the scratch files go away
+    for (int o = 0; o < 3 && ret == 0; o++) {
+        TiledOutput &out = outputs[o];
+        if (!out.name.empty() && out.path != out.name && !save_image_planar(out.name, out.file.plane(0), w, h, out.pd))
+            ret = 1;
+    }
+    frames.clear();
+    outputs.clear();
+    for (const auto &path : scratch)
+        unlink(path.c_str());
+
+    if (ret == 0)
+        printf("(faldoi_pipeline) tiled totals: %d tiles, descriptors %.3fs, matching %.3fs, seeds %.3fs, "
+               "local %.3fs, global %.3fs, peak resident %.1f MB\n", tiles_x * tiles_y, total.descriptors,
+               total.matching, total.sparse, total.local, total.global, peak_resident_bytes() / 1048576.0);
+    return ret;
+}
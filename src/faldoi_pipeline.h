@@ -0,0 +1,183 @@
+#ifndef FALDOI_PIPELINE_H
+#define FALDOI_PIPELINE_H
+
+#include <string>
+#include <vector>
+
+#include "energy_structures.h"
+#include "convergence.h"
+#include "match_file.h"
+
+/// In-memory version of the chain that scripts_python/faldoi_sift.py runs through the
+/// filesystem: SIFT descriptors and matches in both directions, sparse seeds, local growing
+/// (local_faldoi) and global refinement (global_faldoi). Every intermediate result is rounded
+/// the way the text files of the script round it, so the final flow is the same.
+///
+/// Frames are planar float images (pd channels, [0, 255]) as read by iio.
+
+// Local step (local_faldoi.cpp): dense flow grown from the seeds `go` and `ba`
+void match_growing_variational(
+        const SeedList &go, // seeds I0 -> I1, in raster order
+        const SeedList &ba, // seeds I1 -> I0
+        float *i0,
+        float *i1,
+        float *i_1,         // I-1 and I2 (only read by the occlusion model)
+        float *i2,
+        float *sal_go,      // saliency of I0 and I1
+        float *sal_ba,
+        Parameters params,  // LOCAL_STEP parameters (w, h and pd set)
+        float *ene_val,     // output energy (similarity) map
+        float *out_flow,    // output flow (two planes)
+        float *out_occ      // output occlusion mask
+);
+
+// Global step (global_faldoi.cpp): refines `flow` (two planes) in place. i_1 and the occlusion
+// mask `occ` (refined in place) are only used by the occlusion model. params must hold w, h,
+// val_method, warps and iterations_of
+void global_faldoi_run(
+        float *i0,
+        float *i1,
+        float *i_1,
+        int pd,
+        Parameters params,
+        float *flow,
+        float *occ,
+        ConvergenceMonitor &conv
+);
+
+// Match list, "x0 y0 x1 y1" (column, row in I0 and in I1) per match, like the *_cut.txt files
+typedef std::vector<float> MatchList;
+
+// Options of the chain; the defaults are those of faldoi_sift.py
+struct FaldoiPipelineOptions {
+    int sift_nspo = 15;         // SIFT scales per octave (sift_cli -ss_nspo)
+    float match_thresh = 0.6f;  // relative distance threshold of match_cli
+    std::string file_params;    // file of parameters shared by both steps ("" for the defaults)
+    int method = M_TVL1;
+    int w_radio = 5;
+    int local_iters = 3;
+    int patch_iters = 4;
+    int split_img = 0;
+    int h_parts = 3;
+    int v_parts = 2;
+    float fb_thresh = 0.45f;
+    int partial_res = 0;
+    int warps = 5;
+    int global_iters = 400;
+    bool local_only = false;    // stop after the local step (no global refinement)
+};
+
+// Seconds spent in every stage
+struct FaldoiPipelineTimes {
+    double descriptors = 0;
+    double matching = 0;
+    double sparse = 0;          // seed lists of the matches
+    double local = 0;
+    double global = 0;
+};
+
+struct sift_keypoints;
+
+// SIFT keypoints and descriptors of one frame, as match_cli reads them from sift_cli's output.
+// Released with faldoi_free_keypoints
+struct sift_keypoints *faldoi_frame_keypoints(
+        const float *img,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt
+);
+void faldoi_free_keypoints(struct sift_keypoints *k);
+
+// Matches k0 -> k1 (fwd) and k1 -> k0 (bwd) as match_cli + cut_matching_list give them.
+// Both directions run concurrently
+void faldoi_match_keypoints(
+        struct sift_keypoints *k0,
+        struct sift_keypoints *k1,
+        const FaldoiPipelineOptions &opt,
+        MatchList &fwd,
+        MatchList &bwd,
+        FaldoiPipelineTimes *times   // may be null
+);
+
+// SIFT matches I0 -> I1 (fwd) and I1 -> I0 (bwd), as sift_cli + match_cli + cut_matching_list
+// give them. Both frames are described concurrently, like the two processes of the script
+void faldoi_sift_matches(
+        const float *i0,
+        const float *i1,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt,
+        MatchList &fwd,
+        MatchList &bwd,
+        FaldoiPipelineTimes *times   // may be null
+);
+
+// Whole chain. i_1 and i2 may be null (two-frame run, no occlusions). If `fwd` and `bwd` are
+// given they are used as the seeds (e.g. filtered deep matches) and SIFT is skipped.
+// local_flow (two planes) and sim receive the output of the local step if not null
+void faldoi_pipeline(
+        float *i0,
+        float *i1,
+        float *i_1,
+        float *i2,
+        int w,
+        int h,
+        int pd,
+        const FaldoiPipelineOptions &opt,
+        const MatchList *fwd,
+        const MatchList *bwd,
+        float *out_flow,
+        float *local_flow,
+        float *sim,
+        FaldoiPipelineTimes *times
+);
+
+// Sequence mode: flows of every pair (t, t+1) of `filenames`, written to out_dir as
+// <frame t>_sift_rg.flo, <frame t>_sift_sim.tiff and <frame t>_sift_var.flo (the names of the
+// script). A sliding window keeps the decoded frames t-1..t+2 and the keypoints of t and t+1,
+// and the preprocessing cache keeps up to `cache_bytes` of planes in memory, so every
+// per-frame artifact is computed once. With the occlusion model, I-1 and I2 are the neighbours
+// in the list (the first and last pairs only have two frames). Returns 0 on success
+int faldoi_sequence(
+        const std::vector<std::string> &filenames,
+        const FaldoiPipelineOptions &opt,
+        const std::string &out_dir,
+        size_t cache_bytes
+);
+
+// Batch mode: one job per list of frames (an ims.txt of the scripts: I0, I1 and optionally I-1,
+// I2), written to out_dir as <list>_sift_rg.flo, <list>_sift_sim.tiff and <list>_sift_var.flo.
+// Jobs run concurrently within `thread_budget` threads: each one gets job_threads OpenMP threads,
+// or (job_threads <= 0) an even share of the free threads, at least 2, so a long list runs many
+// narrow jobs and the tail (or a single job) gets the whole machine. Prints the latency of every
+// job and the throughput. Returns 0 if every job succeeded
+int faldoi_batch(
+        const std::vector<std::string> &lists,
+        const FaldoiPipelineOptions &opt,
+        const std::string &out_dir,
+        int thread_budget,
+        int job_threads
+);
+
+// Tiled (out-of-core) mode, for frames whose planes do not fit in memory many times over: the
+// frames of `filenames` are spilled to planar files in scratch_dir and mapped, and the chain runs
+// on `tile` x `tile` tiles grown by `overlap` pixels on every side, so only the planes of one
+// tile are resident. The core of every tile goes to mapped output files, written in place when
+// a name ends in .pfl (rg_name and sim_name may be empty). Given matches are cut to each tile;
+// otherwise SIFT runs per tile. Prints the time and memory of every tile. Returns 0 on success
+int faldoi_tiled(
+        const std::vector<std::string> &filenames,
+        const FaldoiPipelineOptions &opt,
+        const MatchList *fwd,
+        const MatchList *bwd,
+        const std::string &out_name,
+        const std::string &rg_name,
+        const std::string &sim_name,
+        const std::string &scratch_dir,
+        int tile,
+        int overlap
+);
+
+#endif // FALDOI_PIPELINE_H
@@ -0,0 +1,218 @@
+// Single-process replacement of scripts_python/faldoi_sift.py (and, with -matches_fwd/-matches_bwd,
+// of the part of faldoi_deep.py that follows the deep matching): one read of the frames, SIFT,
+// matching, sparse seeds, local and global steps in memory.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+extern "C" {
+#include "iio.h"
+}
+
+#include "faldoi_pipeline.h"
+#include "parameters.h"
+#include "utils_preprocess.h"
+#include "numa_utils.h"
+#include "preprocess_cache.h"
+#include "result_writer.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+
+    using namespace chrono;
+    system_clock::time_point today = system_clock::now();
+    time_t tt = system_clock::to_time_t(today);
+    cerr << "Starting  date: " << ctime(&tt);
+
+    // Options (same names as the executables they replace; defaults of faldoi_sift.py)
+    FaldoiPipelineOptions opt;
+    vector<string> args(argv, argv + argc);
+    opt.method = stoi(pick_option(args, "m", to_string(opt.method)));
+    opt.w_radio = stoi(pick_option(args, "wr", to_string(opt.w_radio)));
+    opt.file_params = pick_option(args, "p", "");
+    opt.local_iters = stoi(pick_option(args, "loc_it", to_string(opt.local_iters)));
+    opt.patch_iters = stoi(pick_option(args, "max_pch_it", to_string(opt.patch_iters)));
+    opt.split_img = stoi(pick_option(args, "split_img", to_string(opt.split_img)));
+    opt.h_parts = stoi(pick_option(args, "h_parts", to_string(opt.h_parts)));
+    opt.v_parts = stoi(pick_option(args, "v_parts", to_string(opt.v_parts)));
+    opt.fb_thresh = stof(pick_option(args, "fb_thresh", to_string(opt.fb_thresh)));
+    opt.partial_res = stoi(pick_option(args, "partial_res", to_string(opt.partial_res)));
+    opt.warps = stoi(pick_option(args, "w", to_string(opt.warps)));
+    opt.global_iters = stoi(pick_option(args, "glb_iters", to_string(opt.global_iters)));
+    opt.sift_nspo = stoi(pick_option(args, "nsp", to_string(opt.sift_nspo)));
+    opt.local_only = pick_option(args, "local_only", "0") == "1";    // 1: skip the global step
+    auto filename_rg = pick_option(args, "rg", "");                 // Output of the local step (.flo)
+    auto filename_sim = pick_option(args, "sim", "");               // Similarity map of the local step
+    auto matches_fwd = pick_option(args, "matches_fwd", "");        // Precomputed seeds (skip SIFT)
+    auto matches_bwd = pick_option(args, "matches_bwd", "");
+    auto affinity = pick_option(args, "affinity", to_string(PAR_DEFAULT_AFFINITY));
+    auto cache_dir = pick_option(args, "cache_dir", "");
+    auto sequence = pick_option(args, "seq", "0");                  // 1: frame list, one flow per pair
+    auto seq_cache_mb = stoi(pick_option(args, "seq_cache_mb", "256"));
+    auto batch = pick_option(args, "batch", "0");                   // 1: list of ims.txt, one job each
+#ifdef _OPENMP
+    auto batch_threads = stoi(pick_option(args, "threads", to_string(omp_get_max_threads())));
+#else
+    auto batch_threads = stoi(pick_option(args, "threads", "1"));
+#endif
+    auto job_threads = stoi(pick_option(args, "job_threads", "0")); // 0: chosen per job
+    auto tile = stoi(pick_option(args, "tile", "0"));               // > 0: out-of-core, tile x tile cores
+    auto tile_overlap = stoi(pick_option(args, "tile_overlap", "96"));
+    auto tile_dir = pick_option(args, "tile_dir", "");              // Scratch files (def. output folder)
+
+    const bool seq_mode = sequence == "1";
+    const bool batch_mode = batch == "1";
+    if (args.size() != 3 || matches_fwd.empty() != matches_bwd.empty()
+        || ((seq_mode || batch_mode) && !matches_fwd.empty()) || (seq_mode && batch_mode)
+        || (tile > 0 && (seq_mode || batch_mode))) {
+        fprintf(stderr, "usage:\n\t%s ims.txt out.flo [-m method_id] [-wr windows_radio] [-p file of parameters]"
+                        " [-loc_it local_iters] [-max_pch_it max_iters_patch] [-split_img split_image]"
+                        " [-h_parts horiz_parts] [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val]"
+                        " [-w num_warps] [-glb_iters global_iters] [-local_only 1] [-nsp sift_scales_per_octave]"
+                        " [-rg local_out.flo] [-sim sim_map.tiff] [-matches_fwd fwd.txt -matches_bwd bwd.txt]"
+                        " [-affinity none|close|spread] [-cache_dir dir]"
+                        " [-tile size [-tile_overlap pixels] [-tile_dir scratch_dir]]\n"
+                        "\t%s -seq 1 frames.txt out_dir [same options but -rg, -sim and -matches_*]"
+                        " [-seq_cache_mb megabytes]\n"
+                        "\t%s -batch 1 jobs.txt out_dir [same options but -rg, -sim and -matches_*]"
+                        " [-threads budget] [-job_threads threads_per_job]\n",
+                args[0].c_str(), args[0].c_str(), args[0].c_str());
+        return 1;
+    }
+
+    int affinity_mode = parse_affinity(affinity);
+    if (affinity_mode < 0) {
+        fprintf(stderr, "ERROR: unknown affinity '%s' (none, close or spread)\n", affinity.c_str());
+        return 1;
+    }
+    if (opt.split_img == 2 && affinity_mode == AFFINITY_NONE)
+        affinity_mode = AFFINITY_CLOSE;
+    // Concurrent jobs have their own thread teams: pinning the main team would stack them
+    if (batch_mode && affinity_mode != AFFINITY_NONE) {
+        fprintf(stderr, "WARNING: -affinity is ignored in batch mode\n");
+        affinity_mode = AFFINITY_NONE;
+    }
+    numa_pin_threads(affinity_mode);
+    preprocess_cache().open(cache_dir);
+
+    // Same folder the script creates for the partial results of local_faldoi
+    if (opt.partial_res == 1) {
+        mkdir("../Results", 0755);
+        mkdir("../Results/Partial_results", 0755);
+    }
+
+    // Frames: I0, I1 and optionally I-1, I2 (or the whole sequence, or the jobs of a batch)
+    vector<string> filenames;
+    ifstream infile(args[1]);
+    string line;
+    while (getline(infile, line))
+        if ((!seq_mode && !batch_mode) || !line.empty())
+            filenames.push_back(line);
+
+    if (batch_mode) {
+        mkdir(args[2].c_str(), 0755);
+        int ret = faldoi_batch(filenames, opt, args[2], batch_threads, job_threads);
+        preprocess_cache().print_stats("faldoi_pipeline");
+        result_writer().print_stats("faldoi_pipeline");
+        today = system_clock::now();
+        tt = system_clock::to_time_t(today);
+        cerr << "Finishing date: " << ctime(&tt);
+        return ret;
+    }
+
+    if (seq_mode) {
+        mkdir(args[2].c_str(), 0755);
+        int ret = faldoi_sequence(filenames, opt, args[2], (size_t) max(seq_cache_mb, 0) << 20);
+        preprocess_cache().print_stats("faldoi_pipeline");
+        result_writer().print_stats("faldoi_pipeline");
+        today = system_clock::now();
+        tt = system_clock::to_time_t(today);
+        cerr << "Finishing date: " << ctime(&tt);
+        return ret;
+    }
+
+    if (filenames.size() != 2 && filenames.size() != 4) {
+        fprintf(stderr, "ERROR: %zu images given as input\n", filenames.size());
+        fprintf(stderr, "Usage: 2 images (I0, I1) or 4 images (I0, I1, I-1, I2)\n");
+        return 1;
+    }
+
+    MatchList fwd, bwd;
+    if (!matches_fwd.empty()) {
+        if (!read_match_list(matches_fwd, fwd) || !read_match_list(matches_bwd, bwd))
+            return fprintf(stderr, "ERROR: cannot read the match lists\n");
+    }
+
+    if (tile > 0) {
+        if (tile_dir.empty()) {
+            const size_t slash = args[2].rfind('/');
+            tile_dir = slash == string::npos ? "." : args[2].substr(0, slash + 1);
+        }
+        int ret = faldoi_tiled(filenames, opt, matches_fwd.empty() ? nullptr : &fwd,
+                               matches_bwd.empty() ? nullptr : &bwd, args[2], filename_rg, filename_sim,
+                               tile_dir, tile, tile_overlap);
+        preprocess_cache().print_stats("faldoi_pipeline");
+        today = system_clock::now();
+        tt = system_clock::to_time_t(today);
+        cerr << "Finishing date: " << ctime(&tt);
+        return ret;
+    }
+
+    auto clk = system_clock::now();
+    vector<float *> frames;
+    int w[4], h[4], pd[4];
+    for (size_t f = 0; f < filenames.size(); f++) {
+        frames.push_back(iio_read_image_float_split(filenames[f].c_str(), w + f, h + f, pd + f));
+        if (!frames.back())
+            return fprintf(stderr, "ERROR: cannot read %s\n", filenames[f].c_str());
+        if (w[f] != w[0] || h[f] != h[0] || pd[f] != pd[0])
+            return fprintf(stderr, "ERROR: input images size mismatch\n");
+    }
+    duration<double> elapsed_load = system_clock::now() - clk;
+    printf("(faldoi_pipeline) loading the frames took %.3fs\n", elapsed_load.count());
+
+    const int size = w[0] * h[0];
+    auto *out_flow = new float[2 * size];
+    auto *rg_flow = filename_rg.empty() ? nullptr : new float[2 * size];
+    auto *sim = filename_sim.empty() ? nullptr : new float[size];
+
+    faldoi_pipeline(frames[0], frames[1], frames.size() == 4 ? frames[2] : nullptr,
+                    frames.size() == 4 ? frames[3] : nullptr, w[0], h[0], pd[0], opt,
+                    matches_fwd.empty() ? nullptr : &fwd, matches_bwd.empty() ? nullptr : &bwd,
+                    out_flow, rg_flow, sim, nullptr);
+
+    ResultWriter &writer = result_writer();
+    writer.save(args[2], out_flow, w[0], h[0], 2);
+    if (rg_flow)
+        writer.save(filename_rg, rg_flow, w[0], h[0], 2);
+    if (sim)
+        writer.save(filename_sim, sim, w[0], h[0], 1);
+    preprocess_cache().print_stats("faldoi_pipeline");
+
+    for (auto *f : frames)
+        free(f);
+    delete[] out_flow;
+    delete[] rg_flow;
+    delete[] sim;
+    writer.flush();
+    writer.print_stats("faldoi_pipeline");
+
+    today = system_clock::now();
+    tt = system_clock::to_time_t(today);
+    cerr << "Finishing date: " << ctime(&tt);
+    return 0;
+}
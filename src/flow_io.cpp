@@ -0,0 +1,651 @@
+#include "flow_io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+extern "C" {
+#include "iio.h"
+}
+
+static const char PLANAR_MAGIC[8] = {'F', 'A', 'L', 'D', 'O', 'I', 'P', 'L'};
+static const char QUANTIZED_MAGIC[8] = {'F', 'A', 'L', 'D', 'O', 'I', 'Q', 'F'};
+static const float FLO_MAGIC = 202021.25f;    // "PIEH" read as a float
+
+struct PlanarHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t w;
+    uint32_t h;
+    uint32_t n_planes;
+    uint64_t reserved;
+};
+
+struct QuantizedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t w;
+    uint32_t h;
+    uint16_t tile;
+    uint16_t deflated;
+    uint64_t payload;
+};
+
+// TIFF tags and field types this reader and writer use
+#define TIFF_IMAGE_WIDTH     256
+#define TIFF_IMAGE_LENGTH    257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION     259
+#define TIFF_PHOTOMETRIC     262
+#define TIFF_STRIP_OFFSETS   273
+#define TIFF_SAMPLES_PER_PX  277
+#define TIFF_ROWS_PER_STRIP  278
+#define TIFF_STRIP_BYTES     279
+#define TIFF_PLANAR_CONFIG   284
+#define TIFF_EXTRA_SAMPLES   338
+#define TIFF_SAMPLE_FORMAT   339
+#define TIFF_SHORT 3
+#define TIFF_LONG  4
+
+static bool has_suffix(const std::string &s, const char *suffix) {
+    const size_t n = strlen(suffix);
+    return s.size() >= n && strcasecmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+static uint16_t get_u16(const char *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t get_u32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+MappedImage::~MappedImage() {
+    close();
+}
+
+void MappedImage::close() {
+    if (map)
+        munmap(map, map_bytes);
+    map = nullptr;
+    map_bytes = 0;
+    split.clear();
+    planes.clear();
+    w = h = pd = 0;
+}
+
+bool MappedImage::open(const std::string &filename) {
+    close();
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        ::close(fd);
+        return false;
+    }
+    const size_t bytes = st.st_size;
+    void *m = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+    map = m;
+    map_bytes = bytes;
+
+    const char *data = static_cast<const char *>(m);
+    bool ok;
+    if (memcmp(data, "PIEH", 4) == 0)
+        ok = open_flo(data, bytes);
+    else if (memcmp(data, "II*\0", 4) == 0)
+        ok = open_tiff(data, bytes);
+    else if (bytes >= PLANAR_FILE_HEADER && memcmp(data, PLANAR_MAGIC, sizeof(PLANAR_MAGIC)) == 0)
+        ok = open_planar(data, bytes);
+    else if (bytes >= sizeof(QuantizedHeader) && memcmp(data, QUANTIZED_MAGIC, sizeof(QUANTIZED_MAGIC)) == 0)
+        ok = open_quantized(data, bytes);
+    else
+        ok = false;
+
+    // The planes are copies: the mapping is not needed any more
+    if (ok && !split.empty()) {
+        munmap(map, map_bytes);
+        map = nullptr;
+        map_bytes = 0;
+    }
+    if (!ok)
+        close();
+    return ok;
+}
+
+void MappedImage::split_interleaved(const float *data) {
+    const size_t size = (size_t) w * h;
+    split.resize(size * pd);
+    for (size_t k = 0; k < size; k++)
+        for (int c = 0; c < pd; c++)
+            split[c * size + k] = data[k * pd + c];
+    planes.resize(pd);
+    for (int c = 0; c < pd; c++)
+        planes[c] = split.data() + c * size;
+}
+
+bool MappedImage::open_flo(const char *data, size_t bytes) {
+    float magic;
+    memcpy(&magic, data, sizeof(magic));
+    const int32_t fw = get_u32(data + 4);
+    const int32_t fh = get_u32(data + 8);
+    if (magic != FLO_MAGIC || fw <= 0 || fh <= 0 || bytes != 12 + (size_t) fw * fh * 2 * sizeof(float))
+        return false;
+    w = fw;
+    h = fh;
+    pd = 2;
+    // The mapping is page aligned, so the samples (at byte 12) are float aligned
+    split_interleaved(reinterpret_cast<const float *>(data + 12));
+    return true;
+}
+
+bool MappedImage::open_planar(const char *data, size_t bytes) {
+    PlanarHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    const size_t plane_size = (size_t) hdr.w * hdr.h;
+    if (hdr.version != PLANAR_FILE_VERSION || hdr.w == 0 || hdr.h == 0 || hdr.n_planes == 0
+        || bytes != PLANAR_FILE_HEADER + hdr.n_planes * plane_size * sizeof(float)) {
+        fprintf(stderr, "ERROR: not a valid planar image\n");
+        return false;
+    }
+    w = hdr.w;
+    h = hdr.h;
+    pd = hdr.n_planes;
+    const float *first = reinterpret_cast<const float *>(data + PLANAR_FILE_HEADER);
+    planes.resize(pd);
+    for (int c = 0; c < pd; c++)
+        planes[c] = first + c * plane_size;
+    return true;
+}
+
+// Bytes of the (inflated) payload of a w x h quantized flow with the given tile size
+static size_t quantized_payload(size_t w, size_t h, size_t tile) {
+    const size_t n_tiles = ((w + tile - 1) / tile) * ((h + tile - 1) / tile);
+    return n_tiles * 2 * sizeof(float) + w * h * 2 * sizeof(int16_t);
+}
+
+bool MappedImage::open_quantized(const char *data, size_t bytes) {
+    QuantizedHeader hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.version != QUANTIZED_FILE_VERSION || hdr.w == 0 || hdr.h == 0 || hdr.tile == 0
+        || bytes != sizeof(hdr) + hdr.payload) {
+        fprintf(stderr, "ERROR: not a valid quantized flow\n");
+        return false;
+    }
+    w = hdr.w;
+    h = hdr.h;
+    pd = 2;
+    const size_t size = (size_t) w * h;
+    const size_t expected = quantized_payload(w, h, hdr.tile);
+
+    // Stored payloads are used where they are mapped, deflated ones are inflated first
+    std::vector<char> inflated;
+    const char *payload = data + sizeof(hdr);
+    if (hdr.deflated) {
+        inflated.resize(expected);
+        uLongf out_bytes = expected;
+        if (uncompress(reinterpret_cast<Bytef *>(inflated.data()), &out_bytes,
+                       reinterpret_cast<const Bytef *>(payload), hdr.payload) != Z_OK || out_bytes != expected) {
+            fprintf(stderr, "ERROR: corrupted quantized flow\n");
+            return false;
+        }
+        payload = inflated.data();
+    } else if (hdr.payload != expected) {
+        fprintf(stderr, "ERROR: not a valid quantized flow\n");
+        return false;
+    }
+
+    const int tiles_x = (w + hdr.tile - 1) / hdr.tile;
+    const int n_tiles = tiles_x * ((h + hdr.tile - 1) / hdr.tile);
+    std::vector<float> steps(2 * n_tiles);
+    memcpy(steps.data(), payload, steps.size() * sizeof(float));
+    const char *planes_q = payload + steps.size() * sizeof(float);
+
+    split.resize(2 * size);
+    std::vector<int16_t> row(w);
+    for (int c = 0; c < 2; c++)
+        for (int j = 0; j < h; j++) {
+            memcpy(row.data(), planes_q + (c * size + (size_t) j * w) * sizeof(int16_t), w * sizeof(int16_t));
+            // Undo the delta coding (modulo 2^16, like the encoder)
+            if (hdr.deflated)
+                for (int i = 1; i < w; i++)
+                    row[i] = (int16_t) (uint16_t) ((uint16_t) row[i] + (uint16_t) row[i - 1]);
+            const float *tile_steps = steps.data() + 2 * (j / hdr.tile) * tiles_x;
+            float *out = split.data() + c * size + (size_t) j * w;
+            for (int i = 0; i < w; i++)
+                out[i] = row[i] == INT16_MIN ? NAN : row[i] * tile_steps[2 * (i / hdr.tile) + c];
+        }
+    planes = {split.data(), split.data() + size};
+    return true;
+}
+
+// Value k of a SHORT or LONG field (inline or at its offset); false if it does not exist
+static bool tiff_value(const char *data, size_t bytes, const char *entry, uint32_t k, uint32_t *v) {
+    const uint16_t type = get_u16(entry + 2);
+    const uint32_t count = get_u32(entry + 4);
+    const size_t size = type == TIFF_SHORT ? 2 : (type == TIFF_LONG ? 4 : 0);
+    if (size == 0 || k >= count)
+        return false;
+    const char *values = entry + 8;
+    if (count * size > 4) {
+        const size_t offset = get_u32(entry + 8);
+        if (offset + count * size > bytes)
+            return false;
+        values = data + offset;
+    }
+    *v = size == 2 ? get_u16(values + k * 2) : get_u32(values + k * 4);
+    return true;
+}
+
+bool MappedImage::open_tiff(const char *data, size_t bytes) {
+    const size_t ifd = get_u32(data + 4);
+    if (ifd + 2 > bytes)
+        return false;
+    const int n_entries = get_u16(data + ifd);
+    if (ifd + 2 + n_entries * 12 > bytes)
+        return false;
+
+    uint32_t tw = 0, th = 0, spp = 1, rps = 0, planar = 1, compression = 1, v;
+    const char *offsets = nullptr, *counts = nullptr;
+    bool float32 = true, has_format = false;
+    for (int e = 0; e < n_entries; e++) {
+        const char *entry = data + ifd + 2 + e * 12;
+        const uint16_t tag = get_u16(entry);
+        const uint32_t count = get_u32(entry + 4);
+        switch (tag) {
+            case TIFF_IMAGE_WIDTH:    tiff_value(data, bytes, entry, 0, &tw); break;
+            case TIFF_IMAGE_LENGTH:   tiff_value(data, bytes, entry, 0, &th); break;
+            case TIFF_COMPRESSION:    tiff_value(data, bytes, entry, 0, &compression); break;
+            case TIFF_SAMPLES_PER_PX: tiff_value(data, bytes, entry, 0, &spp); break;
+            case TIFF_ROWS_PER_STRIP: tiff_value(data, bytes, entry, 0, &rps); break;
+            case TIFF_PLANAR_CONFIG:  tiff_value(data, bytes, entry, 0, &planar); break;
+            case TIFF_STRIP_OFFSETS:  offsets = entry; break;
+            case TIFF_STRIP_BYTES:    counts = entry; break;
+            case TIFF_BITS_PER_SAMPLE:
+                for (uint32_t k = 0; k < count; k++)
+                    float32 = float32 && tiff_value(data, bytes, entry, k, &v) && v == 32;
+                break;
+            case TIFF_SAMPLE_FORMAT:
+                has_format = true;
+                for (uint32_t k = 0; k < count; k++)
+                    float32 = float32 && tiff_value(data, bytes, entry, k, &v) && v == 3;
+                break;
+            default:
+                break;
+        }
+    }
+    // Only uncompressed float32 strips (anything else goes to iio)
+    if (!float32 || !has_format || compression != 1 || !offsets || !counts || tw == 0 || th == 0
+        || spp == 0 || (planar != 1 && planar != 2))
+        return false;
+    if (rps == 0 || rps > th)
+        rps = th;
+
+    w = tw;
+    h = th;
+    pd = spp;
+    const size_t size = (size_t) w * h;
+    const int strips_per_plane = (h + rps - 1) / rps;
+    const int n_planes = planar == 2 ? pd : 1;
+    const size_t row_floats = (size_t) w * (planar == 2 ? 1 : pd);
+
+    // Strips of a plane that follow each other (and are float aligned) are used in place
+    std::vector<const float *> in_place(n_planes, nullptr);
+    bool contiguous = true;
+    for (int p = 0; p < n_planes; p++) {
+        uint32_t first = 0;
+        for (int s = 0; s < strips_per_plane; s++) {
+            uint32_t off, cnt;
+            const uint32_t rows = std::min<uint32_t>(rps, h - s * rps);
+            const int k = p * strips_per_plane + s;
+            if (!tiff_value(data, bytes, offsets, k, &off) || !tiff_value(data, bytes, counts, k, &cnt)
+                || cnt < rows * row_floats * sizeof(float) || off + (size_t) rows * row_floats * sizeof(float) > bytes)
+                return false;
+            if (s == 0)
+                first = off;
+            contiguous = contiguous && off == first + (size_t) s * rps * row_floats * sizeof(float);
+        }
+        contiguous = contiguous && first % sizeof(float) == 0;
+        in_place[p] = reinterpret_cast<const float *>(data + first);
+    }
+
+    if (contiguous && n_planes == pd) {
+        planes = in_place;
+        return true;
+    }
+
+    // Scattered strips: gather them (into the planes, or interleaved and split afterwards)
+    std::vector<float> gathered(size * pd);
+    for (int p = 0; p < n_planes; p++)
+        for (int s = 0; s < strips_per_plane; s++) {
+            uint32_t off;
+            tiff_value(data, bytes, offsets, p * strips_per_plane + s, &off);
+            const uint32_t rows = std::min<uint32_t>(rps, h - s * rps);
+            memcpy(gathered.data() + p * size + (size_t) s * rps * row_floats, data + off,
+                   rows * row_floats * sizeof(float));
+        }
+    if (n_planes == pd) {
+        split.swap(gathered);
+        planes.resize(pd);
+        for (int c = 0; c < pd; c++)
+            planes[c] = split.data() + c * size;
+    } else {
+        split_interleaved(gathered.data());
+    }
+    return true;
+}
+
+PlanarFile::~PlanarFile() {
+    if (map)
+        munmap(map, map_bytes);
+}
+
+bool PlanarFile::create(const std::string &filename, int fw, int fh, int pd) {
+    const size_t bytes = PLANAR_FILE_HEADER + (size_t) fw * fh * pd * sizeof(float);
+    const int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0)
+        m = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    PlanarHeader hdr;
+    memcpy(hdr.magic, PLANAR_MAGIC, sizeof(PLANAR_MAGIC));
+    hdr.version = PLANAR_FILE_VERSION;
+    hdr.w = fw;
+    hdr.h = fh;
+    hdr.n_planes = pd;
+    hdr.reserved = 0;
+    memcpy(m, &hdr, sizeof(hdr));
+    map = m;
+    map_bytes = bytes;
+    data = reinterpret_cast<float *>(static_cast<char *>(m) + PLANAR_FILE_HEADER);
+    w = fw;
+    h = fh;
+    return true;
+}
+
+float *read_image_planar(const std::string &filename, int *w, int *h, int *pd) {
+    MappedImage img;
+    if (!img.open(filename))
+        return iio_read_image_float_split(filename.c_str(), w, h, pd);
+    *w = img.width();
+    *h = img.height();
+    *pd = img.channels();
+    const size_t size = (size_t) *w * *h;
+    float *out = (float *) malloc(size * *pd * sizeof(float));
+    if (!out)
+        return nullptr;
+    for (int c = 0; c < *pd; c++)
+        memcpy(out + c * size, img.plane(c), size * sizeof(float));
+    return out;
+}
+
+// KITTI flow PNG: 16-bit RGB, (u, v) * 64 + 2^15 and a validity flag
+static float *read_kitti(const std::string &filename, int *w, int *h) {
+    int pd;
+    uint16_t *rgb = iio_read_image_uint16_vec(filename.c_str(), w, h, &pd);
+    if (!rgb)
+        return nullptr;
+    const size_t size = (size_t) *w * *h;
+    float *flow = pd == 3 ? (float *) malloc(2 * size * sizeof(float)) : nullptr;
+    for (size_t k = 0; flow && k < size; k++) {
+        const bool valid = rgb[3 * k + 2] != 0;
+        flow[k] = valid ? (rgb[3 * k] - 32768.0f) / 64.0f : NAN;
+        flow[size + k] = valid ? (rgb[3 * k + 1] - 32768.0f) / 64.0f : NAN;
+    }
+    free(rgb);
+    return flow;
+}
+
+float *read_flow(const std::string &filename, int *w, int *h) {
+    if (has_suffix(filename, ".png"))
+        return read_kitti(filename, w, h);
+    int pd;
+    float *flow = read_image_planar(filename, w, h, &pd);
+    if (flow && pd != 2) {
+        free(flow);
+        return nullptr;
+    }
+    return flow;
+}
+
+static bool save_kitti(const std::string &filename, const float *data, int w, int h) {
+    const size_t size = (size_t) w * h;
+    std::vector<uint16_t> rgb(3 * size, 0);
+    for (size_t k = 0; k < size; k++) {
+        const float u = data[k], v = data[size + k];
+        if (!std::isfinite(u) || !std::isfinite(v))
+            continue;
+        rgb[3 * k] = std::max(0.0f, std::min(65535.0f, std::round(u * 64.0f + 32768.0f)));
+        rgb[3 * k + 1] = std::max(0.0f, std::min(65535.0f, std::round(v * 64.0f + 32768.0f)));
+        rgb[3 * k + 2] = 1;
+    }
+    iio_save_image_uint16_vec(filename.c_str(), rgb.data(), w, h, 3);
+    return true;
+}
+
+// Per-tile scaled int16 planes, deflated (after a delta coding of the rows) if asked
+static bool save_quantized(const std::string &filename, const float *data, int w, int h, bool deflate) {
+    const int tile = QUANTIZED_TILE;
+    const size_t size = (size_t) w * h;
+    const int tiles_x = (w + tile - 1) / tile;
+    const int tiles_y = (h + tile - 1) / tile;
+    std::vector<char> payload(quantized_payload(w, h, tile));
+    float *steps = reinterpret_cast<float *>(payload.data());
+    int16_t *q = reinterpret_cast<int16_t *>(payload.data() + 2 * tiles_x * tiles_y * sizeof(float));
+
+    for (int ty = 0; ty < tiles_y; ty++)
+        for (int tx = 0; tx < tiles_x; tx++)
+            for (int c = 0; c < 2; c++) {
+                const float *plane = data + c * size;
+                float max_abs = 0.0f;
+                for (int j = ty * tile; j < std::min(h, (ty + 1) * tile); j++)
+                    for (int i = tx * tile; i < std::min(w, (tx + 1) * tile); i++)
+                        if (std::isfinite(plane[j * w + i]))
+                            max_abs = std::max(max_abs, std::fabs(plane[j * w + i]));
+                const float step = std::max(max_abs / 32767.0f, 1.0f / QUANTIZED_MIN_STEP);
+                steps[2 * (ty * tiles_x + tx) + c] = step;
+                for (int j = ty * tile; j < std::min(h, (ty + 1) * tile); j++)
+                    for (int i = tx * tile; i < std::min(w, (tx + 1) * tile); i++) {
+                        const float x = plane[j * w + i];
+                        q[c * size + j * w + i] = std::isfinite(x)
+                                ? (int16_t) std::max(-32767.0f, std::min(32767.0f, std::round(x / step)))
+                                : INT16_MIN;
+                    }
+            }
+
+    QuantizedHeader hdr;
+    memcpy(hdr.magic, QUANTIZED_MAGIC, sizeof(QUANTIZED_MAGIC));
+    hdr.version = QUANTIZED_FILE_VERSION;
+    hdr.w = w;
+    hdr.h = h;
+    hdr.tile = tile;
+    hdr.deflated = deflate;
+    hdr.payload = payload.size();
+
+    std::vector<char> deflated;
+    if (deflate) {
+        // Neighbouring values are close: their differences deflate much better than the values
+        for (size_t r = 2 * (size_t) h; r-- > 0;)
+            for (int i = w - 1; i > 0; i--)
+                q[r * w + i] = (int16_t) (uint16_t) ((uint16_t) q[r * w + i] - (uint16_t) q[r * w + i - 1]);
+        uLongf out_bytes = compressBound(payload.size());
+        deflated.resize(out_bytes);
+        if (compress2(reinterpret_cast<Bytef *>(deflated.data()), &out_bytes,
+                      reinterpret_cast<const Bytef *>(payload.data()), payload.size(), Z_BEST_SPEED) != Z_OK)
+            return false;
+        deflated.resize(out_bytes);
+        hdr.payload = out_bytes;
+    }
+    const std::vector<char> &out = deflate ? deflated : payload;
+
+    FILE *fd = fopen(filename.c_str(), "wb");
+    if (!fd)
+        return false;
+    bool ok = fwrite(&hdr, 1, sizeof(hdr), fd) == sizeof(hdr);
+    ok = ok && fwrite(out.data(), 1, out.size(), fd) == out.size();
+    return (fclose(fd) == 0) && ok;
+}
+
+// .flo: the file is sized up front and the planes are interleaved straight into the mapping
+static bool save_flo(const std::string &filename, const float *data, int w, int h) {
+    const size_t size = (size_t) w * h;
+    const size_t bytes = 12 + size * 2 * sizeof(float);
+    const int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0)
+        m = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    char *out = static_cast<char *>(m);
+    const uint32_t dims[2] = {(uint32_t) w, (uint32_t) h};
+    memcpy(out, &FLO_MAGIC, 4);
+    memcpy(out + 4, dims, sizeof(dims));
+    float *flow = reinterpret_cast<float *>(out + 12);
+    for (size_t k = 0; k < size; k++) {
+        flow[2 * k] = data[k];
+        flow[2 * k + 1] = data[size + k];
+    }
+    return munmap(m, bytes) == 0;
+}
+
+static void put_entry(std::vector<char> &buf, size_t at, uint16_t tag, uint16_t type, uint32_t count,
+                      uint32_t value) {
+    const size_t size = type == TIFF_SHORT ? 2 : 4;
+    memcpy(&buf[at], &tag, 2);
+    memcpy(&buf[at + 2], &type, 2);
+    memcpy(&buf[at + 4], &count, 4);
+    if (count == 1 && size == 2) {
+        const uint16_t v = value;
+        memcpy(&buf[at + 8], &v, 2);
+    } else {
+        memcpy(&buf[at + 8], &value, 4);
+    }
+}
+
+// Float TIFF, one strip per plane (planar configuration for pd > 1). The planes are written
+// as they are, no interleaving
+static bool save_tiff(const std::string &filename, const float *data, int w, int h, int pd) {
+    // Channels past the first one are ExtraSamples of a min-is-black image
+    const int n_entries = pd > 1 ? 12 : 11;
+    const size_t plane_bytes = (size_t) w * h * sizeof(float);
+    const size_t ifd = 8;
+    const size_t arrays = ifd + 2 + n_entries * 12 + 4;
+    // Arrays of pd values that do not fit in the entry (pd > 2 for SHORT, pd > 1 for LONG)
+    const size_t bits_at = arrays;
+    const size_t format_at = bits_at + pd * 2;
+    const size_t offsets_at = format_at + pd * 2;
+    const size_t counts_at = offsets_at + pd * 4;
+    const size_t extra_at = counts_at + pd * 4;
+    const size_t data_at = (extra_at + pd * 2 + 15) & ~(size_t) 15;
+
+    std::vector<char> hdr(data_at, 0);
+    memcpy(&hdr[0], "II*\0", 4);
+    const uint32_t ifd32 = ifd;
+    memcpy(&hdr[4], &ifd32, 4);
+    const uint16_t n16 = n_entries;
+    memcpy(&hdr[ifd], &n16, 2);
+    for (int c = 0; c < pd; c++) {
+        const uint16_t bits = 32, format = 3;
+        const uint32_t off = data_at + c * plane_bytes, cnt = plane_bytes;
+        memcpy(&hdr[bits_at + 2 * c], &bits, 2);
+        memcpy(&hdr[format_at + 2 * c], &format, 2);
+        memcpy(&hdr[offsets_at + 4 * c], &off, 4);
+        memcpy(&hdr[counts_at + 4 * c], &cnt, 4);
+    }
+    // Values that fit in the 4 bytes of an entry are stored there (left-justified)
+    uint32_t bits_v = bits_at, format_v = format_at;
+    if (pd <= 2) {
+        memcpy(&bits_v, &hdr[bits_at], 4);
+        memcpy(&format_v, &hdr[format_at], 4);
+    }
+    const uint32_t offsets_v = pd == 1 ? data_at : offsets_at;
+    const uint32_t counts_v = pd == 1 ? plane_bytes : counts_at;
+    const uint32_t extra_v = pd - 1 <= 2 ? 0 : extra_at;    // unspecified (0) samples
+
+    size_t e = ifd + 2;
+    put_entry(hdr, e, TIFF_IMAGE_WIDTH, TIFF_LONG, 1, w), e += 12;
+    put_entry(hdr, e, TIFF_IMAGE_LENGTH, TIFF_LONG, 1, h), e += 12;
+    put_entry(hdr, e, TIFF_BITS_PER_SAMPLE, TIFF_SHORT, pd, bits_v), e += 12;
+    put_entry(hdr, e, TIFF_COMPRESSION, TIFF_SHORT, 1, 1), e += 12;
+    put_entry(hdr, e, TIFF_PHOTOMETRIC, TIFF_SHORT, 1, 1), e += 12;    // min-is-black
+    put_entry(hdr, e, TIFF_STRIP_OFFSETS, TIFF_LONG, pd, offsets_v), e += 12;
+    put_entry(hdr, e, TIFF_SAMPLES_PER_PX, TIFF_SHORT, 1, pd), e += 12;
+    put_entry(hdr, e, TIFF_ROWS_PER_STRIP, TIFF_LONG, 1, h), e += 12;
+    put_entry(hdr, e, TIFF_STRIP_BYTES, TIFF_LONG, pd, counts_v), e += 12;
+    put_entry(hdr, e, TIFF_PLANAR_CONFIG, TIFF_SHORT, 1, pd > 1 ? 2 : 1), e += 12;
+    if (pd > 1)
+        put_entry(hdr, e, TIFF_EXTRA_SAMPLES, TIFF_SHORT, pd - 1, extra_v), e += 12;
+    put_entry(hdr, e, TIFF_SAMPLE_FORMAT, TIFF_SHORT, pd, format_v);
+
+    FILE *fd = fopen(filename.c_str(), "wb");
+    if (!fd)
+        return false;
+    bool ok = fwrite(hdr.data(), 1, hdr.size(), fd) == hdr.size();
+    ok = ok && fwrite(data, 1, pd * plane_bytes, fd) == pd * plane_bytes;
+    return (fclose(fd) == 0) && ok;
+}
+
+static bool save_planar(const std::string &filename, const float *data, int w, int h, int pd) {
+    FILE *fd = fopen(filename.c_str(), "wb");
+    if (!fd)
+        return false;
+    char header[PLANAR_FILE_HEADER] = {};
+    PlanarHeader hdr;
+    memcpy(hdr.magic, PLANAR_MAGIC, sizeof(PLANAR_MAGIC));
+    hdr.version = PLANAR_FILE_VERSION;
+    hdr.w = w;
+    hdr.h = h;
+    hdr.n_planes = pd;
+    hdr.reserved = 0;
+    memcpy(header, &hdr, sizeof(hdr));
+    const size_t n = (size_t) w * h * pd;
+    bool ok = fwrite(header, 1, sizeof(header), fd) == sizeof(header);
+    ok = ok && fwrite(data, sizeof(float), n, fd) == n;
+    return (fclose(fd) == 0) && ok;
+}
+
+bool save_image_planar(const std::string &filename, const float *data, int w, int h, int pd) {
+    bool ok;
+    if (has_suffix(filename, ".flo") && pd == 2)
+        ok = save_flo(filename, data, w, h);
+    else if (has_suffix(filename, ".tif") || has_suffix(filename, ".tiff"))
+        ok = save_tiff(filename, data, w, h, pd);
+    else if (has_suffix(filename, ".pfl"))
+        ok = save_planar(filename, data, w, h, pd);
+    else if (has_suffix(filename, ".png") && pd == 2)
+        ok = save_kitti(filename, data, w, h);
+    else if ((has_suffix(filename, ".qfl") || has_suffix(filename, ".qfz")) && pd == 2)
+        ok = save_quantized(filename, data, w, h, has_suffix(filename, ".qfz"));
+    else {
+        iio_save_image_float_split(filename.c_str(), const_cast<float *>(data), w, h, pd);
+        ok = true;
+    }
+    if (!ok)
+        fprintf(stderr, "ERROR: could not write %s\n", filename.c_str());
+    return ok;
+}
@@ -0,0 +1,116 @@
+#ifndef FLOW_IO_H
+#define FLOW_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Memory-mapped reading and writing of the float images the binaries exchange (flows,
+/// similarity maps, occlusions), in the split layout the algorithms use (plane after plane).
+///
+/// Middlebury .flo and uncompressed float TIFF are read with a single mmap. A planar TIFF (and
+/// any single-channel one) whose strips are contiguous is used in place; interleaved files are
+/// split once. The planar format stores the split layout itself, so reading it is zero-copy:
+///
+/// File format (.pfl):
+///     bytes  0..7   magic "FALDOIPL"
+///     bytes  8..11  format version (uint32)
+///     bytes 12..15  width (uint32)
+///     bytes 16..19  height (uint32)
+///     bytes 20..23  number of planes (uint32)
+///     bytes 24..31  reserved (0)
+///     byte   32     planes, each width * height float32 in raster order
+
+#define PLANAR_FILE_VERSION 1
+#define PLANAR_FILE_HEADER  32
+
+/// Quantized flows, for consumers that need a fraction of a pixel rather than float32:
+///     .png    KITTI flow: 16-bit RGB, u = (R - 2^15) / 64, v = (G - 2^15) / 64, B = 1 if valid
+///     .qfl    per-tile scaled int16 (below): 4 bytes per pixel, read with a single mmap
+///     .qfz    the same, with the planes delta-coded along the rows and deflated (zlib, fastest level)
+///
+/// File format (.qfl, .qfz):
+///     bytes  0..7   magic "FALDOIQF"
+///     bytes  8..11  format version (uint32)
+///     bytes 12..19  width, height (uint32 each)
+///     bytes 20..21  tile size (uint16)
+///     bytes 22..23  1 if the payload is deflated, 0 otherwise (uint16)
+///     bytes 24..31  payload bytes (uint64)
+///     byte   32     payload: the steps of u and v of every tile (float32, tiles in raster order),
+///                   then the u and v planes (int16, q * step each, INT16_MIN if not finite)
+/// The step of a tile is max |value| / 32767, never finer than 1/QUANTIZED_MIN_STEP of a pixel.
+
+#define QUANTIZED_FILE_VERSION 1
+#define QUANTIZED_TILE         16
+#define QUANTIZED_MIN_STEP     64
+
+class MappedImage {
+public:
+    MappedImage() = default;
+    MappedImage(const MappedImage &) = delete;
+    MappedImage &operator=(const MappedImage &) = delete;
+    ~MappedImage();
+
+    // False if the file is not a .flo, float TIFF, .pfl or .qfl/.qfz file this reader understands
+    bool open(const std::string &filename);
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int channels() const { return pd; }
+
+    // Plane c (width * height floats), valid while the object lives
+    const float *plane(int c) const { return planes[c]; }
+
+    // True if the planes point into the mapping (no copy was made)
+    bool zero_copy() const { return split.empty(); }
+
+private:
+    void close();
+    bool open_flo(const char *data, size_t bytes);
+    bool open_tiff(const char *data, size_t bytes);
+    bool open_planar(const char *data, size_t bytes);
+    bool open_quantized(const char *data, size_t bytes);
+    void split_interleaved(const float *data);
+
+    void *map = nullptr;
+    size_t map_bytes = 0;
+    std::vector<float> split;       // planes of an interleaved, scattered or quantized file
+    std::vector<const float *> planes;
+    int w = 0, h = 0, pd = 0;
+};
+
+// Planar (.pfl) file created with its final size and mapped read-write: a result larger than the
+// memory can be filled piece by piece, the kernel writing the pages back as needed
+class PlanarFile {
+public:
+    PlanarFile() = default;
+    PlanarFile(const PlanarFile &) = delete;
+    PlanarFile &operator=(const PlanarFile &) = delete;
+    ~PlanarFile();
+
+    // False if the file cannot be created or mapped; the planes start zeroed
+    bool create(const std::string &filename, int w, int h, int pd);
+
+    float *plane(int c) { return data + (size_t) c * w * h; }
+
+private:
+    void *map = nullptr;
+    size_t map_bytes = 0;
+    float *data = nullptr;
+    int w = 0, h = 0;
+};
+
+// Split image in a malloc'd buffer, like iio_read_image_float_split (whose fallback it is, for
+// every format MappedImage does not read). NULL on error
+float *read_image_planar(const std::string &filename, int *w, int *h, int *pd);
+
+// Flow (two planes) in a malloc'd buffer: any format above, KITTI for .png. NULL on error
+float *read_flow(const std::string &filename, int *w, int *h);
+
+// Writes pd split planes, choosing the format from the extension: .flo (pd == 2, same bytes as
+// iio), .tif/.tiff (float32, planar), .pfl, the quantized flows (pd == 2: .png, .qfl, .qfz) and
+// iio for anything else. False on error
+bool save_image_planar(const std::string &filename, const float *data, int w, int h, int pd);
+
+#endif // FLOW_IO_H
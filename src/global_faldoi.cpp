@@ -22,6 +22,7 @@
 extern "C" {
 #include "bicubic_interpolation.h"
 #include "iio.h"
+#include "image_kernels.h"
 }
 
 #include "tvl2_model_occ.h"
@@ -29,6 +30,12 @@ extern "C" {
 #include "parameters.h"
 #include "utils_preprocess.h"
 #include "energy_model.h"
+#include "convergence.h"
+#include "numa_utils.h"
+#include "preprocess_cache.h"
+#include "faldoi_pipeline.h"
+#include "flow_io.h"
+#include "result_writer.h"
 
 #include <iostream>
 #include <fstream>
@@ -42,6 +49,38 @@ using namespace std;
 #define MAX(x, y) ((x)>(y)?(x):(y))
 
 
+// Linearised TV-L1 energy of the current warp: sum |Du1| + |Du2| + lambda * |rho(u)|
+// (forward differences, Neumann boundary). The CSAD and NLTV solvers minimise other
+// terms, so for them it is only a proxy used by the convergence trace.
+static double linearized_tvl1_energy(
+        const float *u1,
+        const float *u2,
+        const float *rho_c,
+        const float *I1wx,
+        const float *I1wy,
+        const float lambda,
+        const int nx,
+        const int ny
+) {
+    double energy = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+:energy)
+#endif
+    for (int j = 0; j < ny; j++) {
+        for (int i = 0; i < nx; i++) {
+            const int k = j * nx + i;
+            const float u1x = (i < nx - 1) ? u1[k + 1] - u1[k] : 0.0f;
+            const float u1y = (j < ny - 1) ? u1[k + nx] - u1[k] : 0.0f;
+            const float u2x = (i < nx - 1) ? u2[k + 1] - u2[k] : 0.0f;
+            const float u2y = (j < ny - 1) ? u2[k + nx] - u2[k] : 0.0f;
+            const float rho = rho_c[k] + I1wx[k] * u1[k] + I1wy[k] * u2[k];
+            energy += hypot(u1x, u1y) + hypot(u2x, u2y) + lambda * fabs(rho);
+        }
+    }
+    return energy;
+}
+
+
 //////////
 ///////////WARNING
 /**
@@ -568,7 +607,8 @@ void tvl2OF(
         const int nx,           // image width
         const int ny,           // image height
         const int warps,        // number of warpings per scale
-        const bool verbose      // enable/disable the verbose mode
+        const bool verbose,     // enable/disable the verbose mode
+        ConvergenceMonitor &conv // stopping rules and per-warp trace
 ) {
     using namespace std::chrono;
     auto clk_tvl2OF = system_clock::now();
@@ -577,35 +617,35 @@ void tvl2OF(
     const int size = nx * ny;
 
 
-    auto *u1x = new float[size];
-    auto *u1y = new float[size];
-    auto *u2x = new float[size];
-    auto *u2y = new float[size];
+    auto *u1x = numa_alloc_image(size);
+    auto *u1y = numa_alloc_image(size);
+    auto *u2x = numa_alloc_image(size);
+    auto *u2y = numa_alloc_image(size);
 
-    auto *v1 = new float[size];
-    auto *v2 = new float[size];
+    auto *v1 = numa_alloc_image(size);
+    auto *v2 = numa_alloc_image(size);
 
-    auto *rho_c = new float[size];
-    auto *grad = new float[size];
+    auto *rho_c = numa_alloc_image(size);
+    auto *grad = numa_alloc_image(size);
 
-    auto *u1_ = new float[size];
-    auto *u2_ = new float[size];
+    auto *u1_ = numa_alloc_image(size);
+    auto *u2_ = numa_alloc_image(size);
 
-    auto *u1Aux = new float[size];
-    auto *u2Aux = new float[size];
+    auto *u1Aux = numa_alloc_image(size);
+    auto *u2Aux = numa_alloc_image(size);
 
-    auto *I1x = new float[size];
-    auto *I1y = new float[size];
+    auto *I1x = numa_alloc_image(size);
+    auto *I1y = numa_alloc_image(size);
 
-    auto *I1w = new float[size];
-    auto *I1wx = new float[size];
-    auto *I1wy = new float[size];
+    auto *I1w = numa_alloc_image(size);
+    auto *I1wx = numa_alloc_image(size);
+    auto *I1wy = numa_alloc_image(size);
 
     // Divergence
-    auto *div_xi1 = new float[size];
-    auto *div_xi2 = new float[size];
+    auto *div_xi1 = numa_alloc_image(size);
+    auto *div_xi2 = numa_alloc_image(size);
 
-    auto *u_N = new float[size];
+    auto *u_N = numa_alloc_image(size);
 
     centered_gradient(I1, I1x, I1y, nx, ny);
 
@@ -669,9 +709,10 @@ void tvl2OF(
 	double total_getP = 0.0;
 	double total_copy_u1u2 = 0.0;
 */
+        conv.start_warp("tvl2OF", warpings);
         int n = 0;
         float err_D = INFINITY;
-        while (err_D > tol_OF * tol_OF && n < MAX_ITERATIONS_GLOBAL) {
+        while (err_D > tol_OF * tol_OF && n < conv.max_iter) {
 
             n++;
             // Estimate the values of the variable (v1, v2)
@@ -761,11 +802,16 @@ void tvl2OF(
             duration<double> elapsed_secs_copy_u1u2 = clk_copy_u1u2_end - clk_getP_end;  // PROFILING
             total_copy_u1u2 += elapsed_secs_copy_u1u2.count();
 
+            if (conv.energy_converged(n, [&] {
+                return linearized_tvl1_energy(u1, u2, rho_c, I1wx, I1wy, lambda, nx, ny);
+            }))
+                break;
         }
+        conv.end_warp(n, err_D, tol_OF);
 
 	auto clk_while_end = system_clock::now(); // PROFILING
         duration<double> elapsed_secs_while = clk_while_end - clk_constants; // PROFILING
-        cout << "(tvl2OF) While loop (with 400 it) took "
+        cout << "(tvl2OF) While loop (with " << n << " it) took "
              << elapsed_secs_while.count() << endl;
 
         if (verbose)
@@ -861,38 +907,6 @@ inline bool positive(int val) {
     return val >= 0;
 }
 
-float aux_pow2(float f) { return f * f; }
-
-// Non-normalized images are assumed
-void image_to_lab(float *in, int size, float *out) {
-    const float T = 0.008856;
-    const float color_attenuation = 1.5f;
-    for (int i = 0; i < size; i++) {
-        const float r = in[i] / 255.f;
-        const float g = in[i + size] / 255.f;
-        const float b = in[i + 2 * size] / 255.f;
-        float X = 0.412453 * r + 0.357580 * g + 0.180423 * b;
-        float Y = 0.212671 * r + 0.715160 * g + 0.072169 * b;
-        float Z = 0.019334 * r + 0.119193 * g + 0.950227 * b;
-        X /= 0.950456;
-        Z /= 1.088754;
-        float Y3 = pow(Y, 1. / 3);
-        float fX = X > T ? pow(X, 1. / 3) : 7.787 * X + 16 / 116.;
-        float fY = Y > T ? Y3 : 7.787 * Y + 16 / 116.;
-        float fZ = Z > T ? pow(Z, 1. / 3) : 7.787 * Z + 16 / 116.;
-        float L = Y > T ? 116 * Y3 - 16.0 : 903.3 * Y;
-        float A = 500 * (fX - fY);
-        float B = 200 * (fY - fZ);
-
-        // Correct L*a*b*: dark area or light area have less reliable colors
-        float correct_lab = exp(-color_attenuation * aux_pow2(aux_pow2(L / 100) - 0.6));
-        out[i] = L;
-        out[i + size] = A * correct_lab;
-        out[i + 2 * size] = B * correct_lab;
-    }
-}
-
-
 static int validate_ap_2(int w, int h, int i, int j, int di, int dj) {
     const int r = j + dj;  // Row
     const int c = i + di;  // Column
@@ -965,6 +979,25 @@ void initialize_dual_variables(
         DualVariables_global *q
 ) {
     int size = w * h;
+
+    // The weights (n_d planes, -2 outside the image) only depend on the L*a*b* image; wt is
+    // their sum and is rebuilt on load
+    PreprocessCache &cache = preprocess_cache();
+    uint64_t key = 0;
+    bool cached = false;
+    std::vector<float> weights;
+    std::vector<float *> planes(n_d);
+    if (cache.enabled()) {
+        char tag[96];
+        snprintf(tag, sizeof(tag), "global-nltv-weights beta=%d intensity=%g n_d=%d radius=%d pd=%d",
+                 MAX_BETA, (double) MAX_INTENSITY, n_d, radius, pd);
+        key = cache.key(tag, {{a, (size_t) size * pd}}, w, h);
+        weights.resize((size_t) n_d * size);
+        for (int k = 0; k < n_d; k++)
+            planes[k] = weights.data() + (size_t) k * size;
+        cached = cache.load(key, w, h, planes);
+    }
+
     for (int i = 0; i < size; i++)
         for (int j = 0; j < n_d; j++) {
             p[i].sc[j] = -2.0;
@@ -998,7 +1031,7 @@ void initialize_dual_variables(
                             assert(q[pos].rp[it] >= 0);
 
                             // Compute the weight
-                            float wp = sqrt(get_weight_2(a, w, h, i, j, l, k, pd));
+                            float wp = cached ? planes[it][pos] : sqrt(get_weight_2(a, w, h, i, j, l, k, pd));
                             p[pos].wp[it] = q[pos].wp[it] = wp;
 
                             ne += wp;
@@ -1012,6 +1045,13 @@ void initialize_dual_variables(
             q[pos].wt = ne;
         }
     // std::printf(" Ends\n");
+
+    if (cache.enabled() && !cached) {
+        for (int i = 0; i < size; i++)
+            for (int k = 0; k < n_d; k++)
+                planes[k][i] = p[i].wp[k];
+        cache.store(key, w, h, std::vector<const float *>(planes.begin(), planes.end()));
+    }
 }
 
 void non_local_divergence(
@@ -1148,28 +1188,29 @@ void nltvl1_PD(
         const int warps,        // number of warpings per scale
         const bool verbose,     // enable/disable the verbose mode
         float *u1,              // x component of the optical flow
-        float *u2               // y component of the optical flow
+        float *u2,              // y component of the optical flow
+        ConvergenceMonitor &conv // stopping rules and per-warp trace
 ) {
     const int size = w * h;
     const float l_t = lambda * theta;
 
     auto *p = new DualVariables_global[size];
     auto *q = new DualVariables_global[size];
-    auto *v1 = new float[size];
-    auto *v2 = new float[size];
-    auto *rho_c = new float[size];
-    auto *grad = new float[size];
-    auto *u1_ = new float[size];
-    auto *u2_ = new float[size];
-    auto *u1_tmp = new float[size];
-    auto *u2_tmp = new float[size];
-    auto *I1x = new float[size];
-    auto *I1y = new float[size];
-    auto *I1w = new float[size];
-    auto *I1wx = new float[size];
-    auto *I1wy = new float[size];
-    auto *div_p = new float[size];
-    auto *div_q = new float[size];
+    auto *v1 = numa_alloc_image(size);
+    auto *v2 = numa_alloc_image(size);
+    auto *rho_c = numa_alloc_image(size);
+    auto *grad = numa_alloc_image(size);
+    auto *u1_ = numa_alloc_image(size);
+    auto *u2_ = numa_alloc_image(size);
+    auto *u1_tmp = numa_alloc_image(size);
+    auto *u2_tmp = numa_alloc_image(size);
+    auto *I1x = numa_alloc_image(size);
+    auto *I1y = numa_alloc_image(size);
+    auto *I1w = numa_alloc_image(size);
+    auto *I1wx = numa_alloc_image(size);
+    auto *I1wy = numa_alloc_image(size);
+    auto *div_p = numa_alloc_image(size);
+    auto *div_q = numa_alloc_image(size);
 
     int radius = MAX_BETA;
     int n_d = MAX_DUAL_VAR;
@@ -1204,10 +1245,11 @@ void nltvl1_PD(
             u2_[i] = u2[i];
         }
 
+        conv.start_warp("nltvl1_PD", warpings);
         int n = 0;
         float err_D = INFINITY;
         // while (err_D > tol_OF*tol_OF && n < MAX_ITERATIONS)
-        while (n < MAX_ITERATIONS_GLOBAL) {
+        while (n < conv.max_iter) {
 
             n++;
             // Estimate the values of the variable (v1, v2)
@@ -1260,7 +1302,11 @@ void nltvl1_PD(
                 u2_[i] = 2 * u2[i] - u2_tmp[i];
             }
 
+            conv.trace_energy(n, [&] {
+                return linearized_tvl1_energy(u1, u2, rho_c, I1wx, I1wy, lambda, w, h);
+            });
         }
+        conv.end_warp(n, err_D, 0.0f);
         if (verbose)
             std::printf("Warping: %d,Iter: %d Error: %f\n", warpings, n, err_D);
     }
@@ -1423,7 +1469,8 @@ void tvcsad_PD(
         const int warps,            // number of warpings per scale
         const bool verbose,         // enable/disable the verbose mode
         float *u1,                  // x component of the optical flow
-        float *u2                   // y component of the optical flow
+        float *u2,                  // y component of the optical flow
+        ConvergenceMonitor &conv    // stopping rules and per-warp trace
 ) {
 
     const float l_t = lambda * theta;
@@ -1432,35 +1479,35 @@ void tvcsad_PD(
     const int r = DT_R;
     auto *p = new PosNei[size];
 
-    auto *u1x = new float[size];
-    auto *u1y = new float[size];
-    auto *u2x = new float[size];
-    auto *u2y = new float[size];
+    auto *u1x = numa_alloc_image(size);
+    auto *u1y = numa_alloc_image(size);
+    auto *u2x = numa_alloc_image(size);
+    auto *u2y = numa_alloc_image(size);
 
-    auto *v1 = new float[size];
-    auto *v2 = new float[size];
+    auto *v1 = numa_alloc_image(size);
+    auto *v2 = numa_alloc_image(size);
 
-    auto *rho_c = new float[size];
-    auto *grad = new float[size];
+    auto *rho_c = numa_alloc_image(size);
+    auto *grad = numa_alloc_image(size);
 
-    auto *u1_ = new float[size];
-    auto *u2_ = new float[size];
+    auto *u1_ = numa_alloc_image(size);
+    auto *u2_ = numa_alloc_image(size);
 
-    auto *u1_tmp = new float[size];
-    auto *u2_tmp = new float[size];
+    auto *u1_tmp = numa_alloc_image(size);
+    auto *u2_tmp = numa_alloc_image(size);
 
-    auto *I1x = new float[size];
-    auto *I1y = new float[size];
+    auto *I1x = numa_alloc_image(size);
+    auto *I1y = numa_alloc_image(size);
 
-    auto *I1w = new float[size];
-    auto *I1wx = new float[size];
-    auto *I1wy = new float[size];
+    auto *I1w = numa_alloc_image(size);
+    auto *I1wx = numa_alloc_image(size);
+    auto *I1wy = numa_alloc_image(size);
 
     // Divergence
-    auto *div_xi1 = new float[size];
-    auto *div_xi2 = new float[size];
+    auto *div_xi1 = numa_alloc_image(size);
+    auto *div_xi2 = numa_alloc_image(size);
 
-    auto *u_N = new float[size];
+    auto *u_N = numa_alloc_image(size);
 
     // Five point gradient of the right,left view. (1/12)*[-1 8 0 -8 1]
     centered_gradient(I1, I1x, I1y, nx, ny);
@@ -1479,6 +1526,10 @@ void tvcsad_PD(
             // Store the |Grad(I1(p + u))| (Warping image)
             grad[i] = hypot(Ix2 + Iy2, 0.01);
 
+            // Constant part of the rho function (only used by the energy of the convergence trace)
+            rho_c[i] = (I1w[i] - I1wx[i] * u1[i]
+                        - I1wy[i] * u2[i] - I0[i]);
+
             for (int j = 0; j < n_d; j++) {
                 // std::printf("I:%d Iter:%d J:%d I:%d \n",i, j,  p[i].apj[j], p[i].api[j]);
                 if (positive(p[i].api[j]) && positive(p[i].apj[j])) {
@@ -1499,9 +1550,10 @@ void tvcsad_PD(
             u2_[i] = u2[i];
         }
 
+        conv.start_warp("tvcsad_PD", warpings);
         int n = 0;
         float err_D = INFINITY;
-        while (err_D > tol_OF * tol_OF && n < MAX_ITERATIONS_GLOBAL) {
+        while (err_D > tol_OF * tol_OF && n < conv.max_iter) {
             n++;
             // Estimate the values of the variable (v1, v2)
             // (thresholding opterator TH)
@@ -1556,8 +1608,11 @@ void tvcsad_PD(
 
             }
 
-
+            conv.trace_energy(n, [&] {
+                return linearized_tvl1_energy(u1, u2, rho_c, I1wx, I1wy, lambda, nx, ny);
+            });
         }
+        conv.end_warp(n, err_D, tol_OF);
         if (verbose)
             fprintf(stderr, "Warping: %d,Iter: %d "
                     "Error: %f\n", warpings, n, err_D);
@@ -1613,7 +1668,8 @@ void nltvcsad_PD(
         const int warps,        // number of warpings per scale
         const bool verbose,     // enable/disable the verbose mode
         float *u1,              // x component of the optical flow
-        float *u2               // y component of the optical flow
+        float *u2,              // y component of the optical flow
+        ConvergenceMonitor &conv // stopping rules and per-warp trace
 ) {
 
     const int size = w * h;
@@ -1622,21 +1678,21 @@ void nltvcsad_PD(
     auto *p = new DualVariables_global[size];
     auto *q = new DualVariables_global[size];
     auto *pnei = new PosNei[size];
-    auto *v1 = new float[size];
-    auto *v2 = new float[size];
-    auto *rho_c = new float[size];
-    auto *grad = new float[size];
-    auto *u1_ = new float[size];
-    auto *u2_ = new float[size];
-    auto *u1_tmp = new float[size];
-    auto *u2_tmp = new float[size];
-    auto *I1x = new float[size];
-    auto *I1y = new float[size];
-    auto *I1w = new float[size];
-    auto *I1wx = new float[size];
-    auto *I1wy = new float[size];
-    auto *div_p = new float[size];
-    auto *div_q = new float[size];
+    auto *v1 = numa_alloc_image(size);
+    auto *v2 = numa_alloc_image(size);
+    auto *rho_c = numa_alloc_image(size);
+    auto *grad = numa_alloc_image(size);
+    auto *u1_ = numa_alloc_image(size);
+    auto *u2_ = numa_alloc_image(size);
+    auto *u1_tmp = numa_alloc_image(size);
+    auto *u2_tmp = numa_alloc_image(size);
+    auto *I1x = numa_alloc_image(size);
+    auto *I1y = numa_alloc_image(size);
+    auto *I1w = numa_alloc_image(size);
+    auto *I1wx = numa_alloc_image(size);
+    auto *I1wy = numa_alloc_image(size);
+    auto *div_p = numa_alloc_image(size);
+    auto *div_q = numa_alloc_image(size);
 
     int radius = MAX_BETA;
     int n_d = MAX_DUAL_VAR;
@@ -1662,6 +1718,10 @@ void nltvcsad_PD(
 
             // Store the |Grad(I1(p + u))| (Warping image)
             grad[i] = Ix2 + Iy2;
+
+            // Constant part of the rho function (only used by the energy of the convergence trace)
+            rho_c[i] = (I1w[i] - I1wx[i] * u1[i]
+                        - I1wy[i] * u2[i] - I0[i]);
             if (grad[i] > GRAD_IS_ZERO) {
                 for (int j = 0; j < ndt; j++) {
                     // std::printf("I:%d Iter:%d J:%d I:%d \n",i, j,  p[i].apj[j], p[i].api[j]);
@@ -1684,10 +1744,11 @@ void nltvcsad_PD(
             u2_[i] = u2[i];
         }
 
+        conv.start_warp("nltvcsad_PD", warpings);
         int n = 0;
         float err_D = INFINITY;
         // while (err_D > tol_OF*tol_OF && n < MAX_ITERATIONS)
-        while (n < MAX_ITERATIONS_GLOBAL) {
+        while (n < conv.max_iter) {
             n++;
             // Estimate the values of the variable (v1, v2)
 #ifdef _OPENMP
@@ -1736,7 +1797,11 @@ void nltvcsad_PD(
                 u2_[i] = 2 * u2[i] - u2_tmp[i];
             }
 
+            conv.trace_energy(n, [&] {
+                return linearized_tvl1_energy(u1, u2, rho_c, I1wx, I1wy, lambda, w, h);
+            });
         }
+        conv.end_warp(n, err_D, 0.0f);
         if (verbose)
             std::printf("Warping: %d,Iter: %d Error: %f\n", warpings, n, err_D);
     }
@@ -1779,15 +1844,207 @@ void nltvcsad_PD(
 
 
 void rgb2gray(float *in, int w, int h, float *out) {
+    par_rgb_to_gray(in, w, h, out);
+}
+
+
+// Global minimisation (second FALDOI step) of the flow `flow` (two planes, refined in place)
+// between i0 and i1. i_1 and the occlusion mask `occ` (refined in place) are only used by the
+// occlusion model. params must hold w, h, val_method, warps and iterations_of.
+void global_faldoi_run(
+        float *i0,
+        float *i1,
+        float *i_1,
+        int pd,
+        Parameters params,
+        float *flow,
+        float *occ,
+        ConvergenceMonitor &conv
+) {
+    using namespace std::chrono;
+    const int w = params.w;
+    const int h = params.h;
+    const int val_method = params.val_method;
+
+    OpticalFlowData ofD = init_Optical_Flow_Data(params);
+
+    float *a = nullptr;
+    float *xi11 = nullptr;
+    float *xi12 = nullptr;
+    float *xi21 = nullptr;
+    float *xi22 = nullptr;
+
     int size = w * h;
+    // 0 - TVl2 coupled, otherwise Du
+    if (val_method == M_NLTVL1 || val_method == M_NLTVL1_W || val_method == M_NLTVCSAD || val_method == M_NLTVCSAD_W) {
+        //printf("NL-TVL1 or NLTV-CSAD\n");
+        std::printf("W:%d H:%d Pd:%d\n", w, h, pd);
+        a = new float[size * pd];
+        cached_rgb_to_lab(i0, w, h, pd, a);
+    }
+
+    auto *i0n = numa_alloc_image(size);
+    auto *i1n = numa_alloc_image(size);
+    auto *i_1n = numa_alloc_image(size);
+
+    // Gray, jointly normalized and smoothed frames (from the cache if they were computed before)
+    PreprocessCache &cache = preprocess_cache();
+    char gray_tag[64];
+    snprintf(gray_tag, sizeof(gray_tag), "global-gray-triplet sigma=%g", (double) PRESMOOTHING_SIGMA);
+    const uint64_t gray_key = cache.enabled() ? cache.key(gray_tag, {{i0, (size_t) size * pd},
+                                                                     {i1, (size_t) size * pd},
+                                                                     {i_1, (size_t) size * pd}}, w, h) : 0;
+    if (!cache.load(gray_key, w, h, {i0n, i1n, i_1n})) {
+        if (pd != 1) {
+
+            rgb2gray(i0, w, h, i0n);
+            rgb2gray(i1, w, h, i1n);
+            rgb2gray(i_1, w, h, i_1n);
+
+        } else {
+
+            memcpy(i0n, i0, size * sizeof(float));
+            memcpy(i1n, i1, size * sizeof(float));
+            memcpy(i_1n, i_1, size * sizeof(float));
+        }
+        image_normalization_3(i0n, i1n, i_1n, i0n, i1n, i_1n, size);
+        gaussian(i0n, w, h, PRESMOOTHING_SIGMA);
+        gaussian(i1n, w, h, PRESMOOTHING_SIGMA);
+        gaussian(i_1n, w, h, PRESMOOTHING_SIGMA);
+        cache.store(gray_key, w, h, {i0n, i1n, i_1n});
+    }
+
+
+
+    // Allocate memory for the flow
+    float *u = ofD.u1;
+    float *v = ofD.u2;
+    float *chi = ofD.chi;
+
+    auto clk_init_start = system_clock::now();
+    // Initialize flow with flow from local faldoi
     for (int i = 0; i < size; i++) {
-        out[i] = .299 * in[i] + .587 * in[size + i] + .114 * in[2 * size + i];
+        u[i] = flow[i];
+        v[i] = flow[size + i];
+        if (val_method >= 8) {
+            chi[i] = occ[i];
+        }
+    }
+
+    SpecificOFStuff stuffOF{};
+    PatchIndexes index{};
+    // Initialize dual variables if necessary (TV) and other stuff for TVL1_occ
+    if (val_method == M_TVL1 || val_method == M_TVL1_W || val_method == M_TVCSAD || val_method == M_TVCSAD_W
+        || val_method == M_TVL1_OCC) {
+
+        if (val_method == M_TVL1_OCC) {
 
+            index.ii = 0;
+            index.ij = 0;
+            index.ei = w;
+            index.ej = h;
+
+
+            initialize_auxiliar_stuff(stuffOF, ofD, params.w, params.h);
+            // Derivatives of I0 to compute weight g
+
+            xi11 = stuffOF.tvl2_occ.xi11;
+            xi12 = stuffOF.tvl2_occ.xi12;
+            xi21 = stuffOF.tvl2_occ.xi21;
+            xi22 = stuffOF.tvl2_occ.xi22;
+        } else {
+            xi11 = numa_alloc_image(size);
+            xi12 = numa_alloc_image(size);
+            xi21 = numa_alloc_image(size);
+            xi22 = numa_alloc_image(size);
+        }
+
+
+        for (int i = 0; i < size; i++) {
+            xi11[i] = 0.0;
+            xi12[i] = 0.0;
+            xi21[i] = 0.0;
+            xi22[i] = 0.0;
+        }
     }
 
+    auto clk_init_end = system_clock::now(); // PROFILING
+    duration<double> elapsed_secs_init = clk_init_end - clk_init_start; // PROFILING
+    cout << "(global_faldoi.cpp) initialising everything took "
+         << elapsed_secs_init.count() << endl;
+
+    // 0 - TVl2 coupled, otherwise Du
+    if (val_method == M_TVL1 || val_method == M_TVL1_W) {
+        //printf("TV-l2 coupled\n");
+        tvl2OF(i0n, i1n, u, v, xi11, xi12, xi21, xi22, params.lambda, params.theta, params.tau, params.tol_OF, w,
+               h, params.warps, params.verbose, conv);
+
+    } else if (val_method == M_NLTVCSAD || val_method == M_NLTVCSAD_W) {
+        params.lambda = 0.85;
+        params.theta = 0.3;
+        params.tau = 0.1;
+        //printf("NLTV-CSAD\n");
+        nltvcsad_PD(i0n, i1n, a, pd, params.lambda, params.theta, params.tau, w, h, params.warps,
+                    params.verbose, u, v, conv);
+
+    } else if (val_method == M_NLTVL1 || val_method == M_NLTVL1_W) {
+        params.lambda = 2.0;
+        params.theta = 0.3;
+        params.tau = 0.1;
+        //printf("NLTV-L1\n");
+        nltvl1_PD(i0n, i1n, a, pd, params.lambda, params.theta, params.tau, w, h, params.warps,
+                  params.verbose, u, v, conv);
+
+    } else if (val_method == M_TVCSAD || val_method == M_TVCSAD_W) {
+        params.lambda = 0.85;
+        params.theta = 0.3;
+        params.tau = 0.125;
+        //printf("TV-CSAD\n");
+        tvcsad_PD(i0n, i1n, xi11, xi12, xi21, xi22, params.lambda, params.theta, params.tau, params.tol_OF, w, h,
+                  params.warps, params.verbose, u, v, conv);
+
+    } else if (val_method == M_TVL1_OCC) {
+        //fprintf(stderr, "TV-l2 occlusions\n");
+        float ener_N;
+
+        guided_tvl2coupled_occ(i0n, i1n, i_1n, &ofD, &(stuffOF.tvl2_occ), &ener_N, index, params.w, params.h);
+
+    }
+
+    auto clk_global_min_end = system_clock::now(); // PROFILING
+    duration<double> elapsed_secs_global_min = clk_global_min_end - clk_init_end; // PROFILING
+    cout << "(global_faldoi.cpp) global minimisation (functional-specific) took "
+         << elapsed_secs_global_min.count() << endl;
+
+    // Refined flow (u2 follows u1) and occlusion mask back to the caller
+    memcpy(flow, u, 2 * size * sizeof(float));
+    if (val_method == M_TVL1_OCC) {
+        memcpy(occ, chi, size * sizeof(float));
+        free_auxiliar_stuff(&stuffOF, &ofD);
+    }
+
+    // Delete allocated memory
+
+    delete[] u;
+    delete[] ofD.u1_ba;
+    delete[] chi;
+    if (val_method == M_TVL1 || val_method == M_TVL1_W || val_method == M_TVCSAD || val_method == M_TVCSAD_W) {
+        delete[] xi11;
+        delete[] xi12;
+        delete[] xi21;
+        delete[] xi22;
+    } else {
+        delete[] a;
+    }
+
+    delete[] i0n;
+    delete[] i1n;
+    delete[] i_1n;
 }
 
 
+// Built without main() into faldoi_pipeline
+#ifndef FALDOI_NO_MAIN
 /*
  *
  *  Main program:
@@ -1821,14 +2078,26 @@ int main(int argc, char *argv[]) {
     auto file_params = pick_option(args, "p", "");                          // Params' file
     auto global_iters = pick_option(args, "glb_iters",
                                     to_string(MAX_ITERATIONS_GLOBAL));      // Faldoi global iterations
+    auto conv_log = pick_option(args, "conv_log", "");                      // Convergence trace (.csv/.json)
+    auto rel_tol = pick_option(args, "rel_tol",
+                               to_string(PAR_DEFAULT_REL_TOL_ENERGY));      // Relative energy decrease (-m 0 and 1 only)
+    auto ener_every = pick_option(args, "ener_every",
+                                  to_string(PAR_DEFAULT_ENERGY_CHECK));     // Energy evaluation period
+    auto affinity = pick_option(args, "affinity",
+                                to_string(PAR_DEFAULT_AFFINITY));           // Thread pinning (none, close, spread)
+    auto cache_dir = pick_option(args, "cache_dir", "");                    // Preprocessing cache (off if empty)
 
     if (args.size() != 6 && args.size() != 4) {
         fprintf(stderr, "Without occlusions:\n");
         fprintf(stderr, "Usage: %lu  ims.txt in_flow.flo  out.flo "
-                "[-m method_val] [-w num_warps] [-p file of parameters] val [-glb_iters global_iters] \n", args.size());
+                "[-m method_val] [-w num_warps] [-p file of parameters] val [-glb_iters global_iters] "
+                "[-conv_log trace.csv|trace.json] [-rel_tol rel_energy_decrease] [-ener_every iters] "
+                "[-affinity none|close|spread] [-cache_dir dir]\n", args.size());
         fprintf(stderr, "With occlusions:\n");
         fprintf(stderr, "Usage: %lu  ims.txt in_flow.flo  out.flo occl_input.png occl_out.png"
-                " [-m method_val] [-w num_warps] [-p file of parameters] val [-glb_iters global_iters] \n", args.size());
+                " [-m method_val] [-w num_warps] [-p file of parameters] val [-glb_iters global_iters]"
+                " [-conv_log trace.csv|trace.json] [-rel_tol rel_energy_decrease] [-ener_every iters]"
+                " [-affinity none|close|spread] [-cache_dir dir]\n", args.size());
 
         return EXIT_FAILURE;
     }
@@ -1838,6 +2107,14 @@ int main(int argc, char *argv[]) {
     int val_method = stoi(var_reg);
     int nwarps = stoi(warps_val);
     int glb_it = stoi(global_iters);
+    ConvergenceMonitor conv(glb_it, stof(rel_tol), stoi(ener_every), !conv_log.empty());
+    int affinity_mode = parse_affinity(affinity);
+    if (affinity_mode < 0) {
+        fprintf(stderr, "ERROR: unknown affinity '%s' (none, close or spread)\n", affinity.c_str());
+        return EXIT_FAILURE;
+    }
+    numa_pin_threads(affinity_mode);
+    preprocess_cache().open(cache_dir);
 
 
     // Read the parameters
@@ -1895,7 +2172,8 @@ int main(int argc, char *argv[]) {
 
     float *i0 = iio_read_image_float_split(filename_i0.c_str(), w + 0, h + 0, pd + 0);
     float *i1 = iio_read_image_float_split(filename_i1.c_str(), w + 1, h + 1, pd + 1);
-    float *flow = iio_read_image_float_split(image_flow_name.c_str(), w + 2, h + 2, pd + 2);
+    float *flow = read_flow(image_flow_name, w + 2, h + 2);
+    pd[2] = flow ? 2 : 0;
 
     float *occ = nullptr;
     if (val_method >= 8) {
@@ -1985,182 +2263,26 @@ int main(int argc, char *argv[]) {
     if (params.verbose)
         cerr << params;
 
-    OpticalFlowData ofD = init_Optical_Flow_Data(params);
-
-    float *a = nullptr;
-    float *xi11 = nullptr;
-    float *xi12 = nullptr;
-    float *xi21 = nullptr;
-    float *xi22 = nullptr;
-
-    int size = w[0] * h[0];
-    // 0 - TVl2 coupled, otherwise Du
-    if (val_method == M_NLTVL1 || val_method == M_NLTVL1_W || val_method == M_NLTVCSAD || val_method == M_NLTVCSAD_W) {
-        //printf("NL-TVL1 or NLTV-CSAD\n");
-        std::printf("W:%d H:%d Pd:%d\n", w[0], h[0], pd[0]);
-        a = new float[size * pd[0]];
-        image_to_lab(i0, size, a);
-    }
-
-    auto *i0n = new float[size];
-    auto *i1n = new float[size];
-    auto *i_1n = new float[size];
-
-    if (pd[0] != 1) {
-
-        rgb2gray(i0, w[0], h[0], i0n);
-        rgb2gray(i1, w[0], h[0], i1n);
-        rgb2gray(i_1, w[0], h[0], i_1n);
-
-    } else {
-
-        memcpy(i0n, i0, size * sizeof(float));
-        memcpy(i1n, i1, size * sizeof(float));
-        memcpy(i_1n, i_1, size * sizeof(float));
-    }
-    image_normalization_3(i0n, i1n, i_1n, i0n, i1n, i_1n, size);
-    gaussian(i0n, w[0], h[0], PRESMOOTHING_SIGMA);
-    gaussian(i1n, w[0], h[0], PRESMOOTHING_SIGMA);
-    gaussian(i_1n, w[0], h[0], PRESMOOTHING_SIGMA);
-
+    global_faldoi_run(i0, i1, i_1, pd[0], params, flow, occ, conv);
 
+    ResultWriter &writer = result_writer();
+    writer.save(outfile, flow, w[0], h[0], 2);
+    if (val_method == M_TVL1_OCC)
+        writer.save_mask(occ_output, occ, w[0], h[0]);
 
-    // Allocate memory for the flow
-    float *u = ofD.u1;
-    float *v = ofD.u2;
-    float *chi = ofD.chi;
-
-    auto clk_init_start = system_clock::now();
-    // Initialize flow with flow from local faldoi
-    for (int i = 0; i < size; i++) {
-        u[i] = flow[i];
-        v[i] = flow[size + i];
-        if (val_method >= 8) {
-            chi[i] = occ[i];
-        }
-    }
-
-    SpecificOFStuff stuffOF{};
-    PatchIndexes index{};
-    // Initialize dual variables if necessary (TV) and other stuff for TVL1_occ
-    if (val_method == M_TVL1 || val_method == M_TVL1_W || val_method == M_TVCSAD || val_method == M_TVCSAD_W
-        || val_method == M_TVL1_OCC) {
-
-        if (val_method == M_TVL1_OCC) {
+    if (!conv_log.empty())
+        conv.write(conv_log);
+    preprocess_cache().print_stats("global_faldoi.cpp");
+    writer.flush();
+    writer.print_stats("global_faldoi.cpp");
 
-            index.ii = 0;
-            index.ij = 0;
-            index.ei = w[0];
-            index.ej = h[0];
-
-
-            initialize_auxiliar_stuff(stuffOF, ofD, params.w, params.h);
-            // Derivatives of I0 to compute weight g
-
-            xi11 = stuffOF.tvl2_occ.xi11;
-            xi12 = stuffOF.tvl2_occ.xi12;
-            xi21 = stuffOF.tvl2_occ.xi21;
-            xi22 = stuffOF.tvl2_occ.xi22;
-        } else {
-            xi11 = new float[size];
-            xi12 = new float[size];
-            xi21 = new float[size];
-            xi22 = new float[size];
-        }
-
-
-        for (int i = 0; i < size; i++) {
-            xi11[i] = 0.0;
-            xi12[i] = 0.0;
-            xi21[i] = 0.0;
-            xi22[i] = 0.0;
-        }
-    }
-
-    auto clk_init_end = system_clock::now(); // PROFILING
-    duration<double> elapsed_secs_init = clk_init_end - clk_init_start; // PROFILING
-    cout << "(global_faldoi.cpp) initialising everything took "
-         << elapsed_secs_init.count() << endl;
-
-    // 0 - TVl2 coupled, otherwise Du
-    if (val_method == M_TVL1 || val_method == M_TVL1_W) {
-        //printf("TV-l2 coupled\n");
-        tvl2OF(i0n, i1n, u, v, xi11, xi12, xi21, xi22, params.lambda, params.theta, params.tau, params.tol_OF, w[0],
-               h[0], params.warps, params.verbose);
-
-    } else if (val_method == M_NLTVCSAD || val_method == M_NLTVCSAD_W) {
-        params.lambda = 0.85;
-        params.theta = 0.3;
-        params.tau = 0.1;
-        //printf("NLTV-CSAD\n");
-        nltvcsad_PD(i0n, i1n, a, pd[0], params.lambda, params.theta, params.tau, w[0], h[0], params.warps,
-                    params.verbose, u, v);
-
-    } else if (val_method == M_NLTVL1 || val_method == M_NLTVL1_W) {
-        params.lambda = 2.0;
-        params.theta = 0.3;
-        params.tau = 0.1;
-        //printf("NLTV-L1\n");
-        nltvl1_PD(i0n, i1n, a, pd[0], params.lambda, params.theta, params.tau, w[0], h[0], params.warps,
-                  params.verbose, u, v);
-
-    } else if (val_method == M_TVCSAD || val_method == M_TVCSAD_W) {
-        params.lambda = 0.85;
-        params.theta = 0.3;
-        params.tau = 0.125;
-        //printf("TV-CSAD\n");
-        tvcsad_PD(i0n, i1n, xi11, xi12, xi21, xi22, params.lambda, params.theta, params.tau, params.tol_OF, w[0], h[0],
-                  params.warps, params.verbose, u, v);
-
-    } else if (val_method == M_TVL1_OCC) {
-        //fprintf(stderr, "TV-l2 occlusions\n");
-        float ener_N;
-
-        guided_tvl2coupled_occ(i0n, i1n, i_1n, &ofD, &(stuffOF.tvl2_occ), &ener_N, index, params.w, params.h);
-
-    }
-
-    iio_save_image_float_split(outfile.c_str(), u, w[0], h[0], 2);
-
-
-    if (val_method == M_TVL1_OCC) {
-        auto *out_occ_int = new int[w[0] * h[0]];
-        for (int i = 0; i < w[0] * h[0]; i++) {
-
-            out_occ_int[i] = chi[i];
-        }
-        iio_save_image_int(occ_output.c_str(), out_occ_int, w[0], h[0]);
-        delete[] out_occ_int;
-        free_auxiliar_stuff(&stuffOF, &ofD);
-    }
-
-    // Delete allocated memory
-
-    delete[] u;
-    delete[] chi;
-    if (val_method == M_TVL1 || val_method == M_TVL1_W || val_method == M_TVCSAD || val_method == M_TVCSAD_W) {
-        delete[] xi11;
-        delete[] xi12;
-        delete[] xi21;
-        delete[] xi22;
-    } else {
-        delete[] a;
-    }
-
-    delete[] i0n;
-    delete[] i1n;
-    delete[] i_1n;
     today = system_clock::now();
 
     tt = system_clock::to_time_t(today);
     std::cerr << "today is: " << ctime(&tt);
     return EXIT_SUCCESS;
-
-    auto clk_global_min_end = system_clock::now(); // PROFILING
-    duration<double> elapsed_secs_global_min = clk_global_min_end - clk_init_end; // PROFILING
-    cout << "(global_faldoi.cpp) global minimisation (functional-specific) took "
-         << elapsed_secs_global_min.count() << endl;
-
 }
 
+#endif // FALDOI_NO_MAIN
+
 #endif//GLOBAL_FALDOI
@@ -0,0 +1,551 @@
+// This program is free software: you can use, modify and/or redistribute it
+// under the terms of the simplified BSD License. You should have received a
+// copy of this license along this program. If not, see
+// <http://www.opensource.org/licenses/bsd-license.html>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "xmalloc.h"
+#include "image_kernels.h"
+
+#define DEFAULT_GAUSSIAN_WINDOW_SIZE 5
+
+// Columns handled together by one thread in the vertical IIR pass
+#define IIR_STRIP 64
+// Rows transposed together in the horizontal IIR pass
+#define IIR_ROW_BLOCK 16
+
+// CIE L*a*b* constants
+#define LAB_T 0.008856
+#define LAB_ATTENUATION 1.5f
+// Entries of the a*, b* attenuation table (over L* in [0, 100])
+#define LAB_ATT_SIZE 1024
+
+
+/**
+ *
+ * The static helpers below only contain orphaned "omp for" loops: they are
+ * called from inside a parallel region, so several passes can share one
+ * region (and one row split). Called serially they just run the loop.
+ *
+ **/
+
+// Reflected row/column index of the direct Gaussian (same as the former padded buffers)
+static inline int reflect_index(int r, int n)
+{
+	if (r < 0)
+		return -r;
+	if (r >= n)
+		return 2 * n - 1 - r;
+	return r;
+}
+
+// Normalised half kernel B[0..size-1] of the direct Gaussian
+static void gaussian_kernel(float *B, int size, float sigma)
+{
+	const float den = 2 * sigma * sigma;
+	for (int i = 0; i < size; i++)
+		B[i] = 1 / (sigma * sqrt(2.0 * 3.1415926)) * exp(-i * i / den);
+
+	float norm = 0;
+	for (int i = 0; i < size; i++)
+		norm += B[i];
+	norm *= 2;
+	norm -= B[0];
+	for (int i = 0; i < size; i++)
+		B[i] /= norm;
+}
+
+// Horizontal pass of the direct Gaussian: rows of I convolved into out
+static void gaussian_rows(const float *I, float *out, const float *B,
+		int size, int xdim, int ydim)
+{
+	const int bdx = xdim + size;
+	float *R = xmalloc((size + xdim + size) * sizeof*R);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (int k = 0; k < ydim; k++) {
+		const float *row = I + k * xdim;
+		int i, j;
+		for (i = size; i < bdx; i++)
+			R[i] = row[i - size];
+		for (i = 0, j = bdx; i < size; i++, j++) {
+			R[i] = row[size - i];
+			R[j] = row[xdim - i - 1];
+		}
+		for (i = size; i < bdx; i++) {
+			float sum = B[0] * R[i];
+			for (j = 1; j < size; j++)
+				sum += B[j] * (R[i - j] + R[i + j]);
+			out[k * xdim + i - size] = sum;
+		}
+	}
+	free(R);
+}
+
+// Vertical pass of the direct Gaussian, written row by row so the inner loop runs over
+// contiguous memory (vectorised) instead of gathering one column at a time
+static void gaussian_cols(const float *tmp, float *I, const float *B,
+		int size, int xdim, int ydim)
+{
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (int k = 0; k < ydim; k++) {
+		float *restrict out = I + k * xdim;
+		const float *restrict c = tmp + k * xdim;
+		for (int x = 0; x < xdim; x++)
+			out[x] = B[0] * c[x];
+		for (int j = 1; j < size; j++) {
+			const float *restrict up = tmp + reflect_index(k - j, ydim) * xdim;
+			const float *restrict dn = tmp + reflect_index(k + j, ydim) * xdim;
+			const float b = B[j];
+			for (int x = 0; x < xdim; x++)
+				out[x] += b * (up[x] + dn[x]);
+		}
+	}
+}
+
+// Young & van Vliet coefficients: b[0..2] are b1/b0, b2/b0, b3/b0
+static void iir_coefficients(float sigma, float *b, float *Bn)
+{
+	const double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330
+		: 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+	const double q2 = q * q;
+	const double q3 = q2 * q;
+	const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+
+	b[0] = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+	b[1] = -(1.4281 * q2 + 1.26661 * q3) / b0;
+	b[2] = 0.422205 * q3 / b0;
+	*Bn = 1 - (b[0] + b[1] + b[2]);
+}
+
+// Causal + anti-causal recursive pass over every row (borders replicated).
+// Blocks of IIR_ROW_BLOCK rows are transposed into a buffer so the recursion
+// runs on all the rows of the block at once instead of one dependent chain
+static void iir_rows(float *I, const float *b, float Bn, int xdim, int ydim)
+{
+	const int n = xdim - 1;
+	const int nblocks = (ydim + IIR_ROW_BLOCK - 1) / IIR_ROW_BLOCK;
+	float *T = xmalloc(xdim * IIR_ROW_BLOCK * sizeof*T);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (int blk = 0; blk < nblocks; blk++) {
+		const int y0 = blk * IIR_ROW_BLOCK;
+		const int nr = (y0 + IIR_ROW_BLOCK < ydim) ? IIR_ROW_BLOCK : ydim - y0;
+
+		for (int r = 0; r < nr; r++)
+			for (int x = 0; x < xdim; x++)
+				T[x * IIR_ROW_BLOCK + r] = I[(y0 + r) * xdim + x];
+
+		for (int x = 1; x <= n; x++) {
+			float *restrict c = T + x * IIR_ROW_BLOCK;
+			const float *p1 = T + (x - 1) * IIR_ROW_BLOCK;
+			const float *p2 = T + (x >= 2 ? x - 2 : 0) * IIR_ROW_BLOCK;
+			const float *p3 = T + (x >= 3 ? x - 3 : 0) * IIR_ROW_BLOCK;
+			for (int r = 0; r < nr; r++)
+				c[r] = Bn * c[r] + b[0] * p1[r] + b[1] * p2[r] + b[2] * p3[r];
+		}
+		for (int x = n - 1; x >= 0; x--) {
+			float *restrict c = T + x * IIR_ROW_BLOCK;
+			const float *p1 = T + (x + 1) * IIR_ROW_BLOCK;
+			const float *p2 = T + (x + 2 <= n ? x + 2 : n) * IIR_ROW_BLOCK;
+			const float *p3 = T + (x + 3 <= n ? x + 3 : n) * IIR_ROW_BLOCK;
+			for (int r = 0; r < nr; r++)
+				c[r] = Bn * c[r] + b[0] * p1[r] + b[1] * p2[r] + b[2] * p3[r];
+		}
+
+		for (int r = 0; r < nr; r++)
+			for (int x = 0; x < xdim; x++)
+				I[(y0 + r) * xdim + x] = T[x * IIR_ROW_BLOCK + r];
+	}
+	free(T);
+}
+
+// Same recursion along the columns, on strips of IIR_STRIP columns so the
+// inner loop stays contiguous
+static void iir_cols(float *I, const float *b, float Bn, int xdim, int ydim)
+{
+	const int n = ydim - 1;
+	const int nstrips = (xdim + IIR_STRIP - 1) / IIR_STRIP;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (int s = 0; s < nstrips; s++) {
+		const int x0 = s * IIR_STRIP;
+		const int x1 = (x0 + IIR_STRIP < xdim) ? x0 + IIR_STRIP : xdim;
+
+		for (int y = 1; y <= n; y++) {
+			float *restrict c = I + y * xdim;
+			const float *p1 = I + (y - 1) * xdim;
+			const float *p2 = I + (y >= 2 ? y - 2 : 0) * xdim;
+			const float *p3 = I + (y >= 3 ? y - 3 : 0) * xdim;
+			for (int x = x0; x < x1; x++)
+				c[x] = Bn * c[x] + b[0] * p1[x] + b[1] * p2[x] + b[2] * p3[x];
+		}
+		for (int y = n - 1; y >= 0; y--) {
+			float *restrict c = I + y * xdim;
+			const float *p1 = I + (y + 1) * xdim;
+			const float *p2 = I + (y + 2 <= n ? y + 2 : n) * xdim;
+			const float *p3 = I + (y + 3 <= n ? y + 3 : n) * xdim;
+			for (int x = x0; x < x1; x++)
+				c[x] = Bn * c[x] + b[0] * p1[x] + b[1] * p2[x] + b[2] * p3[x];
+		}
+	}
+}
+
+static void centered_gradient_rows(const float *input, float *dx, float *dy,
+		int nx, int ny)
+{
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (int i = 0; i < ny; i++) {
+		const float *r  = input + i * nx;
+		const float *up = (i > 0) ? r - nx : r;
+		const float *dn = (i < ny - 1) ? r + nx : r;
+		float *ox = dx + i * nx;
+		float *oy = dy + i * nx;
+
+		ox[0] = 0.5 * (r[1] - r[0]);
+		for (int j = 1; j < nx - 1; j++)
+			ox[j] = 0.5 * (r[j + 1] - r[j - 1]);
+		ox[nx - 1] = 0.5 * (r[nx - 1] - r[nx - 2]);
+
+		for (int j = 0; j < nx; j++)
+			oy[j] = 0.5 * (dn[j] - up[j]);
+	}
+}
+
+// Checks the direct kernel fits in the image (reflecting boundary); returns its size
+static int direct_kernel_size(int xdim, int ydim, float sigma)
+{
+	const int size = (int) (DEFAULT_GAUSSIAN_WINDOW_SIZE * sigma) + 1;
+	if (size > xdim || size > ydim) {
+		fprintf(stderr, "GaussianSmooth: sigma too large\n");
+		abort();
+	}
+	return size;
+}
+
+
+void par_gaussian_direct(
+	float *I,
+	const int xdim,
+	const int ydim,
+	const float sigma
+	)
+{
+	if (sigma <= 0)
+		return;
+
+	const int size = direct_kernel_size(xdim, ydim, sigma);
+	float B[size];
+	gaussian_kernel(B, size, sigma);
+
+	float *tmp = xmalloc(xdim * ydim * sizeof*tmp);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+		gaussian_rows(I, tmp, B, size, xdim, ydim);
+		gaussian_cols(tmp, I, B, size, xdim, ydim);
+	}
+	free(tmp);
+}
+
+void par_gaussian_iir(
+	float *I,
+	const int xdim,
+	const int ydim,
+	const float sigma
+	)
+{
+	if (sigma <= 0)
+		return;
+
+	float b[3], Bn;
+	iir_coefficients(sigma, b, &Bn);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	{
+		iir_rows(I, b, Bn, xdim, ydim);
+		iir_cols(I, b, Bn, xdim, ydim);
+	}
+}
+
+void par_gaussian(
+	float *I,
+	const int xdim,
+	const int ydim,
+	const float sigma
+	)
+{
+	if (sigma >= GAUSSIAN_IIR_SIGMA)
+		par_gaussian_iir(I, xdim, ydim, sigma);
+	else
+		par_gaussian_direct(I, xdim, ydim, sigma);
+}
+
+void par_gaussian_centered_gradient(
+	float *I,
+	float *dx,
+	float *dy,
+	const int nx,
+	const int ny,
+	const float sigma
+	)
+{
+	if (sigma <= 0) {
+		par_centered_gradient(I, dx, dy, nx, ny);
+		return;
+	}
+
+	if (sigma >= GAUSSIAN_IIR_SIGMA) {
+		float b[3], Bn;
+		iir_coefficients(sigma, b, &Bn);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			iir_rows(I, b, Bn, nx, ny);
+			iir_cols(I, b, Bn, nx, ny);
+			centered_gradient_rows(I, dx, dy, nx, ny);
+		}
+	} else {
+		const int size = direct_kernel_size(nx, ny, sigma);
+		float B[size];
+		gaussian_kernel(B, size, sigma);
+
+		float *tmp = xmalloc(nx * ny * sizeof*tmp);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+			gaussian_rows(I, tmp, B, size, nx, ny);
+			gaussian_cols(tmp, I, B, size, nx, ny);
+			centered_gradient_rows(I, dx, dy, nx, ny);
+		}
+		free(tmp);
+	}
+}
+
+void par_centered_gradient(
+	const float *input,
+	float *dx,
+	float *dy,
+	const int nx,
+	const int ny
+	)
+{
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+	centered_gradient_rows(input, dx, dy, nx, ny);
+}
+
+void par_forward_gradient(
+	const float *f,
+	float *fx,
+	float *fy,
+	const int nx,
+	const int ny
+	)
+{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < ny; i++) {
+		const float *r = f + i * nx;
+		float *ox = fx + i * nx;
+		float *oy = fy + i * nx;
+
+		for (int j = 0; j < nx - 1; j++)
+			ox[j] = r[j + 1] - r[j];
+		ox[nx - 1] = 0;
+
+		if (i < ny - 1)
+			for (int j = 0; j < nx; j++)
+				oy[j] = r[j + nx] - r[j];
+		else
+			for (int j = 0; j < nx; j++)
+				oy[j] = 0;
+	}
+}
+
+void par_five_point_gradient(
+	const float *input,
+	float *dx,
+	float *dy,
+	const int nx,
+	const int ny
+	)
+{
+	// compute the gradient on the center body of the image
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 2; i < ny-2; i++) {
+		for (int j = 2; j < nx-2; j++) {
+			const int k = i * nx + j;
+			dx[k] = (1.0/12)*(input[k-2] - 8*input[k-1] + 8*input[k+1] - input[k+2]);
+			dy[k] = (1.0/12)*(input[k-2*nx] - 8*input[k-nx] + 8*input[k+ nx] - input[k+2*nx]);
+		}
+	}
+
+	// The borders are O(nx + ny) and keep the exact order of the serial version
+
+	//Centered gradient for the second column an the penultimate column
+	for (int j = 1; j < ny-1; j++) {
+		dx[j*nx + 1] = 0.5*(input[j*nx + 2] - input[j*nx -1]);
+		dy[j*nx + 1] = 0.5*(input[j*nx + nx +1] - input[j*nx - nx +1]);
+
+		const int k = j*nx + (ny-2);
+
+		dx[k] = 0.5*(input[k+1] - input[k-1]);
+		dy[k] = 0.5*(input[k + nx] - input[k-nx]);
+	}
+
+	//Centered gradient for the second row an the penultimate row
+	for (int j = 1; j < ny-1; j++) {
+		dx[nx + j] = 0.5*(input[nx + j + 1] - input[nx + j -1]);
+		dy[nx + j] = 0.5*(input[2*nx + j] - input[j]);
+
+		const int k = nx*(ny-2);
+
+		dx[k+j] = 0.5*(input[k+j+1] - input[k+j-1]);
+		dy[k+j] = 0.5*(input[k + nx + j] - input[k - nx +j]);
+	}
+
+	// compute the gradient on the first and last rows
+	for (int j = 1; j < nx-1; j++) {
+		dx[j] = 0.5*(input[j+1] - input[j-1]);
+		dy[j] = 0.5*(input[j+nx] - input[j]);
+
+		const int k = (ny - 1) * nx + j;
+
+		dx[k] = 0.5*(input[k+1] - input[k-1]);
+		dy[k] = 0.5*(input[k] - input[k-nx]);
+	}
+
+	// compute the gradient on the first and last columns
+	for (int i = 1; i < ny-1; i++) {
+		const int p = i * nx;
+		dx[p] = 0.5*(input[p+1] - input[p]);
+		dy[p] = 0.5*(input[p+nx] - input[p-nx]);
+
+		const int k = (i+1) * nx - 1;
+
+		dx[k] = 0.5*(input[k] - input[k-1]);
+		dy[k] = 0.5*(input[k+nx] - input[k-nx]);
+	}
+
+	// compute the gradient at the four corners
+	dx[0] = 0.5*(input[1] - input[0]);
+	dy[0] = 0.5*(input[nx] - input[0]);
+
+	dx[nx-1] = 0.5*(input[nx-1] - input[nx-2]);
+	dy[nx-1] = 0.5*(input[2*nx-1] - input[nx-1]);
+
+	dx[(ny-1)*nx] = 0.5*(input[(ny-1)*nx + 1] - input[(ny-1)*nx]);
+	dy[(ny-1)*nx] = 0.5*(input[(ny-1)*nx] - input[(ny-2)*nx]);
+
+	dx[ny*nx-1] = 0.5*(input[ny*nx-1] - input[ny*nx-1-1]);
+	dy[ny*nx-1] = 0.5*(input[ny*nx-1] - input[(ny-1)*nx-1]);
+}
+
+void par_rgb_to_gray(
+	const float *in,
+	const int w,
+	const int h,
+	float *out
+	)
+{
+	const int size = w * h;
+	const float *r = in, *g = in + size, *b = in + 2 * size;
+#ifdef _OPENMP
+#pragma omp parallel for simd schedule(static)
+#endif
+	for (int i = 0; i < size; i++)
+		out[i] = .299 * r[i] + .587 * g[i] + .114 * b[i];
+}
+
+// f(t) of the L*a*b* definition: cube root above LAB_T, linear below
+static inline float lab_f(float t)
+{
+	return t > LAB_T ? pow(t, 1. / 3) : 7.787 * t + 16 / 116.;
+}
+
+static inline float lab_attenuation(float L)
+{
+	const float l2 = (L / 100) * (L / 100) - 0.6;
+	return exp(-LAB_ATTENUATION * l2 * l2);
+}
+
+// Table lookup with linear interpolation of a function sampled on [0, 1]
+static inline float lut_interp(const float *lut, int n, float t)
+{
+	const float p = t * n;
+	int k = (int) p;
+	k = k < n ? k : n - 1;
+	const float a = p - k;
+	return lut[k] + a * (lut[k + 1] - lut[k]);
+}
+
+void par_rgb_to_lab(
+	const float *in,
+	const int size,
+	float *out
+	)
+{
+	// f is C1 at LAB_T (both branches have slope 7.787 there), so one table
+	// covers the two branches; the attenuation only depends on L*
+	float f[LAB_LUT_SIZE + 1], att[LAB_ATT_SIZE + 1];
+	for (int k = 0; k <= LAB_LUT_SIZE; k++)
+		f[k] = lab_f((float) k / LAB_LUT_SIZE);
+	for (int k = 0; k <= LAB_ATT_SIZE; k++)
+		att[k] = lab_attenuation(100.f * k / LAB_ATT_SIZE);
+
+	const float *r = in, *g = in + size, *b = in + 2 * size;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < size; i++) {
+		const float R = r[i] / 255.f;
+		const float G = g[i] / 255.f;
+		const float B = b[i] / 255.f;
+		const float X = (0.412453f * R + 0.357580f * G + 0.180423f * B) / 0.950456f;
+		const float Y =  0.212671f * R + 0.715160f * G + 0.072169f * B;
+		const float Z = (0.019334f * R + 0.119193f * G + 0.950227f * B) / 1.088754f;
+
+		float fX, fY, fZ, c;
+		if (X >= 0 && X <= 1 && Y >= 0 && Y <= 1 && Z >= 0 && Z <= 1) {
+			fX = lut_interp(f, LAB_LUT_SIZE, X);
+			fY = lut_interp(f, LAB_LUT_SIZE, Y);
+			fZ = lut_interp(f, LAB_LUT_SIZE, Z);
+		} else {
+			fX = lab_f(X);
+			fY = lab_f(Y);
+			fZ = lab_f(Z);
+		}
+		// 116 f(Y) - 16 equals 903.3 Y below LAB_T
+		const float L = 116 * fY - 16;
+		// Dark and bright areas have less reliable colours: attenuate a*, b*
+		if (L >= 0 && L <= 100)
+			c = lut_interp(att, LAB_ATT_SIZE, L / 100);
+		else
+			c = lab_attenuation(L);
+
+		out[i] = L;
+		out[i + size] = 500 * (fX - fY) * c;
+		out[i + 2 * size] = 200 * (fY - fZ) * c;
+	}
+}
@@ -0,0 +1,138 @@
+// This program is free software: you can use, modify and/or redistribute it
+// under the terms of the simplified BSD License. You should have received a
+// copy of this license along this program. If not, see
+// <http://www.opensource.org/licenses/bsd-license.html>.
+
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+/**
+ *
+ * Shared OpenMP-parallel preprocessing kernels (Gaussian smoothing and image
+ * derivatives). The gaussian/gradient functions of mask.c and utils.cpp are
+ * thin wrappers around these, so the local and the global step run the same code.
+ *
+ * The direct Gaussian and the gradients give the same values as the former
+ * serial versions (same boundaries, same summation order).
+ *
+ **/
+
+// Above this sigma par_gaussian switches to the recursive (IIR) filter
+#define GAUSSIAN_IIR_SIGMA 3.0
+
+
+/**
+ *
+ * In-place Gaussian smoothing of an image: direct separable convolution
+ * for small sigmas, recursive IIR filter for sigma >= GAUSSIAN_IIR_SIGMA
+ *
+ **/
+void par_gaussian(
+	float *I,             // input/output image
+	const int xdim,       // image width
+	const int ydim,       // image height
+	const float sigma     // Gaussian sigma
+);
+
+/**
+ *
+ * In-place Gaussian smoothing with a truncated (5 sigma) kernel and
+ * reflecting boundaries. Rows and columns are processed in parallel
+ *
+ **/
+void par_gaussian_direct(
+	float *I,             // input/output image
+	const int xdim,       // image width
+	const int ydim,       // image height
+	const float sigma     // Gaussian sigma
+);
+
+/**
+ *
+ * In-place recursive Gaussian (Young & van Vliet, 1995) with replicated
+ * borders. Its cost does not depend on sigma; it departs from the direct
+ * filter by up to ~1.5% of the image range (mostly near the borders)
+ *
+ **/
+void par_gaussian_iir(
+	float *I,             // input/output image
+	const int xdim,       // image width
+	const int ydim,       // image height
+	const float sigma     // Gaussian sigma
+);
+
+/**
+ *
+ * Gaussian smoothing of I (in place) followed by its centered gradient,
+ * both inside one parallel region with the same row split
+ *
+ **/
+void par_gaussian_centered_gradient(
+	float *I,             // input/output image
+	float *dx,            // computed x derivative of the smoothed image
+	float *dy,            // computed y derivative of the smoothed image
+	const int nx,         // image width
+	const int ny,         // image height
+	const float sigma     // Gaussian sigma
+);
+
+// Gradient with centered differences
+void par_centered_gradient(
+	const float *input,   // input image
+	float *dx,            // computed x derivative
+	float *dy,            // computed y derivative
+	const int nx,         // image width
+	const int ny          // image height
+);
+
+// Gradient with forward differences (zero on the last row/column)
+void par_forward_gradient(
+	const float *f,       // input image
+	float *fx,            // computed x derivative
+	float *fy,            // computed y derivative
+	const int nx,         // image width
+	const int ny          // image height
+);
+
+// Gradient with five-point derivatives (1/12)*[-1 8 0 -8 1]
+void par_five_point_gradient(
+	const float *input,   // input image
+	float *dx,            // computed x derivative
+	float *dy,            // computed y derivative
+	const int nx,         // image width
+	const int ny          // image height
+);
+
+/**
+ *
+ * Colour conversion of planar RGB images (channels stored one after the
+ * other, values in [0, 255])
+ *
+ **/
+
+// Entries of the cube-root table used by par_rgb_to_lab
+#define LAB_LUT_SIZE 4096
+
+// Luma .299 R + .587 G + .114 B (same values as the former serial loop)
+void par_rgb_to_gray(
+	const float *in,      // input RGB image
+	const int w,          // image width
+	const int h,          // image height
+	float *out            // output gray image
+);
+
+/**
+ *
+ * CIE L*a*b* with the a*, b* attenuation of dark and bright areas used by
+ * the NLTV weights. The cube root and the attenuation come from linearly
+ * interpolated tables: L*, a* and b* are within 2e-3 of the pow/exp
+ * version for every 8-bit colour. Channels out of range use the exact maths
+ *
+ **/
+void par_rgb_to_lab(
+	const float *in,      // input RGB image
+	const int size,       // number of pixels
+	float *out            // output L*a*b* image
+);
+
+#endif // IMAGE_KERNELS_H
@@ -0,0 +1,254 @@
+// This program is free software: you can use, modify and/or redistribute it
+// under the terms of the simplified BSD License. You should have received a
+// copy of this license along this program. If not, see
+// <http://www.opensource.org/licenses/bsd-license.html>.
+
+// Microbenchmark of the shared preprocessing kernels against the former serial
+// gaussian/centered_gradient and colour conversions (copied below as reference).
+//
+// usage: image_kernels_bench [width height sigma repetitions]
+
+#define _POSIX_C_SOURCE 199309L   // clock_gettime under -std=c99
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "xmalloc.h"
+#include "image_kernels.h"
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Former serial version (reflecting boundary)
+static void gaussian_reference(float *I, int xdim, int ydim, float sigma)
+{
+	const float den  = 2*sigma*sigma;
+	const int   size = (int) (5 * sigma) + 1 ;
+	const int   bdx  = xdim + size;
+	const int   bdy  = ydim + size;
+
+	float B[size];
+	for(int i = 0; i < size; i++)
+		B[i] = 1 / (sigma * sqrt(2.0 * 3.1415926)) * exp(-i * i / den);
+	float norm = 0;
+	for(int i = 0; i < size; i++)
+		norm += B[i];
+	norm *= 2;
+	norm -= B[0];
+	for(int i = 0; i < size; i++)
+		B[i] /= norm;
+
+	float *R = xmalloc((size + xdim + size)*sizeof*R);
+	for (int k = 0; k < ydim; k++) {
+		int i, j;
+		for (i = size; i < bdx; i++)
+			R[i] = I[k * xdim + i - size];
+		for(i = 0, j = bdx; i < size; i++, j++) {
+			R[i] = I[k * xdim + size-i];
+			R[j] = I[k * xdim + xdim-i-1];
+		}
+		for (i = size; i < bdx; i++) {
+			float sum = B[0] * R[i];
+			for (j = 1; j < size; j++ )
+				sum += B[j] * ( R[i-j] + R[i+j] );
+			I[k * xdim + i - size] = sum;
+		}
+	}
+
+	float *T = xmalloc((size + ydim + size)*sizeof*T);
+	for (int k = 0; k < xdim; k++) {
+		int i, j;
+		for (i = size; i < bdy; i++)
+			T[i] = I[(i - size) * xdim + k];
+		for (i = 0, j = bdy; i < size; i++, j++) {
+			T[i] = I[(size-i) * xdim + k];
+			T[j] = I[(ydim-i-1) * xdim + k];
+		}
+		for (i = size; i < bdy; i++) {
+			float sum = B[0] * T[i];
+			for (j = 1; j < size; j++ )
+				sum += B[j] * (T[i-j] + T[i+j]);
+			I[(i - size) * xdim + k] = sum;
+		}
+	}
+	free(R);
+	free(T);
+}
+
+// Former serial versions of the colour conversions
+static void rgb_to_gray_reference(const float *in, int w, int h, float *out)
+{
+	const int size = w * h;
+	for (int i = 0; i < size; i++)
+		out[i] = .299 * in[i] + .587 * in[size + i] + .114 * in[2 * size + i];
+}
+
+static float pow2(const float f) { return f * f; }
+
+static void rgb_to_lab_reference(const float *in, int size, float *out)
+{
+	const float T = 0.008856;
+	const float color_attenuation = 1.5f;
+	for (int i = 0; i < size; i++) {
+		const float r = in[i] / 255.f;
+		const float g = in[i + size] / 255.f;
+		const float b = in[i + 2 * size] / 255.f;
+		float X = 0.412453 * r + 0.357580 * g + 0.180423 * b;
+		float Y = 0.212671 * r + 0.715160 * g + 0.072169 * b;
+		float Z = 0.019334 * r + 0.119193 * g + 0.950227 * b;
+		X /= 0.950456;
+		Z /= 1.088754;
+		float Y3 = pow(Y, 1. / 3);
+		float fX = X > T ? pow(X, 1. / 3) : 7.787 * X + 16 / 116.;
+		float fY = Y > T ? Y3 : 7.787 * Y + 16 / 116.;
+		float fZ = Z > T ? pow(Z, 1. / 3) : 7.787 * Z + 16 / 116.;
+		float L = Y > T ? 116 * Y3 - 16.0 : 903.3 * Y;
+		float A = 500 * (fX - fY);
+		float B = 200 * (fY - fZ);
+		float correct_lab = exp(-color_attenuation * pow2(pow2(L / 100) - 0.6));
+		out[i] = L;
+		out[i + size] = A * correct_lab;
+		out[i + 2 * size] = B * correct_lab;
+	}
+}
+
+// Former serial version
+static void centered_gradient_reference(const float *input, float *dx, float *dy,
+		const int nx, const int ny)
+{
+	for (int i = 1; i < ny-1; i++)
+		for(int j = 1; j < nx-1; j++) {
+			const int k = i * nx + j;
+			dx[k] = 0.5*(input[k + 1] - input[k - 1]);
+			dy[k] = 0.5*(input[k + nx] - input[k - nx]);
+		}
+	for (int j = 1; j < nx-1; j++) {
+		dx[j] = 0.5*(input[j + 1] - input[j - 1]);
+		dy[j] = 0.5*(input[j + nx] - input[j]);
+		const int k = (ny - 1) * nx + j;
+		dx[k] = 0.5*(input[k + 1] - input[k - 1]);
+		dy[k] = 0.5*(input[k] - input[k - nx]);
+	}
+	for(int i = 1; i < ny-1; i++) {
+		const int p = i * nx;
+		dx[p] = 0.5*(input[p + 1] - input[p]);
+		dy[p] = 0.5*(input[p + nx] - input[p - nx]);
+		const int k = (i + 1) * nx - 1;
+		dx[k] = 0.5*(input[k] - input[k - 1]);
+		dy[k] = 0.5*(input[k + nx] - input[k - nx]);
+	}
+	dx[0] = 0.5*(input[1] - input[0]);
+	dy[0] = 0.5*(input[nx] - input[0]);
+	dx[nx - 1] = 0.5*(input[nx-1] - input[nx-2]);
+	dy[nx - 1] = 0.5*(input[2*nx-1] - input[nx-1]);
+	dx[(ny - 1)*nx] = 0.5*(input[(ny - 1)*nx + 1] - input[(ny - 1)*nx]);
+	dy[(ny - 1)*nx] = 0.5*(input[(ny - 1)*nx] - input[(ny - 2)*nx]);
+	dx[ny*nx-1] = 0.5*(input[ny*nx-1] - input[ny*nx-1-1]);
+	dy[ny*nx-1] = 0.5*(input[ny*nx-1] - input[(ny-1)*nx-1]);
+}
+
+static float max_abs_diff(const float *a, const float *b, int n)
+{
+	float m = 0;
+	for (int i = 0; i < n; i++)
+		if (fabsf(a[i] - b[i]) > m)
+			m = fabsf(a[i] - b[i]);
+	return m;
+}
+
+int main(int argc, char *argv[])
+{
+	const int w = argc > 1 ? atoi(argv[1]) : 1920;
+	const int h = argc > 2 ? atoi(argv[2]) : 1080;
+	const float sigma = argc > 3 ? atof(argv[3]) : 0.9;
+	const int reps = argc > 4 ? atoi(argv[4]) : 10;
+	const int size = w * h;
+
+	float *src = xmalloc(size * sizeof*src);
+	float *a = xmalloc(size * sizeof*a);
+	float *b = xmalloc(size * sizeof*b);
+	float *ax = xmalloc(size * sizeof*ax), *ay = xmalloc(size * sizeof*ay);
+	float *bx = xmalloc(size * sizeof*bx), *by = xmalloc(size * sizeof*by);
+
+	// Smooth random image in [0, 255]
+	srand(1);
+	for (int i = 0; i < size; i++)
+		src[i] = 127.5 * (1 + sin(0.01 * (i % w)) * cos(0.013 * (i / w))) + (rand() % 16);
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	printf("%dx%d, sigma %g, %d repetitions, %d threads\n", w, h, sigma, reps, threads);
+
+	double t0, t_ref = 0, t_dir = 0, t_iir = 0, t_gref = 0, t_grad = 0, t_fused = 0;
+	float d_dir = 0, d_iir = 0, d_grad = 0, d_fused = 0;
+	for (int r = 0; r < reps; r++) {
+		memcpy(a, src, size * sizeof*a);
+		t0 = now(); gaussian_reference(a, w, h, sigma); t_ref += now() - t0;
+
+		memcpy(b, src, size * sizeof*b);
+		t0 = now(); par_gaussian_direct(b, w, h, sigma); t_dir += now() - t0;
+		d_dir = max_abs_diff(a, b, size);
+
+		memcpy(b, src, size * sizeof*b);
+		t0 = now(); par_gaussian_iir(b, w, h, sigma); t_iir += now() - t0;
+		d_iir = max_abs_diff(a, b, size);
+
+		t0 = now(); centered_gradient_reference(a, ax, ay, w, h); t_gref += now() - t0;
+		t0 = now(); par_centered_gradient(a, bx, by, w, h); t_grad += now() - t0;
+		d_grad = fmaxf(max_abs_diff(ax, bx, size), max_abs_diff(ay, by, size));
+
+		memcpy(b, src, size * sizeof*b);
+		t0 = now(); par_gaussian_centered_gradient(b, bx, by, w, h, sigma); t_fused += now() - t0;
+		d_fused = fmaxf(max_abs_diff(ax, bx, size), max_abs_diff(ay, by, size));
+	}
+
+	printf("%-34s %10s %10s %12s\n", "kernel", "ms", "speedup", "max |diff|");
+	printf("%-34s %10.3f %10s %12s\n", "gaussian (serial reference)", 1e3 * t_ref / reps, "1.00", "-");
+	printf("%-34s %10.3f %10.2f %12g\n", "par_gaussian_direct", 1e3 * t_dir / reps, t_ref / t_dir, d_dir);
+	printf("%-34s %10.3f %10.2f %12g\n", "par_gaussian_iir", 1e3 * t_iir / reps, t_ref / t_iir, d_iir);
+	printf("%-34s %10.3f %10s %12s\n", "centered_gradient (serial ref.)", 1e3 * t_gref / reps, "1.00", "-");
+	printf("%-34s %10.3f %10.2f %12g\n", "par_centered_gradient", 1e3 * t_grad / reps, t_gref / t_grad, d_grad);
+	printf("%-34s %10.3f %10.2f %12g\n", "par_gaussian_centered_gradient", 1e3 * t_fused / reps,
+			(t_ref + t_gref) / t_fused, d_fused);
+
+	// Colour conversion of an RGB image with every 8-bit colour (4096x4096)
+	const int nc = 1 << 24;
+	float *rgb = xmalloc(3 * nc * sizeof*rgb);
+	float *c_ref = xmalloc(3 * nc * sizeof*c_ref);
+	float *c_new = xmalloc(3 * nc * sizeof*c_new);
+	for (int i = 0; i < nc; i++) {
+		rgb[i] = i & 255;
+		rgb[nc + i] = (i >> 8) & 255;
+		rgb[2 * nc + i] = i >> 16;
+	}
+	double t_gray_ref, t_gray, t_lab_ref, t_lab;
+	t0 = now(); rgb_to_gray_reference(rgb, 4096, 4096, c_ref); t_gray_ref = now() - t0;
+	t0 = now(); par_rgb_to_gray(rgb, 4096, 4096, c_new); t_gray = now() - t0;
+	const float d_gray = max_abs_diff(c_ref, c_new, nc);
+	t0 = now(); rgb_to_lab_reference(rgb, nc, c_ref); t_lab_ref = now() - t0;
+	t0 = now(); par_rgb_to_lab(rgb, nc, c_new); t_lab = now() - t0;
+	const float d_lab = max_abs_diff(c_ref, c_new, 3 * nc);
+
+	printf("%-34s %10.3f %10s %12s\n", "rgb_to_gray (serial ref., 2^24 px)", 1e3 * t_gray_ref, "1.00", "-");
+	printf("%-34s %10.3f %10.2f %12g\n", "par_rgb_to_gray", 1e3 * t_gray, t_gray_ref / t_gray, d_gray);
+	printf("%-34s %10.3f %10s %12s\n", "rgb_to_lab (serial ref., 2^24 px)", 1e3 * t_lab_ref, "1.00", "-");
+	printf("%-34s %10.3f %10.2f %12g\n", "par_rgb_to_lab", 1e3 * t_lab, t_lab_ref / t_lab, d_lab);
+
+	free(rgb); free(c_ref); free(c_new);
+	free(src); free(a); free(b);
+	free(ax); free(ay); free(bx); free(by);
+	return 0;
+}
@@ -28,6 +28,12 @@
 #include "energy_model.h"
 #include "utils_preprocess.h"
 #include "aux_partitions.h"
+#include "numa_utils.h"
+#include "preprocess_cache.h"
+#include "faldoi_pipeline.h"
+#include "match_file.h"
+#include "flow_io.h"
+#include "result_writer.h"
 
 extern "C" {
 #include "iio.h"
@@ -702,9 +708,10 @@ void bilateral_filter(OpticalFlowData *ofD, BilateralFilterData *BiFilt, const P
  * @param ener_N        auxiliar variable to store the new computed energy (and compare against old one in ene_val)
  * @param w             width of the optical flow data being processed (to img_width or partition_width if parallelizing)
  * @param h             height of the optical flow data being processed (to img_height or partition_height if parallelizing)
+ * @param pending       if not null, candidates are appended here instead of being pushed (to be pushed later in a fixed order)
  */
 void insert_candidates(pq_cand &queue, float *ene_val, OpticalFlowData *ofD, const int i, const int j,
-                       const float ener_N, const int w, const int h)
+                       const float ener_N, const int w, const int h, std::vector<SparseOF> *pending = nullptr)
 {
     int n_neigh = 4;
     int neighborhood[8][2] = {
@@ -739,7 +746,10 @@ void insert_candidates(pq_cand &queue, float *ene_val, OpticalFlowData *ofD, con
                 if(ofD->params.val_method >= 8) {
                     element.occluded = ofD->chi[py * w + px];
                 }
-                queue.push(element);
+                if (pending)
+                    pending->push_back(element);
+                else
+                    queue.push(element);
             }
         }
     }
@@ -885,10 +895,12 @@ int check_trustable_patch(
  * @param BiFilt        struct that contains the indices and weights of the bilateral filter
  * @param w             width of the optical flow data being processed (to img_width or partition_width if parallelizing)
  * @param h             height of the optical flow data being processed (to img_height or partition_height if parallelizing)
+ * @param pending       if not null, the new candidates are appended here instead of being pushed to 'queue'
  */
 static void add_neighbors(const float *i0, const float *i1, const float *i_1, float *ene_val, OpticalFlowData *ofD,
                           SpecificOFStuff *ofS, pq_cand *queue, const int i, const int j, const int iteration,
-                          float *out, float *out_occ, BilateralFilterData *BiFilt, const int w, const int h)
+                          float *out, float *out_occ, BilateralFilterData *BiFilt, const int w, const int h,
+                          std::vector<SparseOF> *pending = nullptr)
 {
     const int wr = ofD->params.w_radio;
     float ener_N;
@@ -921,7 +933,7 @@ static void add_neighbors(const float *i0, const float *i1, const float *i_1, fl
     // Optical flow method on patch (2*wr x 2wr + 1)
     of_estimation(ofS, ofD, &ener_N, i0, i1, i_1, index, w, h);
     // Insert new candidates to the queue
-    insert_candidates(*queue, ene_val, ofD, i, j, ener_N, w, h);
+    insert_candidates(*queue, ene_val, ofD, i, j, ener_N, w, h, pending);
 
     // It is a strange step, if the energy over the patch is lower thant the
     // stored energy, we put the new one, if it's not, we leave the old one.
@@ -937,14 +949,60 @@ static void add_neighbors(const float *i0, const float *i1, const float *i_1, fl
 }
 
 
+/**
+ * @brief               groups the seeds into waves that can be evaluated concurrently
+ * @details             two seeds depend on each other if the areas they read or write (patch of radius 'wr' plus
+ *                      SEED_FOOTPRINT_MARGIN) overlap; a seed goes one wave after the last earlier seed it depends
+ *                      on, so running the waves in order (and each wave in any order) gives the serial result
+ *
+ * @param seeds         initial seeds, in raster order
+ * @param wr            radius of the patch used to evaluate a seed
+ * @param w             width of the optical flow data being processed
+ * @param h             height of the optical flow data being processed
+ * @return              indices of the seeds of every wave, each in raster order
+ */
+static std::vector<std::vector<int>> seed_waves(const SeedList &seeds, const int wr, const int w, const int h)
+{
+    const int reach = wr + SEED_FOOTPRINT_MARGIN;
+    const int dist = 2 * reach;          // closer seeds (in both directions) depend on each other
+    const int cell = dist + 1;
+    const int cw = w / cell + 1;
+    const int ch = h / cell + 1;
+
+    // Seeds already placed, bucketed in cells of the dependency distance
+    std::vector<std::vector<int>> grid(cw * ch);
+    std::vector<int> wave(seeds.size(), 0);
+    std::vector<std::vector<int>> waves;
+    for (int s = 0; s < (int) seeds.size(); s++) {
+        const int ci = seeds[s].i / cell;
+        const int cj = seeds[s].j / cell;
+        int wv = 0;
+        for (int nj = std::max(cj - 1, 0); nj <= std::min(cj + 1, ch - 1); nj++)
+            for (int ni = std::max(ci - 1, 0); ni <= std::min(ci + 1, cw - 1); ni++)
+                for (int t : grid[nj * cw + ni])
+                    if (std::abs(seeds[t].i - seeds[s].i) <= dist && std::abs(seeds[t].j - seeds[s].j) <= dist)
+                        wv = std::max(wv, wave[t] + 1);
+        wave[s] = wv;
+        grid[cj * cw + ci].push_back(s);
+        if (wv >= (int) waves.size())
+            waves.resize(wv + 1);
+        waves[wv].push_back(s);
+    }
+    return waves;
+}
+
+
 /**
  * @brief               inserts the initial seeds to the priority queue by using initial flow derived from the sparse matches (SIFT or deepmatching)
- * @details             initialises to default values: flow to NAN, energy to INF and occlusions to 0 (if it applies)
+ * @details             initialises to default values: flow to NAN, energy to INF and occlusions to 0 (if it applies).
+ *                      Independent seeds are evaluated concurrently (see 'seed_waves'), each thread with its own copy of
+ *                      the functional's stuff; candidates are pushed afterwards in seed order, so the queue (and thus
+ *                      the result) is the same for any number of threads
  *
  * @param i0            source frame at time 't'
  * @param i1            second frame at time 't+1'
  * @param i_1           previous frame at time 't-1' (used for occlusions only)
- * @param in_flow       array that contains the initial flow obtained from the sparse matches
+ * @param seeds         initial seeds obtained from the sparse matches (pixel and flow, in raster order)
  * @param queue         priority queue where the initial candidates will be inserted
  * @param ofD           OpticalFlowData struct with default values
  * @param ofS           SpecificOFStuff struct with default values
@@ -955,7 +1013,7 @@ static void add_neighbors(const float *i0, const float *i1, const float *i_1, fl
  * @param w             width of the optical flow data being processed
  * @param h             height of the optical flow data being processed
  */
-void insert_initial_seeds(const float *i0, const float *i1, const float *i_1, float *in_flow, pq_cand *queue,
+void insert_initial_seeds(const float *i0, const float *i1, const float *i_1, const SeedList &seeds, pq_cand *queue,
                           OpticalFlowData *ofD, SpecificOFStuff *ofS, float *ene_val, float *out_flow, float *out_occ,
                           BilateralFilterData *BiFilt, const int w, const int h)
 {
@@ -972,37 +1030,47 @@ void insert_initial_seeds(const float *i0, const float *i1, const float *i_1, fl
 
 
     ofD->params.w_radio = 1;
+    const std::vector<std::vector<int>> waves = seed_waves(seeds, ofD->params.w_radio, w, h);
+    std::vector<std::vector<SparseOF>> pending(seeds.size());
     //Fixed the initial seeds.
-    for (int j = 0; j < h; j++)
-        for (int i = 0; i < w; i++)
+    for (const auto &wave : waves)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int n = 0; n < (int) wave.size(); n++)
         {
+            const int s = wave[n];
+            const int i = seeds[s].i;
+            const int j = seeds[s].j;
+            // Buffers are shared (the seeds of a wave touch disjoint pixels), scalars such as the weights' indices are not
+            SpecificOFStuff stuff = *ofS;
             //Indicates the initial seed in the similarity map
-            if (std::isfinite(in_flow[j*w +i]) && std::isfinite(in_flow[w*h + j*w +i]))
-            {
-                out_flow[j*w + i] = in_flow[j*w + i];
-                out_flow[w*h + j*w + i] = in_flow[w*h + j*w +i];
-                ofD->fixed_points[j*w + i] = 1;
-                // add_neigbors 0 means that during the propagation interpolates the patch
-                // based on the energy.
-                add_neighbors(i0, i1, i_1, ene_val, ofD, ofS, queue, i, j, 0, out_flow, out_occ, BiFilt, w, h);
-                out_flow[j*w + i] = NAN;
-                out_flow[w*h + j*w + i] = NAN;
-                ofD->fixed_points[j*w + i] = 0;
-            }
+            out_flow[j*w + i] = seeds[s].u;
+            out_flow[w*h + j*w + i] = seeds[s].v;
+            ofD->fixed_points[j*w + i] = 1;
+            // add_neigbors 0 means that during the propagation interpolates the patch
+            // based on the energy.
+            add_neighbors(i0, i1, i_1, ene_val, ofD, &stuff, queue, i, j, 0, out_flow, out_occ, BiFilt, w, h,
+                          &pending[s]);
+            out_flow[j*w + i] = NAN;
+            out_flow[w*h + j*w + i] = NAN;
+            ofD->fixed_points[j*w + i] = 0;
         }
+    }
+    for (const auto &candidates : pending)
+        for (const auto &element : candidates)
+            queue->push(element);
     ofD->params.w_radio = wr;
     //Propagate the information of the initial seeds to their neighbours.
-    for (int j = 0; j < h; j++)
-        for (int i = 0; i < w; i++)
-        {
-            if (std::isfinite(in_flow[j*w +i]) && std::isfinite(in_flow[w*h + j*w +i]))
-            {
-                out_flow[j*w + i] = in_flow[j*w + i];
-                out_flow[w*h + j*w + i] = in_flow[w*h + j*w +i];
-                ofD->fixed_points[j*w + i] = 1;
-                ene_val[j*w + i] = 0.0;
-            }
-        }
+    for (const auto &s : seeds)
+    {
+        const int k = s.j*w + s.i;
+        out_flow[k] = s.u;
+        out_flow[w*h + k] = s.v;
+        ofD->fixed_points[k] = 1;
+        ene_val[k] = 0.0;
+    }
 }
 
 
@@ -1080,6 +1148,29 @@ void prepare_data_for_growing(OpticalFlowData *ofD, float *ene_val, float *out,
 }
 
 
+/**
+ * @brief           queues a snapshot of the forward growing (flow and, if estimated, occlusions) for the result writer
+ * @details         the data is copied, so the growing goes on while the files are written in the background
+ *
+ * @param ofD       OpticalFlowData struct (parameters of the run)
+ * @param percent   percentage of fixed pixels, part of the file name
+ * @param iteration current iteration of the local minimization
+ * @param part_idx  partition index (only in the file name when the image is split)
+ * @param out_flow  optical flow fields grown so far
+ * @param out_occ   occlusion map grown so far
+ * @param w         width of the data (image or partition)
+ * @param h         height of the data (image or partition)
+ */
+static void save_partial_result(const OpticalFlowData *ofD, const string &percent, int iteration, int part_idx,
+                                const float *out_flow, const float *out_occ, int w, int h) {
+    string name = "../Results/Partial_results/partial_results_fwd_" + percent + "_iter_" + std::to_string(iteration);
+    if (ofD->params.split_img)
+        name += "_part_idx" + to_string(part_idx);
+    result_writer().save(name + ".flo", out_flow, w, h, 2);
+    if (ofD->params.val_method >= 8)
+        result_writer().save_mask(name + "_occ.png", out_occ, w, h);
+}
+
 /**
  * @brief               function that manages a specific iteration of the local minimization, processing all the queue's candidates
  *
@@ -1146,106 +1237,22 @@ void local_growing(const float *i0, const float *i1, const float *i_1, pq_cand *
 
             add_neighbors(i0, i1, i_1, ene_val, ofD, ofS, queue, i, j, iteration, out_flow, out_occ, BiFilt, w, h);
 
-            // From here to the end of the function:
-            // Code used to print partial growing results for debugging or further exploration
-            // Just set add the flag '-partial_res 1' when you call any of the Python scripts (or the binary)
+            // Snapshots of the growing for debugging or further exploration: just add the flag
+            // '-partial_res 1' when you call any of the Python scripts (or the binary)
             float percent = 100 * fixed * 1.0 / size * 1.0;
-
-            if (ofD->params.part_res == 1) {
+            if (ofD->params.part_res == 1 && fwd_or_bwd) {
                 for (int k = 0; k < 4; k++) {
                     if (percent > percent_print[k] && percent < percent_print[k + 1]) {
-                        string filename_flow = " ";
-                        string filename_occ = " ";
-                        if (fwd_or_bwd) {
-                            if (ofD->params.split_img) {
-                                filename_flow =
-                                        "../Results/Partial_results/partial_results_fwd_" +
-                                        std::to_string(percent_print[k]) +
-                                        "_iter_" + std::to_string(iteration) + "_part_idx" + to_string(part_idx) + ".flo";
-                                iio_save_image_float_split(filename_flow.c_str(), out_flow, w, h, 2);
-
-                                if (ofD->params.val_method >= 8) {
-                                    filename_occ =
-                                            "../Results/Partial_results/partial_results_fwd_" +
-                                            std::to_string(percent_print[k]) +
-                                            "_iter_" + std::to_string(iteration) + "_part_idx" + to_string(part_idx) +
-                                            "_occ.png";
-                                    auto *out_occ_int = new int[w * h];
-                                    for (int l = 0; l < w * h; l++) {
-                                        out_occ_int[l] = out_occ[l];
-                                    }
-                                    iio_save_image_int(filename_occ.c_str(), out_occ_int, w, h);
-                                }
-
-                            } else {
-                                filename_flow =
-                                        "../Results/Partial_results/partial_results_fwd_" +
-                                        std::to_string(percent_print[k]) +
-                                        "_iter_" + std::to_string(iteration) + ".flo";
-                                iio_save_image_float_split(filename_flow.c_str(), out_flow, w, h, 2);
-
-                                if (ofD->params.val_method >= 8) {
-                                    filename_occ =
-                                            "../Results/Partial_results/partial_results_fwd_" +
-                                            std::to_string(percent_print[k]) +
-                                            "_iter_" + std::to_string(iteration) + "_occ.png";
-                                    auto *out_occ_int = new int[w * h];
-                                    for (int l = 0; l < w * h; l++) {
-                                        out_occ_int[l] = out_occ[l];
-                                    }
-                                    iio_save_image_int(filename_occ.c_str(), out_occ_int, w, h);
-                                }
-
-                            }
-
-                            percent_print[k] = 200;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    if (ofD->params.part_res == 1) {
-        if (fwd_or_bwd) {
-            string filename_flow = " ";
-            string filename_occ = " ";
-            if (ofD->params.split_img) {
-
-                filename_flow =
-                        "../Results/Partial_results/partial_results_fwd_100_iter_" + std::to_string(iteration)
-                        + "_part_idx" + to_string(part_idx) + ".flo";
-                iio_save_image_float_split(filename_flow.c_str(), out_flow, w, h, 2);
-
-                if (ofD->params.val_method >= 8) {
-                filename_occ =
-                        "../Results/Partial_results/partial_results_fwd_100_iter_" +
-                        std::to_string(iteration) + "_part_idx" + to_string(part_idx) + "_occ.png";
-                auto *out_occ_int = new int[w * h];
-                for (int i = 0; i < w * h; i++) {
-                    out_occ_int[i] = out_occ[i];
-                }
-                iio_save_image_int(filename_occ.c_str(), out_occ_int, w, h);
-            }
-            } else {
-                filename_flow =
-                        "../Results/Partial_results/partial_results_fwd_100_iter_" + std::to_string(iteration) + ".flo";
-                iio_save_image_float_split(filename_flow.c_str(), out_flow, w, h, 2);
-
-                if (ofD->params.val_method >= 8) {
-                    filename_occ =
-                            "../Results/Partial_results/partial_results_fwd_100_iter_" + std::to_string(iteration) +
-                            "_occ.png";
-                    auto *out_occ_int = new int[w * h];
-                    for (int i = 0; i < w * h; i++) {
-                        out_occ_int[i] = out_occ[i];
+                        save_partial_result(ofD, std::to_string(percent_print[k]), iteration, part_idx, out_flow,
+                                            out_occ, w, h);
+                        percent_print[k] = 200;
                     }
-                    iio_save_image_int(filename_occ.c_str(), out_occ_int, w, h);
                 }
             }
         }
     }
-
-
+    if (ofD->params.part_res == 1 && fwd_or_bwd)
+        save_partial_result(ofD, "100", iteration, part_idx, out_flow, out_occ, w, h);
 }
 
 
@@ -1253,8 +1260,8 @@ void local_growing(const float *i0, const float *i1, const float *i_1, pq_cand *
  * @brief               manages the whole local minimization, calling 'local_growing' for each iteration and updating all variables
  * @details             every iteration involves: growing, pruning, deleting non valid candidates and updating queues
  *
- * @param go            initial forward flow field obtained from the sparse matches
- * @param ba            initial backward flow field obtained from the sparse matches
+ * @param go            initial forward seeds obtained from the sparse matches
+ * @param ba            initial backward seeds obtained from the sparse matches
  * @param i0n           normalised (gray and smooth) source frame
  * @param i1n           normalised (gray and smooth) second frame
  * @param i_1n          normalised (gray and smooth) previous frame
@@ -1267,8 +1274,8 @@ void local_growing(const float *i0, const float *i1, const float *i_1, pq_cand *
  * @param out_occ       array that stores the occlusion map in the local minimization (may be updated if it applies)
  */
 void match_growing_variational(
-        float *go,
-        float *ba,
+        const SeedList &go,
+        const SeedList &ba,
         float *i0,
         float *i1,
         float *i_1,
@@ -1333,16 +1340,9 @@ void match_growing_variational(
     printf("Inserting initial seeds\n");
 
     auto clk_seeds = system_clock::now(); // PROFILING
-#ifdef _OPENMP
-#pragma omp parallel for
-    for (int i = 0; i < 2; i++) {
-        if (i == 0) {
-            insert_initial_seeds(i0n, i1n, i_1n, go, &queue_Go, &ofGo, &stuffGo, ene_Go, oft0, occ_Go, BiFilt_Go, w, h);
-        } else {
-            insert_initial_seeds(i1n, i0n, i2n, ba, &queue_Ba, &ofBa, &stuffBa, ene_Ba, oft1, occ_Ba, BiFilt_Ba, w, h);
-        }
-    }
-#endif
+    // Each direction spreads its seeds over all the threads
+    insert_initial_seeds(i0n, i1n, i_1n, go, &queue_Go, &ofGo, &stuffGo, ene_Go, oft0, occ_Go, BiFilt_Go, w, h);
+    insert_initial_seeds(i1n, i0n, i2n, ba, &queue_Ba, &ofBa, &stuffBa, ene_Ba, oft1, occ_Ba, BiFilt_Ba, w, h);
     printf("Finished inserting initial seeds\n");
 
 
@@ -1360,7 +1360,7 @@ void match_growing_variational(
     std::vector<PartitionData*> p_data;
     std::vector<PartitionData*> p_data_r;
 
-    if (params.split_img == 1) {
+    if (params.split_img >= 1) {
         auto clk_init_part = system_clock::now(); // PROFILING
         // Initialise partitions
         // Note: to avoid reinforcing discontinuities that may be caused by the partitions, we
@@ -1387,7 +1387,7 @@ void match_growing_variational(
 
         // Estimate local minimization (forward: I0 ==> I1 and backward: I0 <== I1)
         // First iteration works on the whole image
-        if (params.split_img == 0 || (params.split_img == 1 && i == 0)) {
+        if (params.split_img == 0 || (params.split_img >= 1 && i == 0)) {
 #ifdef _OPENMP
 #pragma omp parallel for
             for (int k = 0; k < 2; k++) {
@@ -1457,7 +1457,7 @@ void match_growing_variational(
             cout << "(match growing) Local iteration " << i << " => all iteration's tasks took "
                  << elapsed_secs_all_tasks.count() << endl;
 
-        } else if ((i > 0 && i <= iter - 1) && params.split_img == 1) {
+        } else if ((i > 0 && i <= iter - 1) && params.split_img >= 1) {
             // Common stuff to any iteration from 2nd to last
             const int n_partitions = params.h_parts * params.v_parts;
 
@@ -1474,9 +1474,7 @@ void match_growing_variational(
 
                 // If at least one seed falls into each partition queue, we can parallelise the code
                 if (!anyEmptyQueues(&p_data, n_partitions)) {
-#ifdef _OPENMP
-#pragma omp parallel for
-                    for (unsigned n = 0; n < n_partitions * 2; n++) {
+                    auto grow_partition = [&](const unsigned n) {
                         // 1. Local growing based on updated OF variables ofGo and ofBa (fwd/bwd)
                         if (n % 2 == 0) {
                             // FWD
@@ -1511,6 +1509,16 @@ void match_growing_variational(
                                  << " => BWD growing took "
                                  << elapsed_secs_bwd_grow.count() << endl;
                         }
+                    };
+#ifdef _OPENMP
+                    if (params.split_img == 2) {
+#pragma omp parallel
+                        for (int n : numa_socket_tasks(n_partitions, 2))
+                            grow_partition(n);
+                    } else {
+#pragma omp parallel for
+                        for (unsigned n = 0; n < n_partitions * 2; n++)
+                            grow_partition(n);
                     }
 #endif
                 } else {
@@ -1611,9 +1619,7 @@ void match_growing_variational(
 
                 // If at least one seed falls into each partition queue, we can parallelise the code
                 if (!anyEmptyQueues(&p_data_r, n_partitions)) {
-#ifdef _OPENMP
-#pragma omp parallel for
-                    for (unsigned n = 0; n < n_partitions * 2; n++) {
+                    auto grow_partition = [&](const unsigned n) {
                         if (n % 2 == 0) {
                             // 1. Local growing based on updated OF variables, ofGo, ofBa (previous iteration)
                             // FWD
@@ -1649,6 +1655,16 @@ void match_growing_variational(
                                  << " => BWD growing took "
                                  << elapsed_secs_bwd_grow.count() << endl;
                         }
+                    };
+#ifdef _OPENMP
+                    if (params.split_img == 2) {
+#pragma omp parallel
+                        for (int n : numa_socket_tasks(n_partitions, 2))
+                            grow_partition(n);
+                    } else {
+#pragma omp parallel for
+                        for (unsigned n = 0; n < n_partitions * 2; n++)
+                            grow_partition(n);
                     }
 #endif
                 } else {
@@ -1741,7 +1757,7 @@ void match_growing_variational(
 
     printf("Last growing (FWD only)\n");
 
-    if (params.split_img == 1) {
+    if (params.split_img >= 1) {
         const int n_partitions = params.h_parts * params.v_parts;
 
         auto clk_update_last_start = system_clock::now(); // PROFILING
@@ -1757,9 +1773,7 @@ void match_growing_variational(
         auto last_growing = system_clock::now();
 
         if (!anyEmptyQueues(&p_data, n_partitions)) {
-#ifdef _OPENMP
-#pragma omp parallel for
-            for (unsigned m = 0; m < n_partitions; m++) {
+            auto grow_partition = [&](const unsigned m) {
                 std::cout << "Last local growing partition (h x v) => " << m << std::endl;
                 auto clk_start_fwd = system_clock::now();
                 // FWD only (n_partitions function calls in parallel)
@@ -1772,6 +1786,16 @@ void match_growing_variational(
                 duration<double> elapsed_secs_fwd_grow = clk_fwd_grow - clk_start_fwd; // PROFILING
                 cout << "(match growing) Last local iteration " << iter << ", partition " << m
                      << " => FWD growing took " << elapsed_secs_fwd_grow.count() << endl;
+            };
+#ifdef _OPENMP
+            if (params.split_img == 2) {
+#pragma omp parallel
+                for (int m : numa_socket_tasks(n_partitions, 1))
+                    grow_partition(m);
+            } else {
+#pragma omp parallel for
+                for (unsigned m = 0; m < n_partitions; m++)
+                    grow_partition(m);
             }
 #endif
         } else {
@@ -1812,6 +1836,8 @@ void match_growing_variational(
 
     free_auxiliar_stuff(&stuffGo, &ofGo);
     free_auxiliar_stuff(&stuffBa, &ofBa);
+    free_weights_bilateral(BiFilt_Go, w, h);
+    free_weights_bilateral(BiFilt_Ba, w, h);
 
     delete[] i1n;
     delete[] i2n;
@@ -1820,6 +1846,12 @@ void match_growing_variational(
 
     delete[] ofGo.u1;
     delete[] ofBa.u1;
+    delete[] ofGo.u1_ba;
+    delete[] ofBa.u1_ba;
+    delete[] ofGo.u1_filter;
+    delete[] ofBa.u1_filter;
+    delete[] ofGo.chi;
+    delete[] ofBa.chi;
 
     delete[] ofGo.fixed_points;
     delete[] ofBa.fixed_points;
@@ -1832,6 +1864,9 @@ void match_growing_variational(
 
     delete[] ene_Go;
     delete[] ene_Ba;
+
+    delete[] occ_Go;
+    delete[] occ_Ba;
 }
 
 
@@ -1839,6 +1874,64 @@ void match_growing_variational(
 ///////////////////////////////MAIN/////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
+// Built without main() into faldoi_pipeline
+#ifndef FALDOI_NO_MAIN
+/**
+ * @brief           reads the seeds of a sparse flow (.flo) or of a binary match file, the latter without any w*h raster
+ *
+ * @param filename  sparse flow or binary match file (see match_file.h)
+ * @param w, h      size of the frames
+ * @param seeds     output seeds, in raster order
+ * @return          false if the file cannot be read or its size does not match the frames
+ */
+static bool read_seeds(const string &filename, int w, int h, SeedList &seeds) {
+    if (is_match_file(filename)) {
+        MatchFile file;
+        if (!file.open(filename, MATCH_LAYOUT_CUT))
+            return false;
+        seeds_from_records(file.data(), file.size(), -INFINITY, w, h, seeds);
+        return true;
+    }
+
+    // Sparse flows are only scanned, from the mapping itself when the format allows it
+    MappedImage mapped;
+    if (mapped.open(filename)) {
+        const bool valid = mapped.width() == w && mapped.height() == h && mapped.channels() == 2;
+        if (valid)
+            seeds_from_flow(mapped.plane(0), mapped.plane(1), w, h, seeds);
+        return valid;
+    }
+
+    // Quantized flows (KITTI .png) and the formats of iio are decoded
+    int fw, fh;
+    float *flow = read_flow(filename, &fw, &fh);
+    if (!flow)
+        return false;
+    const bool valid = fw == w && fh == h;
+    if (valid)
+        seeds_from_flow(flow, flow + w * h, w, h, seeds);
+    free(flow);
+    return valid;
+}
+
+/**
+ * @brief           reads a saliency map: float TIFF and .pfl maps are mapped, colour images are averaged by iio
+ *
+ * @param filename  saliency map
+ * @param w         output width
+ * @param h         output height
+ * @return          malloc'd map (one channel), NULL on error
+ */
+static float *read_saliency(const char *filename, int *w, int *h) {
+    int pd;
+    float *sal = read_image_planar(filename, w, h, &pd);
+    if (sal && pd != 1) {
+        free(sal);
+        sal = iio_read_image_float(filename, w, h);
+    }
+    return sal;
+}
+
 /**
  * @brief           main function that reads the command arguments, calls 'match_growing_variational' and frees memory
  *
@@ -1873,6 +1966,8 @@ int main(int argc, char *argv[]) {
 	auto fb_threshold = pick_option(args, "fb_thresh", to_string(FB_TOL));		// Threshold for the FB pruning (if tol > thr, discard)
 	auto partial_results = pick_option(args, "partial_res",
 								       to_string(SAVE_RESULTS));				// Whether to store intermediate flows in "../Results/Partial_results"
+    auto affinity = pick_option(args, "affinity", to_string(PAR_DEFAULT_AFFINITY));  // Thread pinning (none, close, spread)
+    auto cache_dir = pick_option(args, "cache_dir", "");                        // Preprocessing cache (off if empty)
 
     if (args.size() < 6 || args.size() > 9) {
         // Without occlusions
@@ -1881,12 +1976,14 @@ int main(int argc, char *argv[]) {
                         " [-m method_id] [-wr windows_radio] [-p file of parameters]"
                         " [-loc_it local_iters] [-max_pch_it max_iters_patch]"
                         " [-split_img split_image] [-h_parts horiz_parts]"
-                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val]\n", args.size(), args[0].c_str());
+                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val] [-affinity none|close|spread]"
+                        " [-cache_dir dir]\n", args.size(), args[0].c_str());
         fprintf(stderr, "usage %lu :\n\t%s ims.txt in0.flo in1.flo out.flo sim_map.tiff sal0.tiff sal1.tiff"
                         " [-m method_id] [-wr windows_radio] [-p file of parameters]"
                         " [-loc_it local_iters] [-max_pch_it max_iters_patch]"
                         " [-split_img split_image] [-h_parts horiz_parts]"
-                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val]\n", args.size(), args[0].c_str());
+                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val] [-affinity none|close|spread]"
+                        " [-cache_dir dir]\n", args.size(), args[0].c_str());
         fprintf(stderr, "\n");
         // With occlusions
         fprintf(stderr, "With occlusions (nº of params: 7 or 9 + 1 (own function name)):\n");
@@ -1894,13 +1991,15 @@ int main(int argc, char *argv[]) {
                         " [-m method_id] [-wr windows_radio] [-p file of parameters]"
                         " [-loc_it local_iters] [-max_pch_it max_iters_patch]"
                         " [-split_img split_image] [-h_parts horiz_parts]"
-                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val]\n", args.size(), args[0].c_str());
+                        " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val] [-affinity none|close|spread]"
+                        " [-cache_dir dir]\n", args.size(), args[0].c_str());
         fprintf(stderr,
                 "usage %lu :\n\t%s ims.txt in0.flo in1.flo out.flo sim_map.tiff occlusions.png sal0.tiff sal1.tiff"
                 " [-m method_id] [-wr windows_radio] [-p file of parameters]"
                 " [-loc_it local_iters] [-max_pch_it max_iters_patch]"
                 " [-split_img split_image] [-h_parts horiz_parts]"
-                " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val]\n", args.size(), args[0].c_str());
+                " [-v_parts vert_parts] [-fb_thresh thresh] [-partial_res val] [-affinity none|close|spread]"
+                        " [-cache_dir dir]\n", args.size(), args[0].c_str());
         return 1;
     }
 
@@ -1973,6 +2072,18 @@ int main(int argc, char *argv[]) {
     int loc_it = stoi(local_iters);
     int max_it_pch = stoi(max_iters_patch);
     int sp_img = stoi(split_img);
+    int affinity_mode = parse_affinity(affinity);
+    if (affinity_mode < 0) {
+        fprintf(stderr, "ERROR: unknown affinity '%s' (none, close or spread)\n", affinity.c_str());
+        return 1;
+    }
+    // The per-socket partition mode needs to know where every thread lives
+    if (sp_img == 2 && affinity_mode == AFFINITY_NONE)
+        affinity_mode = AFFINITY_CLOSE;
+    int n_sockets = numa_pin_threads(affinity_mode);
+    if (sp_img == 2)
+        printf("Partitions assigned per socket (%d socket(s) found)\n", n_sockets);
+    preprocess_cache().open(cache_dir);
     int h_prts = stoi(hor_parts);
     int v_prts = stoi(ver_parts);
 	float fb_thresh = stof(fb_threshold);
@@ -2001,9 +2112,6 @@ int main(int argc, char *argv[]) {
     float *i0 = iio_read_image_float_split(filename_i0.c_str(), w + 0, h + 0, pd + 0);
     float *i1 = iio_read_image_float_split(filename_i1.c_str(), w + 1, h + 1, pd + 1);
 
-    // Sparse Optical flow forward and backward
-    float *go = iio_read_image_float_split(filename_go.c_str(), w + 2, h + 2, pd + 2);
-    float *ba = iio_read_image_float_split(filename_ba.c_str(), w + 3, h + 3, pd + 3);
 
     // Ensure dimensions match in images
     if (num_files == 4) {
@@ -2021,16 +2129,20 @@ int main(int argc, char *argv[]) {
             return fprintf(stderr, "ERROR: input images size mismatch\n");
     }
 
-    // Ensure dimensions match in flow
-    if (w[2] != w[3] || h[2] != h[3] || pd[2] != 2 || pd[2] != pd[3])
-        return fprintf(stderr, "ERROR: input flow field size mismatch (global\n");
+    // Seeds forward and backward, from the sparse flows (.flo) or binary match files
+    SeedList go, ba;
+    if (!read_seeds(filename_go, w[0], h[0], go) || !read_seeds(filename_ba, w[0], h[0], ba))
+        return fprintf(stderr, "ERROR: cannot read the seeds or input flow field size mismatch\n");
+    fprintf(stderr, "%zu forward and %zu backward seeds\n", go.size(), ba.size());
 
     // Load or compute saliency
     float *sal0 = nullptr;
     float *sal1 = nullptr;
     if (args.size() == 9 || args.size() == 8) {
-        sal0 = iio_read_image_float(filename_sal0, w + 4, h + 4);
-        sal1 = iio_read_image_float(filename_sal1, w + 5, h + 5);
+        sal0 = read_saliency(filename_sal0, w + 4, h + 4);
+        sal1 = read_saliency(filename_sal1, w + 5, h + 5);
+        if (!sal0 || !sal1)
+            return fprintf(stderr, "ERROR: cannot read the saliency maps\n");
         fprintf(stderr, "Reading given saliency values\n");
 
     } else {
@@ -2142,21 +2254,12 @@ int main(int argc, char *argv[]) {
     cout << "(local_faldoi) Match growing variational took "
          << elapsed_secs2.count() << endl;
 
-    // Save results
-    iio_save_image_float_split(filename_out.c_str(), out_flow, w[0], h[0], 2);
-    iio_save_image_float(filename_sim.c_str(), ene_val, w[0], h[0]);
-
-    // Properly define occlusion mask
-    if (args.size() == 7 || args.size() == 9) {
-        //iio_save_image_float(filename_occ.c_str(), out_occ, w[0], h[0]);
-        auto *out_occ_int = new int[w[0] * h[0]];
-        for (int i = 0; i < w[0] * h[0]; i++) {
-            out_occ_int[i] = out_occ[i];
-        }
-        iio_save_image_int(filename_occ.c_str(), out_occ_int, w[0], h[0]);
-    }
-    // Else, define it as null (to avoid compilation errors)
-    int *out_occ_int = nullptr;
+    // Save results (in the background, while the buffers are released)
+    ResultWriter &writer = result_writer();
+    writer.save(filename_out, out_flow, w[0], h[0], 2);
+    writer.save(filename_sim, ene_val, w[0], h[0], 1);
+    if (args.size() == 7 || args.size() == 9)
+        writer.save_mask(filename_occ, out_occ, w[0], h[0]);
 
     // Cleanup and exit
     free(i_1);
@@ -2164,8 +2267,6 @@ int main(int argc, char *argv[]) {
     free(i1);
     free(i2);
 
-    free(go);
-    free(ba);
 
     if (args.size() == 8 || args.size() == 9) {
         free(sal0);
@@ -2180,13 +2281,18 @@ int main(int argc, char *argv[]) {
 
     if (args.size() == 7 || args.size() == 9) {
         delete[] out_occ;
-        delete[] out_occ_int;
     }
 
+    writer.flush();
+    writer.print_stats("local_faldoi.cpp");
+    preprocess_cache().print_stats("local_faldoi.cpp");
+
     today = system_clock::now();
     tt = system_clock::to_time_t(today);
     cerr << "Finishing date: " << ctime(&tt);
     return 0;
 }
 
+#endif // FALDOI_NO_MAIN
+
 #endif  // LOCAL_FALDOI
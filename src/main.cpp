@@ -1,40 +1,105 @@
 #include <opencv2/opencv.hpp>
-#include "MotionDenoiser.h"
 #include "VideoIO.h"
-#include <time.h>
+#include "VideoPipeline.h"
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 
 using namespace cv;
 using namespace std;
 
+static void usage(const char* name)
+{
+    cerr << "Usage: " << name << " input.yuv output.yuv [options]" << endl
+         << "  -size WxH          frame size (default 1280x720)" << endl
+         << "  -fps F             frame rate (default 30)" << endl
+         << "  -format F          i420, nv12 or p010 (default i420)" << endl
+         << "  -space S           bgr, or yuv to denoise the YUV planes without colour conversion (default bgr)" << endl
+         << "  -mode M            window (average of 2N+1 aligned frames) or recursive (blend with the" << endl
+         << "                     previous output, one warp per frame, no delay) (default window)" << endl
+         << "  -motion NAME       flow backend: dis_ultrafast, dis_fast, dis_medium, farneback," << endl
+         << "                     faldoi_local (FALDOI local step) or faldoi (default dis_medium)" << endl
+         << "  -queue N           frames per queue between stages (default 4)" << endl
+         << "  -flow_threads N    threads estimating the flow (default: cores left by the other stages)" << endl;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " input.yuv output.yuv" << endl;
+    if (argc < 3) {
+        usage(argv[0]);
         return -1;
     }
 
     string input_yuv = argv[1];
     string output_yuv = argv[2];
-    
-    // Read YUV file
-    double fps;
-    vector<Mat> frames = GetFramesFromYUV(input_yuv, fps);
-    
-    if (frames.empty()) {
-        cerr << "Failed to read input YUV file" << endl;
+    YUVFormat format;
+    FrameLayout layout = FRAME_BGR;
+    DenoiseMode mode = DENOISE_WINDOW;
+    string backend = "dis_medium";
+    int queue_depth = 4;
+    // By default the cores left over by the other three stages estimate the flow
+    int flow_threads = max((int)thread::hardware_concurrency() - 3, 1);
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        const char* value = argv[i + 1];
+        if (!strcmp(argv[i], "-size")) {
+            if (sscanf(value, "%dx%d", &format.width, &format.height) != 2) {
+                cerr << "Bad frame size: " << value << endl;
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-fps")) {
+            format.fps = atof(value);
+        } else if (!strcmp(argv[i], "-format")) {
+            if (!ParseYUVLayout(value, format.layout)) {
+                cerr << "Unknown YUV format: " << value << endl;
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-space")) {
+            if (!strcmp(value, "yuv")) {
+                layout = FRAME_I420;
+            } else if (strcmp(value, "bgr")) {
+                cerr << "Unknown colour space: " << value << endl;
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-mode")) {
+            if (!strcmp(value, "recursive")) {
+                mode = DENOISE_RECURSIVE;
+            } else if (strcmp(value, "window")) {
+                cerr << "Unknown denoising mode: " << value << endl;
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "-motion")) {
+            if (!CreateMotionBackend(value)) {
+                cerr << "Unknown motion backend: " << value << endl;
+                return -1;
+            }
+            backend = value;
+        } else if (!strcmp(argv[i], "-queue")) {
+            queue_depth = atoi(value);
+        } else if (!strcmp(argv[i], "-flow_threads")) {
+            flow_threads = atoi(value);
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (queue_depth < 1 || flow_threads < 1) {
+        cerr << "The queue depth and the number of flow threads must be at least 1" << endl;
         return -1;
     }
     
-    cout << "Loaded " << frames.size() << " frames at " << fps << " fps" << endl;
-    
-    // Create and execute denoiser
-    MotionDenoiser denoiser(frames);
-    vector<Mat> denoised_frames = denoiser.Execute();
-    
-    // Save output in YUV format
-    WriteFramesToYUV(denoised_frames, output_yuv);
+    // Decode, flow, fusion and encode run concurrently; only the queues and the
+    // denoiser's window are in memory
+    VideoPipeline pipeline(queue_depth, flow_threads, layout, mode, backend);
+    if (!pipeline.Run(input_yuv, output_yuv, format)) {
+        return -1;
+    }
+    pipeline.PrintStats();
     
     cout << "Video denoising complete. Output saved to: " << output_yuv << endl;
     
     return 0;
-}
\ No newline at end of file
+}
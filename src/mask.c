@@ -11,14 +11,9 @@
 #include <math.h>
 
 #include "xmalloc.h"
+#include "image_kernels.h"
 
 
-#define BOUNDARY_CONDITION_DIRICHLET 0
-#define BOUNDARY_CONDITION_REFLECTING 1
-#define BOUNDARY_CONDITION_PERIODIC 2
-
-#define DEFAULT_GAUSSIAN_WINDOW_SIZE 5
-#define DEFAULT_BOUNDARY_CONDITION BOUNDARY_CONDITION_REFLECTING
 
 
 /**
@@ -96,37 +91,7 @@ void forward_gradient(
         const int nx,   //image width
         const int ny    //image height
         ){
-    // compute the gradient on the central body of the image
-//#pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < ny-1; i++){
-        for(int j = 0; j < nx-1; j++){
-            const int p  = i * nx + j;
-            const int p1 = p + 1;
-            const int p2 = p + nx;
-
-            fx[p] = f[p1] - f[p];
-            fy[p] = f[p2] - f[p];
-        }
-    }
-
-    // compute the gradient on the last row
-    for (int j = 0; j < nx-1; j++){
-        const int p = (ny-1) * nx + j;
-
-        fx[p] = f[p+1] - f[p];
-        fy[p] = 0;
-    }
-
-    // compute the gradient on the last column
-    for (int i = 1; i < ny; i++){
-        const int p = i * nx-1;
-
-        fx[p] = 0;
-        fy[p] = f[p+nx] - f[p];
-    }
-
-    fx[ny * nx - 1] = 0;
-    fy[ny * nx - 1] = 0;
+    par_forward_gradient(f, fx, fy, nx, ny);
 }
 
 /**
@@ -188,55 +153,7 @@ void centered_gradient(
         const int nx,        //image width
         const int ny         //image height
         ) {
-
-    // compute the gradient on the center body of the image
-//#pragma omp parallel for schedule(dynamic)
-    for (int i = 1; i < ny-1; i++){
-        for(int j = 1; j < nx-1; j++){
-
-            const int k = i * nx + j;
-            dx[k] = 0.5*(input[k + 1] - input[k - 1]);
-            dy[k] = 0.5*(input[k + nx] - input[k - nx]);
-
-        }
-    }
-
-    // compute the gradient on the first and last rows
-    for (int j = 1; j < nx-1; j++){
-
-        dx[j] = 0.5*(input[j + 1] - input[j - 1]);
-        dy[j] = 0.5*(input[j + nx] - input[j]);
-
-        const int k = (ny - 1) * nx + j;
-
-        dx[k] = 0.5*(input[k + 1] - input[k - 1]);
-        dy[k] = 0.5*(input[k] - input[k - nx]);
-    }
-
-    // compute the gradient on the first and last columns
-    for(int i = 1; i < ny-1; i++){
-
-        const int p = i * nx;
-        dx[p] = 0.5*(input[p + 1] - input[p]);
-        dy[p] = 0.5*(input[p + nx] - input[p - nx]);
-
-        const int k = (i + 1) * nx - 1;
-        dx[k] = 0.5*(input[k] - input[k - 1]);
-        dy[k] = 0.5*(input[k + nx] - input[k - nx]);
-    }
-
-    // compute the gradient at the four corners
-    dx[0] = 0.5*(input[1] - input[0]);
-    dy[0] = 0.5*(input[nx] - input[0]);
-
-    dx[nx - 1] = 0.5*(input[nx-1] - input[nx-2]);
-    dy[nx - 1] = 0.5*(input[2*nx-1] - input[nx-1]);
-
-    dx[(ny - 1)*nx] = 0.5*(input[(ny - 1)*nx + 1] - input[(ny - 1)*nx]);
-    dy[(ny - 1)*nx] = 0.5*(input[(ny - 1)*nx] - input[(ny - 2)*nx]);
-
-    dx[ny*nx-1] = 0.5*(input[ny*nx-1] - input[ny*nx-1-1]);
-    dy[ny*nx-1] = 0.5*(input[ny*nx-1] - input[(ny-1)*nx-1]);
+    par_centered_gradient(input, dx, dy, nx, ny);
 }
 
 
@@ -251,109 +168,7 @@ void gaussian(
         const int ydim,       // image height
         const float sigma    // Gaussian sigma
         ){
-    const int boundary_condition = DEFAULT_BOUNDARY_CONDITION;
-    const int window_size = DEFAULT_GAUSSIAN_WINDOW_SIZE;
-
-    const float den  = 2*sigma*sigma;
-    const int   size = (int) (window_size * sigma) + 1 ;
-    const int   bdx  = xdim + size;
-    const int   bdy  = ydim + size;
-
-    if (boundary_condition && size > xdim) {
-        fprintf(stderr, "GaussianSmooth: sigma too large\n");
-        abort();
-    }
-
-    // compute the coefficients of the 1D convolution kernel
-    float B[size];
-    for(int i = 0; i < size; i++)
-        B[i] = 1 / (sigma * sqrt(2.0 * 3.1415926)) * exp(-i * i / den);
-
-    // normalize the 1D convolution kernel
-    float norm = 0;
-    for(int i = 0; i < size; i++)
-        norm += B[i];
-    norm *= 2;
-    norm -= B[0];
-    for(int i = 0; i < size; i++)
-        B[i] /= norm;
-
-    // convolution of each line of the input image
-    float *R = xmalloc((size + xdim + size)*sizeof*R);
-
-    for (int k = 0; k < ydim; k++){
-        int i, j;
-        for (i = size; i < bdx; i++)
-            R[i] = I[k * xdim + i - size];
-
-        switch (boundary_condition){
-        case BOUNDARY_CONDITION_DIRICHLET:
-            for(i = 0, j = bdx; i < size; i++, j++)
-                R[i] = R[j] = 0;
-            break;
-
-        case BOUNDARY_CONDITION_REFLECTING:
-            for(i = 0, j = bdx; i < size; i++, j++) {
-                R[i] = I[k * xdim + size-i];
-                R[j] = I[k * xdim + xdim-i-1];
-            }
-            break;
-
-        case BOUNDARY_CONDITION_PERIODIC:
-            for(i = 0, j = bdx; i < size; i++, j++) {
-                R[i] = I[k * xdim + xdim-size+i];
-                R[j] = I[k * xdim + i];
-            }
-            break;
-        }
-
-        for (i = size; i < bdx; i++){
-            float sum = B[0] * R[i];
-            for (j = 1; j < size; j++ )
-                sum += B[j] * ( R[i-j] + R[i+j] );
-            I[k * xdim + i - size] = sum;
-        }
-    }
-
-    // convolution of each column of the input image
-    float *T = xmalloc((size + ydim + size)*sizeof*T);
-
-    for (int k = 0; k < xdim; k++){
-        int i, j;
-        for (i = size; i < bdy; i++)
-            T[i] = I[(i - size) * xdim + k];
-
-        switch (boundary_condition){
-        case BOUNDARY_CONDITION_DIRICHLET:
-            for (i = 0, j = bdy; i < size; i++, j++)
-                T[i] = T[j] = 0;
-            break;
-
-        case BOUNDARY_CONDITION_REFLECTING:
-            for (i = 0, j = bdy; i < size; i++, j++) {
-                T[i] = I[(size-i) * xdim + k];
-                T[j] = I[(ydim-i-1) * xdim + k];
-            }
-            break;
-
-        case BOUNDARY_CONDITION_PERIODIC:
-            for( i = 0, j = bdx; i < size; i++, j++) {
-                T[i] = I[(ydim-size+i) * xdim + k];
-                T[j] = I[i * xdim + k];
-            }
-            break;
-        }
-
-        for (i = size; i < bdy; i++){
-            float sum = B[0] * T[i];
-            for (j = 1; j < size; j++ )
-                sum += B[j] * (T[i-j] + T[i+j]);
-            I[(i - size) * xdim + k] = sum;
-        }
-    }
-
-    free(R);
-    free(T);
+    par_gaussian(I, xdim, ydim, sigma);
 }
 
 
@@ -388,75 +203,5 @@ void five_point_gradient(
         const int nx,        //image width
         const int ny         //image height
         ){
-
-
-    // compute the gradient on the center body of the image
-//#pragma omp parallel for schedule(dynamic)
-    for (int i = 2; i < ny-2; i++){
-        for(int j = 2; j < nx-2; j++)
-        {
-            const int k = i * nx + j;
-            dx[k] = (1.0/12)*(input[k-2] - 8*input[k-1] + 8*input[k+1] - input[k+2]);
-            dy[k] = (1.0/12)*(input[k-2*nx] - 8*input[k-nx] + 8*input[k+ nx] - input[k+2*nx]);
-        }
-    }
-
-
-    //Centered gradient for the second column an the penultimate column
-    for (int j = 1; j < ny-1; j++){
-        dx[j*nx + 1] = 0.5*(input[j*nx + 2] - input[j*nx -1]);
-        dy[j*nx + 1] = 0.5*(input[j*nx + nx +1] - input[j*nx - nx +1]);
-
-        const int k = j*nx + (ny-2);
-
-        dx[k] = 0.5*(input[k+1] - input[k-1]);
-        dy[k] = 0.5*(input[k + nx] - input[k-nx]);
-    }
-
-    //Centered gradient for the second row an the penultimate row
-    for (int j = 1; j < ny-1; j++){
-        dx[nx + j] = 0.5*(input[nx + j + 1] - input[nx + j -1]);
-        dy[nx + j] = 0.5*(input[2*nx + j] - input[j]);
-
-        const int k = nx*(ny-2);
-
-        dx[k+j] = 0.5*(input[k+j+1] - input[k+j-1]);
-        dy[k+j] = 0.5*(input[k + nx + j] - input[k - nx +j]);
-    }
-
-    // compute the gradient on the first and last rows
-    for (int j = 1; j < nx-1; j++){
-        dx[j] = 0.5*(input[j+1] - input[j-1]);
-        dy[j] = 0.5*(input[j+nx] - input[j]);
-
-        const int k = (ny - 1) * nx + j;
-
-        dx[k] = 0.5*(input[k+1] - input[k-1]);
-        dy[k] = 0.5*(input[k] - input[k-nx]);
-    }
-
-    // compute the gradient on the first and last columns
-    for(int i = 1; i < ny-1; i++){
-        const int p = i * nx;
-        dx[p] = 0.5*(input[p+1] - input[p]);
-        dy[p] = 0.5*(input[p+nx] - input[p-nx]);
-
-        const int k = (i+1) * nx - 1;
-
-        dx[k] = 0.5*(input[k] - input[k-1]);
-        dy[k] = 0.5*(input[k+nx] - input[k-nx]);
-    }
-
-    // compute the gradient at the four corners
-    dx[0] = 0.5*(input[1] - input[0]);
-    dy[0] = 0.5*(input[nx] - input[0]);
-
-    dx[nx-1] = 0.5*(input[nx-1] - input[nx-2]);
-    dy[nx-1] = 0.5*(input[2*nx-1] - input[nx-1]);
-
-    dx[(ny-1)*nx] = 0.5*(input[(ny-1)*nx + 1] - input[(ny-1)*nx]);
-    dy[(ny-1)*nx] = 0.5*(input[(ny-1)*nx] - input[(ny-2)*nx]);
-
-    dx[ny*nx-1] = 0.5*(input[ny*nx-1] - input[ny*nx-1-1]);
-    dy[ny*nx-1] = 0.5*(input[ny*nx-1] - input[(ny-1)*nx-1]);
+    par_five_point_gradient(input, dx, dy, nx, ny);
 }
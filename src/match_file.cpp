@@ -0,0 +1,242 @@
+#include "match_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MATCH_MAGIC[8] = {'F', 'A', 'L', 'D', 'O', 'I', 'M', 'T'};
+
+struct MatchHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_fields;
+    uint64_t n_matches;
+    uint64_t reserved;
+};
+
+int parse_match_layout(const std::string &name) {
+    if (name == "cut")
+        return MATCH_LAYOUT_CUT;
+    if (name == "sift")
+        return MATCH_LAYOUT_SIFT;
+    if (name == "deep")
+        return MATCH_LAYOUT_DEEP;
+    return -1;
+}
+
+bool is_match_file(const std::string &filename) {
+    FILE *fd = fopen(filename.c_str(), "rb");
+    if (!fd)
+        return false;
+    char magic[8];
+    const bool is_bin = fread(magic, 1, sizeof(magic), fd) == sizeof(magic)
+                        && memcmp(magic, MATCH_MAGIC, sizeof(magic)) == 0;
+    fclose(fd);
+    return is_bin;
+}
+
+// Record of one text line in the given layout; false if the line has too few numbers
+static bool parse_match_line(const char *line, const char *end, int layout, MatchRecord &m) {
+    float v[8];
+    int n_v = 0;
+    const char *p = line;
+    while (n_v < 8) {
+        // Stay inside the line (strtof would skip the '\n' and read the next one)
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        if (p >= end)
+            break;
+        char *next;
+        const float val = strtof(p, &next);
+        if (next == p || next > end)
+            break;
+        v[n_v++] = val;
+        p = next;
+    }
+    switch (layout) {
+        case MATCH_LAYOUT_SIFT:
+            // Keypoints of sift_cli have the row first
+            if (n_v < 6)
+                return false;
+            m = {v[1], v[0], v[5], v[4], 0.0f};
+            return true;
+        case MATCH_LAYOUT_DEEP:
+            if (n_v < 5)
+                return false;
+            m = {v[0], v[1], v[2], v[3], v[4]};
+            return true;
+        default:
+            if (n_v < 4)
+                return false;
+            m = {v[0], v[1], v[2], v[3], n_v > 4 ? v[4] : 0.0f};
+            return true;
+    }
+}
+
+MatchFile::~MatchFile() {
+    if (map)
+        munmap(map, map_bytes);
+}
+
+bool MatchFile::open(const std::string &filename, int layout) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    const size_t bytes = st.st_size;
+    if (bytes == 0) {
+        close(fd);
+        records = nullptr;
+        n = 0;
+        return true;
+    }
+    void *m = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+        return false;
+
+    // Binary: the records are used where they are mapped
+    MatchHeader hdr;
+    if (bytes >= sizeof(hdr)) {
+        memcpy(&hdr, m, sizeof(hdr));
+        if (memcmp(hdr.magic, MATCH_MAGIC, sizeof(MATCH_MAGIC)) == 0) {
+            const bool valid = hdr.version == MATCH_FILE_VERSION && hdr.n_fields == 5
+                               && bytes == MATCH_FILE_HEADER + hdr.n_matches * sizeof(MatchRecord);
+            if (!valid) {
+                fprintf(stderr, "ERROR: %s is not a valid match file\n", filename.c_str());
+                munmap(m, bytes);
+                return false;
+            }
+            map = m;
+            map_bytes = bytes;
+            records = reinterpret_cast<const MatchRecord *>(static_cast<const char *>(m) + MATCH_FILE_HEADER);
+            n = hdr.n_matches;
+            return true;
+        }
+    }
+
+    // Text: one match per line, lines that do not parse are skipped
+    const char *text = static_cast<const char *>(m);
+    const char *end = text + bytes;
+    parsed.clear();
+    for (const char *line = text; line < end;) {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        if (!eol)
+            eol = end;
+        // strtof needs a terminated string: the last line (without '\n') is copied
+        MatchRecord r;
+        bool ok;
+        if (eol == end) {
+            std::string last(line, eol);
+            ok = parse_match_line(last.c_str(), last.c_str() + last.size(), layout, r);
+        } else {
+            ok = parse_match_line(line, eol, layout, r);
+        }
+        if (ok)
+            parsed.push_back(r);
+        line = eol + 1;
+    }
+    munmap(m, bytes);
+    records = parsed.data();
+    n = parsed.size();
+    return true;
+}
+
+bool write_match_file(const std::string &filename, const MatchRecord *records, size_t n) {
+    FILE *fd = fopen(filename.c_str(), "wb");
+    if (!fd)
+        return false;
+    char header[MATCH_FILE_HEADER] = {};
+    MatchHeader hdr;
+    memcpy(hdr.magic, MATCH_MAGIC, sizeof(MATCH_MAGIC));
+    hdr.version = MATCH_FILE_VERSION;
+    hdr.n_fields = 5;
+    hdr.n_matches = n;
+    hdr.reserved = 0;
+    memcpy(header, &hdr, sizeof(hdr));
+    bool ok = fwrite(header, 1, sizeof(header), fd) == sizeof(header);
+    ok = ok && (n == 0 || fwrite(records, sizeof(MatchRecord), n, fd) == n);
+    return (fclose(fd) == 0) && ok;
+}
+
+void sparse_flow_from_records(const MatchRecord *records, size_t n, float min_score, int nx, int ny,
+                              float *out) {
+    for (int k = 0; k < nx * ny; k++) {
+        out[k] = NAN;
+        out[nx * ny + k] = NAN;
+    }
+    // The last match of a pixel wins
+    for (size_t m = 0; m < n; m++) {
+        const MatchRecord &r = records[m];
+        if (!(r.score > min_score))
+            continue;
+        const int i = std::floor(r.x0);
+        const int j = std::floor(r.y0);
+        if (i < 0 || i >= nx || j < 0 || j >= ny)
+            continue;
+        out[j * nx + i] = r.x1 - r.x0;
+        out[nx * ny + j * nx + i] = r.y1 - r.y0;
+    }
+}
+
+// Seeds of n matches laid out with `stride` floats per match (x0 y0 x1 y1 first); `score`
+// (same stride) may be null. Ties on a pixel are resolved like the rasterization: last wins
+static void collect_seeds(const float *base, size_t stride, const float *score, size_t n, float min_score,
+                          int nx, int ny, SeedList &seeds) {
+    std::vector<std::pair<int, size_t>> order;  // (pixel, position in the list)
+    order.reserve(n);
+    for (size_t m = 0; m < n; m++) {
+        const float *r = base + m * stride;
+        if (score && !(score[m * stride] > min_score))
+            continue;
+        const int i = std::floor(r[0]);
+        const int j = std::floor(r[1]);
+        if (i < 0 || i >= nx || j < 0 || j >= ny)
+            continue;
+        order.emplace_back(j * nx + i, m);
+    }
+    std::sort(order.begin(), order.end());
+
+    seeds.clear();
+    for (size_t k = 0; k < order.size(); k++) {
+        if (k + 1 < order.size() && order[k + 1].first == order[k].first)
+            continue;
+        const float *r = base + order[k].second * stride;
+        const float u = r[2] - r[0];
+        const float v = r[3] - r[1];
+        if (std::isfinite(u) && std::isfinite(v))
+            seeds.push_back({order[k].first % nx, order[k].first / nx, u, v});
+    }
+}
+
+void seeds_from_records(const MatchRecord *records, size_t n, float min_score, int nx, int ny,
+                        SeedList &seeds) {
+    static_assert(sizeof(MatchRecord) == 5 * sizeof(float), "MatchRecord must be packed");
+    const float *base = reinterpret_cast<const float *>(records);
+    collect_seeds(base, 5, base + 4, n, min_score, nx, ny, seeds);
+}
+
+void seeds_from_match_list(const std::vector<float> &matches, int nx, int ny, SeedList &seeds) {
+    collect_seeds(matches.data(), 4, nullptr, matches.size() / 4, 0.0f, nx, ny, seeds);
+}
+
+void seeds_from_flow(const float *u, const float *v, int nx, int ny, SeedList &seeds) {
+    seeds.clear();
+    for (int j = 0; j < ny; j++)
+        for (int i = 0; i < nx; i++) {
+            const int k = j * nx + i;
+            if (std::isfinite(u[k]) && std::isfinite(v[k]))
+                seeds.push_back({i, j, u[k], v[k]});
+        }
+}
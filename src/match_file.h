@@ -0,0 +1,88 @@
+#ifndef MATCH_FILE_H
+#define MATCH_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Binary match list, the compact alternative to the "x0 y0 x1 y1" text files: one packed
+/// float32 record per match, readable with a single mmap (no parsing, no copy).
+///
+/// File format (.fmt):
+///     bytes  0..7   magic "FALDOIMT"
+///     bytes  8..11  format version (uint32)
+///     bytes 12..15  floats per record (uint32, 5)
+///     bytes 16..23  number of matches (uint64)
+///     bytes 24..31  reserved (0)
+///     byte   32     records x0 y0 x1 y1 score (column and row in I0, column and row in I1)
+
+#define MATCH_FILE_VERSION 1
+#define MATCH_FILE_HEADER  32
+
+struct MatchRecord {
+    float x0, y0, x1, y1;
+    float score;    // confidence (0 if the list has none)
+};
+
+// Column layouts of the text lists, i.e. the reordering the python helpers did
+#define MATCH_LAYOUT_CUT  0     // "x0 y0 x1 y1 [score]" (*_cut.txt)
+#define MATCH_LAYOUT_SIFT 1     // match_cli: "x y sigma theta x y sigma theta" (x is the row)
+#define MATCH_LAYOUT_DEEP 2     // deepmatching / rescoring: "x0 y0 x1 y1 score [index]"
+
+// Layout from its name (cut, sift or deep); -1 if unknown
+int parse_match_layout(const std::string &name);
+
+// True if `filename` starts with the magic of the binary format
+bool is_match_file(const std::string &filename);
+
+// Matches of a binary file (mapped) or of a text list (parsed with the given layout)
+class MatchFile {
+public:
+    MatchFile() = default;
+    MatchFile(const MatchFile &) = delete;
+    MatchFile &operator=(const MatchFile &) = delete;
+    ~MatchFile();
+
+    // False if the file cannot be opened or is not a valid match list
+    bool open(const std::string &filename, int layout);
+
+    const MatchRecord *data() const { return records; }
+    size_t size() const { return n; }
+
+private:
+    void *map = nullptr;
+    size_t map_bytes = 0;
+    std::vector<MatchRecord> parsed;
+    const MatchRecord *records = nullptr;
+    size_t n = 0;
+};
+
+// Writes `n` records in the binary format; false on error
+bool write_match_file(const std::string &filename, const MatchRecord *records, size_t n);
+
+// Initial seed of the local step: pixel (i, j) of the source frame and its flow
+struct SparseSeed {
+    int i, j;
+    float u, v;
+};
+typedef std::vector<SparseSeed> SeedList;
+
+// Seeds of `n` records with a score above min_score, exactly the finite pixels of the sparse
+// flow sparse_flow_from_records would give (the last match of a pixel wins), in raster order.
+// O(n log n), nothing of size nx*ny is touched
+void seeds_from_records(const MatchRecord *records, size_t n, float min_score, int nx, int ny,
+                        SeedList &seeds);
+
+// Same for a list of "x0 y0 x1 y1" matches (faldoi_pipeline's MatchList)
+void seeds_from_match_list(const std::vector<float> &matches, int nx, int ny, SeedList &seeds);
+
+// Seeds of a dense sparse flow (.flo) given by its two planes: its finite pixels, in raster order
+void seeds_from_flow(const float *u, const float *v, int nx, int ny, SeedList &seeds);
+
+// Sparse flow (two planes) of `n` records: NAN everywhere except at (floor(x0), floor(y0)),
+// which gets (x1 - x0, y1 - y0). Only records with a score above min_score are used
+void sparse_flow_from_records(const MatchRecord *records, size_t n, float min_score, int nx, int ny,
+                              float *out);
+
+#endif // MATCH_FILE_H
@@ -23,21 +23,21 @@ void  initialize_stuff_nltvl1(
     //const int h = ofCore->params.h;
     ofStuff->nltvl1.p = new DualVariables[w*h];
     ofStuff->nltvl1.q = new DualVariables[w*h];
-    ofStuff->nltvl1.v1 =  new float[w*h];
-    ofStuff->nltvl1.v2 =  new float[w*h];
-    ofStuff->nltvl1.rho_c =  new float[w*h];
-    ofStuff->nltvl1.grad =  new float[w*h];
-    ofStuff->nltvl1.u1_ =  new float[w*h];
-    ofStuff->nltvl1.u2_ =  new float[w*h];
-    ofStuff->nltvl1.u1_tmp = new float[w*h];
-    ofStuff->nltvl1.u2_tmp = new float[w*h];
-    ofStuff->nltvl1.I1x = new float[w*h];
-    ofStuff->nltvl1.I1y = new float[w*h];
-    ofStuff->nltvl1.I1w = new float[w*h];
-    ofStuff->nltvl1.I1wx = new float[w*h];
-    ofStuff->nltvl1.I1wy = new float[w*h];
-    ofStuff->nltvl1.div_p = new float[w*h];
-    ofStuff->nltvl1.div_q = new float[w*h];
+    ofStuff->nltvl1.v1 =  new float[w*h]();
+    ofStuff->nltvl1.v2 =  new float[w*h]();
+    ofStuff->nltvl1.rho_c =  new float[w*h]();
+    ofStuff->nltvl1.grad =  new float[w*h]();
+    ofStuff->nltvl1.u1_ =  new float[w*h]();
+    ofStuff->nltvl1.u2_ =  new float[w*h]();
+    ofStuff->nltvl1.u1_tmp = new float[w*h]();
+    ofStuff->nltvl1.u2_tmp = new float[w*h]();
+    ofStuff->nltvl1.I1x = new float[w*h]();
+    ofStuff->nltvl1.I1y = new float[w*h]();
+    ofStuff->nltvl1.I1w = new float[w*h]();
+    ofStuff->nltvl1.I1wx = new float[w*h]();
+    ofStuff->nltvl1.I1wy = new float[w*h]();
+    ofStuff->nltvl1.div_p = new float[w*h]();
+    ofStuff->nltvl1.div_q = new float[w*h]();
 }
 
 
@@ -23,21 +23,21 @@ void  initialize_stuff_nltvcsad(
     ofStuff->nltvcsad.p    = new DualVariables[w*h];
     ofStuff->nltvcsad.q    = new DualVariables[w*h];
     ofStuff->nltvcsad.pnei = new PosNei[w*h];
-    ofStuff->nltvcsad.v1 =  new float[w*h];
-    ofStuff->nltvcsad.v2 =  new float[w*h];
-    ofStuff->nltvcsad.rho_c =  new float[w*h];
-    ofStuff->nltvcsad.grad =  new float[w*h];
-    ofStuff->nltvcsad.u1_ =  new float[w*h];
-    ofStuff->nltvcsad.u2_ =  new float[w*h];
-    ofStuff->nltvcsad.u1_tmp = new float[w*h];
-    ofStuff->nltvcsad.u2_tmp = new float[w*h];
-    ofStuff->nltvcsad.I1x = new float[w*h];
-    ofStuff->nltvcsad.I1y = new float[w*h];
-    ofStuff->nltvcsad.I1w = new float[w*h];
-    ofStuff->nltvcsad.I1wx = new float[w*h];
-    ofStuff->nltvcsad.I1wy = new float[w*h];
-    ofStuff->nltvcsad.div_p = new float[w*h];
-    ofStuff->nltvcsad.div_q = new float[w*h];
+    ofStuff->nltvcsad.v1 =  new float[w*h]();
+    ofStuff->nltvcsad.v2 =  new float[w*h]();
+    ofStuff->nltvcsad.rho_c =  new float[w*h]();
+    ofStuff->nltvcsad.grad =  new float[w*h]();
+    ofStuff->nltvcsad.u1_ =  new float[w*h]();
+    ofStuff->nltvcsad.u2_ =  new float[w*h]();
+    ofStuff->nltvcsad.u1_tmp = new float[w*h]();
+    ofStuff->nltvcsad.u2_tmp = new float[w*h]();
+    ofStuff->nltvcsad.I1x = new float[w*h]();
+    ofStuff->nltvcsad.I1y = new float[w*h]();
+    ofStuff->nltvcsad.I1w = new float[w*h]();
+    ofStuff->nltvcsad.I1wx = new float[w*h]();
+    ofStuff->nltvcsad.I1wy = new float[w*h]();
+    ofStuff->nltvcsad.div_p = new float[w*h]();
+    ofStuff->nltvcsad.div_q = new float[w*h]();
 }
 
 void  free_stuff_nltvcsad(SpecificOFStuff *ofStuff)
@@ -17,25 +17,25 @@ void  initialize_stuff_nltvcsad_w(
           const int w,
           const int h)
 {
-  ofStuff->nltvcsadw.weight = new float[ofCore->params.w_radio*2 + 1];
+  ofStuff->nltvcsadw.weight = new float[ofCore->params.w_radio*2 + 1]();
   ofStuff->nltvcsadw.p    = new DualVariables[w*h];
   ofStuff->nltvcsadw.q    = new DualVariables[w*h];
   ofStuff->nltvcsadw.pnei = new PosNei[w*h];
-  ofStuff->nltvcsadw.v1 =  new float[w*h];
-  ofStuff->nltvcsadw.v2 =  new float[w*h];
-  ofStuff->nltvcsadw.rho_c =  new float[w*h];
-  ofStuff->nltvcsadw.grad =  new float[w*h];
-  ofStuff->nltvcsadw.u1_ =  new float[w*h];
-  ofStuff->nltvcsadw.u2_ =  new float[w*h];
-  ofStuff->nltvcsadw.u1_tmp = new float[w*h];
-  ofStuff->nltvcsadw.u2_tmp = new float[w*h];  
-  ofStuff->nltvcsadw.I1x = new float[w*h];
-  ofStuff->nltvcsadw.I1y = new float[w*h]; 
-  ofStuff->nltvcsadw.I1w = new float[w*h]; 
-  ofStuff->nltvcsadw.I1wx = new float[w*h]; 
-  ofStuff->nltvcsadw.I1wy = new float[w*h]; 
-  ofStuff->nltvcsadw.div_p = new float[w*h]; 
-  ofStuff->nltvcsadw.div_q = new float[w*h]; 
+  ofStuff->nltvcsadw.v1 =  new float[w*h]();
+  ofStuff->nltvcsadw.v2 =  new float[w*h]();
+  ofStuff->nltvcsadw.rho_c =  new float[w*h]();
+  ofStuff->nltvcsadw.grad =  new float[w*h]();
+  ofStuff->nltvcsadw.u1_ =  new float[w*h]();
+  ofStuff->nltvcsadw.u2_ =  new float[w*h]();
+  ofStuff->nltvcsadw.u1_tmp = new float[w*h]();
+  ofStuff->nltvcsadw.u2_tmp = new float[w*h]();  
+  ofStuff->nltvcsadw.I1x = new float[w*h]();
+  ofStuff->nltvcsadw.I1y = new float[w*h](); 
+  ofStuff->nltvcsadw.I1w = new float[w*h](); 
+  ofStuff->nltvcsadw.I1wx = new float[w*h](); 
+  ofStuff->nltvcsadw.I1wy = new float[w*h](); 
+  ofStuff->nltvcsadw.div_p = new float[w*h](); 
+  ofStuff->nltvcsadw.div_q = new float[w*h](); 
 }
 
 void  free_stuff_nltvcsad_w(SpecificOFStuff *ofStuff)
@@ -19,24 +19,24 @@ void  initialize_stuff_nltvl1_w(
   // w, h as params in the function call
   //const int w = ofCore->params.w;
   //const int h = ofCore->params.h;
-  ofStuff->nltvl1w.weight = new float[ofCore->params.w_radio*2 + 1];
+  ofStuff->nltvl1w.weight = new float[ofCore->params.w_radio*2 + 1]();
   ofStuff->nltvl1w.p = new DualVariables[w*h];
   ofStuff->nltvl1w.q = new DualVariables[w*h];
-  ofStuff->nltvl1w.v1 =  new float[w*h];
-  ofStuff->nltvl1w.v2 =  new float[w*h];
-  ofStuff->nltvl1w.rho_c =  new float[w*h];
-  ofStuff->nltvl1w.grad =  new float[w*h];
-  ofStuff->nltvl1w.u1_ =  new float[w*h];
-  ofStuff->nltvl1w.u2_ =  new float[w*h];
-  ofStuff->nltvl1w.u1_tmp = new float[w*h];
-  ofStuff->nltvl1w.u2_tmp = new float[w*h];  
-  ofStuff->nltvl1w.I1x = new float[w*h];
-  ofStuff->nltvl1w.I1y = new float[w*h]; 
-  ofStuff->nltvl1w.I1w = new float[w*h]; 
-  ofStuff->nltvl1w.I1wx = new float[w*h]; 
-  ofStuff->nltvl1w.I1wy = new float[w*h]; 
-  ofStuff->nltvl1w.div_p = new float[w*h]; 
-  ofStuff->nltvl1w.div_q = new float[w*h]; 
+  ofStuff->nltvl1w.v1 =  new float[w*h]();
+  ofStuff->nltvl1w.v2 =  new float[w*h]();
+  ofStuff->nltvl1w.rho_c =  new float[w*h]();
+  ofStuff->nltvl1w.grad =  new float[w*h]();
+  ofStuff->nltvl1w.u1_ =  new float[w*h]();
+  ofStuff->nltvl1w.u2_ =  new float[w*h]();
+  ofStuff->nltvl1w.u1_tmp = new float[w*h]();
+  ofStuff->nltvl1w.u2_tmp = new float[w*h]();  
+  ofStuff->nltvl1w.I1x = new float[w*h]();
+  ofStuff->nltvl1w.I1y = new float[w*h](); 
+  ofStuff->nltvl1w.I1w = new float[w*h](); 
+  ofStuff->nltvl1w.I1wx = new float[w*h](); 
+  ofStuff->nltvl1w.I1wy = new float[w*h](); 
+  ofStuff->nltvl1w.div_p = new float[w*h](); 
+  ofStuff->nltvl1w.div_q = new float[w*h](); 
 }
 
 
@@ -0,0 +1,173 @@
+#include "numa_utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Sockets found by numa_pin_threads and socket of each pinned thread (empty if not pinned)
+static int g_num_sockets = 1;
+static std::vector<int> g_thread_socket;
+
+int parse_affinity(const std::string &mode) {
+    if (mode == "none" || mode == "0")
+        return AFFINITY_NONE;
+    if (mode == "close" || mode == "1")
+        return AFFINITY_CLOSE;
+    if (mode == "spread" || mode == "2")
+        return AFFINITY_SPREAD;
+    return -1;
+}
+
+#ifdef __linux__
+// physical_package_id of a CPU as exposed by sysfs (0 if it cannot be read)
+static int cpu_package_id(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *fd = fopen(path, "r");
+    int id = 0;
+    if (fd) {
+        if (fscanf(fd, "%d", &id) != 1)
+            id = 0;
+        fclose(fd);
+    }
+    return id;
+}
+#endif
+
+int numa_pin_threads(int mode) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return g_num_sockets;
+
+    // (socket, cpu) of every CPU we may run on, sockets renumbered 0..S-1
+    std::vector<std::pair<int, int>> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+            cpus.emplace_back(cpu_package_id(c), c);
+    if (cpus.empty())
+        return g_num_sockets;
+    std::sort(cpus.begin(), cpus.end());
+    int n_sockets = 0;
+    int last_pkg = -1;
+    for (auto &c : cpus) {
+        if (c.first != last_pkg) {
+            last_pkg = c.first;
+            n_sockets++;
+        }
+        c.first = n_sockets - 1;
+    }
+    g_num_sockets = n_sockets;
+
+    if (mode == AFFINITY_NONE)
+        return g_num_sockets;
+
+    // Order in which the threads take the CPUs
+    std::vector<std::pair<int, int>> order;
+    if (mode == AFFINITY_SPREAD) {
+        std::vector<std::vector<std::pair<int, int>>> per_socket(n_sockets);
+        for (const auto &c : cpus)
+            per_socket[c.first].push_back(c);
+        for (size_t k = 0; order.size() < cpus.size(); k++)
+            for (int s = 0; s < n_sockets; s++)
+                if (k < per_socket[s].size())
+                    order.push_back(per_socket[s][k]);
+    } else {
+        order = cpus;
+    }
+
+#ifdef _OPENMP
+    g_thread_socket.assign(omp_get_max_threads(), 0);
+#pragma omp parallel
+    {
+        const int tid = omp_get_thread_num();
+        const std::pair<int, int> &c = order[tid % order.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(c.second, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            fprintf(stderr, "WARNING: could not pin thread %d to cpu %d\n", tid, c.second);
+        g_thread_socket[tid] = c.first;
+    }
+#endif
+#else
+    (void) mode;
+#endif
+    return g_num_sockets;
+}
+
+int numa_num_sockets() {
+    return g_num_sockets;
+}
+
+int numa_thread_socket(int tid, int n_threads) {
+    if (tid < (int) g_thread_socket.size())
+        return g_thread_socket[tid];
+    return std::min(g_num_sockets - 1, tid * g_num_sockets / std::max(n_threads, 1));
+}
+
+void numa_first_touch(float *buf, int size, int planes) {
+    for (int c = 0; c < planes; c++) {
+        float *plane = buf + (size_t) c * size;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for (int i = 0; i < size; i++)
+            plane[i] = 0.0f;
+    }
+}
+
+float *numa_alloc_image(int size, int planes) {
+    auto *buf = new float[(size_t) size * planes];
+    numa_first_touch(buf, size, planes);
+    return buf;
+}
+
+int numa_partition_socket(int p, int n_parts) {
+    return std::min(g_num_sockets - 1, p * g_num_sockets / std::max(n_parts, 1));
+}
+
+std::vector<int> numa_socket_tasks(int n_parts, int tasks_per_part) {
+    int tid = 0;
+    int n_threads = 1;
+#ifdef _OPENMP
+    tid = omp_get_thread_num();
+    n_threads = omp_get_num_threads();
+#endif
+    const int my_socket = numa_thread_socket(tid, n_threads);
+
+    // Threads living on each socket and rank of this thread among those of its socket
+    std::vector<int> threads_on(g_num_sockets, 0);
+    int rank = 0;
+    for (int t = 0; t < n_threads; t++) {
+        const int s = numa_thread_socket(t, n_threads);
+        if (s == my_socket && t < tid)
+            rank++;
+        threads_on[s]++;
+    }
+
+    std::vector<int> tasks;
+    int dealt = 0;      // tasks of my socket seen so far
+    int orphans = 0;    // tasks of sockets without threads, dealt among everybody
+    for (int n = 0; n < n_parts * tasks_per_part; n++) {
+        const int s = numa_partition_socket(n / tasks_per_part, n_parts);
+        if (threads_on[s] == 0) {
+            if (orphans++ % n_threads == tid)
+                tasks.push_back(n);
+        } else if (s == my_socket) {
+            if (dealt++ % threads_on[s] == rank)
+                tasks.push_back(n);
+        }
+    }
+    return tasks;
+}
@@ -0,0 +1,45 @@
+#ifndef NUMA_UTILS_H
+#define NUMA_UTILS_H
+
+#include <string>
+#include <vector>
+
+/// NUMA helpers for large-frame runs: thread pinning, first-touch allocation and the
+/// assignment of partitions to sockets used by the per-socket `split_img` mode.
+/// Without OpenMP (or outside Linux) pinning is a no-op and everything runs on one socket.
+
+// Thread affinity modes (-affinity)
+#define AFFINITY_NONE  0    // Leave threads where the OS puts them
+#define AFFINITY_CLOSE 1    // Fill one socket before moving to the next
+#define AFFINITY_SPREAD 2   // Round-robin threads over the sockets
+
+// Parses "none", "close" or "spread" (or the numeric value); returns -1 if unknown
+int parse_affinity(const std::string &mode);
+
+// Pins every OpenMP thread to one CPU following `mode` and records the socket of each
+// thread. Must be called from the main thread before the first parallel region that matters.
+// Returns the number of sockets found among the allowed CPUs.
+int numa_pin_threads(int mode);
+
+// Number of sockets seen by numa_pin_threads (1 until it has been called)
+int numa_num_sockets();
+
+// Socket of OpenMP thread `tid` (by position if the threads have not been pinned)
+int numa_thread_socket(int tid, int n_threads);
+
+// Zero-fills `planes` consecutive planes of `size` floats with the same static row split
+// the solver loops use, so every page lands on the node of the thread that will update it
+void numa_first_touch(float *buf, int size, int planes = 1);
+
+// new float[size * planes], first-touched as above (release with delete[])
+float *numa_alloc_image(int size, int planes = 1);
+
+// Socket that owns partition `p` when `n_parts` partitions are split in contiguous blocks over the sockets
+int numa_partition_socket(int p, int n_parts);
+
+// Tasks (out of `n_parts * tasks_per_part`, task n belonging to partition n / tasks_per_part)
+// that the calling OpenMP thread must run in per-socket mode: only tasks of partitions owned
+// by the thread's socket, dealt round-robin among the threads of that socket
+std::vector<int> numa_socket_tasks(int n_parts, int tasks_per_part);
+
+#endif // NUMA_UTILS_H
@@ -45,6 +45,11 @@
 #define GRAD_IS_ZERO 1E-8
 #define GRAD_IS_ZERO_GLOBAL 1E-10
 
+// Global stopping rule on the relative energy decrease (0 disables it)
+#define PAR_DEFAULT_REL_TOL_ENERGY 0.0
+#define PAR_DEFAULT_ENERGY_CHECK   10 // Evaluate the energy every N iterations
+#define PAR_DEFAULT_ENERGY_STOPS   3  // Consecutive small decreases needed to stop a warp
+
 #define PAR_DEFAULT_NPROC   0    //0
 
 #define PAR_DEFAULT_NWARPS_LOCAL  1  //1
@@ -64,11 +69,14 @@
 #define PAR_DEFAULT_WINSIZE 5       // Default patch/window size
 
 // Whether to partition the image or not
-#define PARTITIONING 0          // Toggle on/off
+#define PARTITIONING 0          // 0: off, 1: grid, 2: grid with partitions grown by their NUMA socket
 #define PARTS_CPU 0             // Whether the parts are conditioned on the num of cpus
 #define HOR_PARTS 3             // Def. nº of horizontal parts for the first partition
 #define VER_PARTS 2             // The same as above but for vertical parts
 
+// Thread pinning: 0 none, 1 close (fill a socket first), 2 spread (round-robin over sockets)
+#define PAR_DEFAULT_AFFINITY 0
+
 // Parameters for bilateral filter
 #define PATCH_BILATERAL_FILTER 2
 #define SIGMA_BILATERAL_DIST   4.0
@@ -88,5 +96,9 @@
 
 #define MAX_PATCH 50
 
+// Pixels around a patch that the local functionals may read (gradients, NLTV neighbours), used to
+// tell which initial seeds can be evaluated concurrently
+#define SEED_FOOTPRINT_MARGIN (NL_BETA + 1)
+
 
 #endif // PARAMETERS_H
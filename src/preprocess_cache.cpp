@@ -0,0 +1,269 @@
+#include "preprocess_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include "image_kernels.h"
+}
+
+static const char CACHE_MAGIC[8] = {'F', 'A', 'L', 'D', 'O', 'I', 'P', 'C'};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t w;
+    uint32_t h;
+    uint32_t n_planes;
+    uint64_t key;
+};
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// 64-bit hash of a byte buffer (MurmurHash3-style mixing of 8-byte words)
+static uint64_t hash_bytes(const void *buf, size_t len, uint64_t seed) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    const auto *bytes = static_cast<const unsigned char *>(buf);
+    uint64_t h = seed ^ (len * c1);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, bytes + i, 8);
+        k *= c1;
+        k = rotl64(k, 31);
+        k *= c2;
+        h ^= k;
+        h = rotl64(h, 27) * 5 + 0x52dce729;
+    }
+    uint64_t k = 0;
+    for (size_t j = 0; i + j < len; j++)
+        k |= (uint64_t) bytes[i + j] << (8 * j);
+    h ^= rotl64(k * c1, 31) * c2;
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static double seconds_since(std::chrono::system_clock::time_point t0) {
+    std::chrono::duration<double> d = std::chrono::system_clock::now() - t0;
+    return d.count();
+}
+
+void PreprocessCache::open(const std::string &d) {
+    dir = d;
+    if (dir.empty())
+        return;
+    // Create the directory if needed (a single level, like the Partial_results folder)
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 && mkdir(dir.c_str(), 0755) != 0) {
+        fprintf(stderr, "WARNING: cannot create cache directory %s, caching disabled\n", dir.c_str());
+        dir.clear();
+    }
+}
+
+void PreprocessCache::keep_in_memory(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mem_lock);
+    mem_limit = max_bytes;
+    mem.clear();
+    mem_bytes = 0;
+}
+
+bool PreprocessCache::load_memory(uint64_t key, int w, int h, const std::vector<float *> &planes) {
+    std::lock_guard<std::mutex> lock(mem_lock);
+    auto it = mem.find(key);
+    const size_t plane_size = (size_t) w * h;
+    if (it == mem.end() || it->second.w != w || it->second.h != h
+        || it->second.data.size() != planes.size() * plane_size)
+        return false;
+    for (size_t c = 0; c < planes.size(); c++)
+        memcpy(planes[c], it->second.data.data() + c * plane_size, plane_size * sizeof(float));
+    it->second.last_use = ++mem_clock;
+    mem_hits++;
+    return true;
+}
+
+void PreprocessCache::store_memory(uint64_t key, int w, int h, const std::vector<const float *> &planes) {
+    const size_t plane_size = (size_t) w * h;
+    const size_t bytes = planes.size() * plane_size * sizeof(float);
+    std::lock_guard<std::mutex> lock(mem_lock);
+    if (bytes > mem_limit || mem.count(key))
+        return;
+
+    // Evict the least recently used entries (a handful per frame, a linear scan is enough)
+    while (mem_bytes + bytes > mem_limit && !mem.empty()) {
+        auto oldest = mem.begin();
+        for (auto it = mem.begin(); it != mem.end(); ++it)
+            if (it->second.last_use < oldest->second.last_use)
+                oldest = it;
+        mem_bytes -= oldest->second.data.size() * sizeof(float);
+        mem.erase(oldest);
+    }
+
+    MemoryEntry &e = mem[key];
+    e.w = w;
+    e.h = h;
+    e.data.resize(planes.size() * plane_size);
+    for (size_t c = 0; c < planes.size(); c++)
+        memcpy(e.data.data() + c * plane_size, planes[c], plane_size * sizeof(float));
+    e.last_use = ++mem_clock;
+    mem_bytes += bytes;
+}
+
+uint64_t PreprocessCache::key(const std::string &tag, const std::vector<CacheInput> &inputs, int w, int h) {
+    auto t0 = std::chrono::system_clock::now();
+    const int32_t dims[2] = {w, h};
+    uint64_t k = hash_bytes(tag.data(), tag.size(), PREPROCESS_CACHE_VERSION);
+    k = hash_bytes(dims, sizeof(dims), k);
+    for (const auto &in : inputs)
+        k = hash_bytes(in.data, in.n * sizeof(float), k);
+    count(nullptr, &hash_secs, seconds_since(t0));
+    return k;
+}
+
+void PreprocessCache::count(int *counter, double *secs, double elapsed) {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    if (counter)
+        (*counter)++;
+    *secs += elapsed;
+}
+
+std::string PreprocessCache::path(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.fpc", (unsigned long long) key);
+    return dir + "/" + name;
+}
+
+bool PreprocessCache::load(uint64_t key, int w, int h, const std::vector<float *> &planes) {
+    if (!enabled())
+        return false;
+    auto t0 = std::chrono::system_clock::now();
+    if (mem_limit > 0 && load_memory(key, w, h, planes)) {
+        count(&hits, &load_secs, seconds_since(t0));
+        return true;
+    }
+    if (dir.empty()) {
+        count(&misses, &load_secs, seconds_since(t0));
+        return false;
+    }
+    const size_t plane_bytes = (size_t) w * h * sizeof(float);
+    const size_t expected = PREPROCESS_CACHE_HEADER + planes.size() * plane_bytes;
+
+    const int fd = ::open(path(key).c_str(), O_RDONLY);
+    if (fd < 0) {
+        count(&misses, &load_secs, seconds_since(t0));
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size == expected)
+        map = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        count(&misses, &load_secs, seconds_since(t0));
+        return false;
+    }
+
+    CacheHeader hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    const bool valid = memcmp(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+                       && hdr.version == PREPROCESS_CACHE_VERSION && hdr.key == key
+                       && hdr.w == (uint32_t) w && hdr.h == (uint32_t) h
+                       && hdr.n_planes == (uint32_t) planes.size();
+    if (valid) {
+        const char *data = static_cast<const char *>(map) + PREPROCESS_CACHE_HEADER;
+        for (size_t c = 0; c < planes.size(); c++)
+            memcpy(planes[c], data + c * plane_bytes, plane_bytes);
+    }
+    munmap(map, expected);
+
+    if (valid && mem_limit > 0)
+        store_memory(key, w, h, std::vector<const float *>(planes.begin(), planes.end()));
+    count(valid ? &hits : &misses, &load_secs, seconds_since(t0));
+    return valid;
+}
+
+void PreprocessCache::store(uint64_t key, int w, int h, const std::vector<const float *> &planes) {
+    if (!enabled())
+        return;
+    auto t0 = std::chrono::system_clock::now();
+    if (mem_limit > 0)
+        store_memory(key, w, h, planes);
+    if (dir.empty()) {
+        count(nullptr, &store_secs, seconds_since(t0));
+        return;
+    }
+    const size_t plane_bytes = (size_t) w * h * sizeof(float);
+    const std::string final_path = path(key);
+    // Unique per call: concurrent jobs of one process may store the same frame's artifact
+    static std::atomic<unsigned> tmp_serial(0);
+    const std::string tmp_path = final_path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(tmp_serial++);
+
+    FILE *fd = fopen(tmp_path.c_str(), "wb");
+    if (!fd) {
+        fprintf(stderr, "WARNING: cannot write cache file %s\n", tmp_path.c_str());
+        count(nullptr, &store_secs, seconds_since(t0));
+        return;
+    }
+    char header[PREPROCESS_CACHE_HEADER] = {};
+    CacheHeader hdr;
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.version = PREPROCESS_CACHE_VERSION;
+    hdr.w = w;
+    hdr.h = h;
+    hdr.n_planes = planes.size();
+    hdr.key = key;
+    memcpy(header, &hdr, sizeof(hdr));
+
+    bool ok = fwrite(header, 1, sizeof(header), fd) == sizeof(header);
+    for (size_t c = 0; ok && c < planes.size(); c++)
+        ok = fwrite(planes[c], 1, plane_bytes, fd) == plane_bytes;
+    ok = (fclose(fd) == 0) && ok;
+
+    if (!ok || rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+        fprintf(stderr, "WARNING: cannot write cache file %s\n", final_path.c_str());
+        unlink(tmp_path.c_str());
+    }
+    count(nullptr, &store_secs, seconds_since(t0));
+}
+
+void PreprocessCache::print_stats(const char *who) const {
+    if (!enabled())
+        return;
+    printf("(%s) preprocessing cache: %d hit(s) (%d in memory), %d miss(es); hashing %.4fs, loading %.4fs, "
+           "storing %.4fs\n", who, hits, mem_hits, misses, hash_secs, load_secs, store_secs);
+}
+
+PreprocessCache &preprocess_cache() {
+    static PreprocessCache cache;
+    return cache;
+}
+
+void cached_rgb_to_lab(const float *rgb, int w, int h, int pd, float *lab) {
+    PreprocessCache &cache = preprocess_cache();
+    const int size = w * h;
+    if (!cache.enabled() || pd != 3) {
+        par_rgb_to_lab(rgb, size, lab);
+        return;
+    }
+    const uint64_t key = cache.key("rgb-to-lab", {{rgb, (size_t) size * pd}}, w, h);
+    if (!cache.load(key, w, h, {lab, lab + size, lab + 2 * size})) {
+        par_rgb_to_lab(rgb, size, lab);
+        cache.store(key, w, h, {lab, lab + size, lab + 2 * size});
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PREPROCESS_CACHE_H
+#define PREPROCESS_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Content-addressed on-disk cache of preprocessing planes (smoothed gray images, gradients,
+/// L*a*b* images, non-local weights). An artifact is keyed on a hash of the pixels it was
+/// computed from plus a tag naming the step and every constant it depends on, so the local
+/// and the global step (and re-runs of a parameter sweep) find each other's planes.
+///
+/// File format (<dir>/<key>.fpc), readable with a single mmap:
+///     bytes  0..7   magic "FALDOIPC"
+///     bytes  8..11  format version (uint32)
+///     bytes 12..23  width, height, number of planes (uint32 each)
+///     bytes 24..31  key hash (uint64)
+///     byte   4096   planes of width*height float32, one after the other
+/// Files are written to a temporary name and renamed, so concurrent runs never see half a file.
+///
+/// A process that goes through a whole sequence (faldoi_pipeline -seq) can also keep the
+/// artifacts in memory, with or without a directory: frame t+1 of a pair is frame t of the next.
+
+#define PREPROCESS_CACHE_VERSION 2
+#define PREPROCESS_CACHE_HEADER  4096
+
+// One input of an artifact: `n` floats whose content goes into the key
+struct CacheInput {
+    const float *data;
+    size_t n;
+};
+
+class PreprocessCache {
+public:
+    // Caching is disabled until a directory is set
+    void open(const std::string &dir);
+    bool enabled() const { return !dir.empty() || mem_limit > 0; }
+
+    // Keeps up to `max_bytes` of planes in memory, the least recently used evicted first
+    void keep_in_memory(size_t max_bytes);
+
+    // Key of the artifact computed by `tag` from `inputs` (w x h images)
+    uint64_t key(const std::string &tag, const std::vector<CacheInput> &inputs, int w, int h);
+
+    // Copies the cached planes into `planes` (w*h floats each); false if absent or invalid
+    bool load(uint64_t key, int w, int h, const std::vector<float *> &planes);
+
+    // Writes the planes; failures only print a warning (the cache is an accelerator)
+    void store(uint64_t key, int w, int h, const std::vector<const float *> &planes);
+
+    // Hits, misses and time spent hashing, loading and storing
+    void print_stats(const char *who) const;
+
+private:
+    std::string path(uint64_t key) const;
+    void count(int *counter, double *secs, double elapsed);
+    bool load_memory(uint64_t key, int w, int h, const std::vector<float *> &planes);
+    void store_memory(uint64_t key, int w, int h, const std::vector<const float *> &planes);
+
+    struct MemoryEntry {
+        int w, h;
+        std::vector<float> data;    // planes one after the other
+        uint64_t last_use;
+    };
+
+    std::string dir;
+    std::mutex stats_lock;  // prepare_stuff runs concurrently for the partitions
+    int hits = 0;
+    int misses = 0;
+    double hash_secs = 0;
+    double load_secs = 0;
+    double store_secs = 0;
+
+    std::mutex mem_lock;
+    std::unordered_map<uint64_t, MemoryEntry> mem;
+    size_t mem_limit = 0;
+    size_t mem_bytes = 0;
+    uint64_t mem_clock = 0;
+    int mem_hits = 0;
+};
+
+// Cache shared by the preprocessing code of the executable (disabled unless -cache_dir is given)
+PreprocessCache &preprocess_cache();
+
+// par_rgb_to_lab of a w x h image with pd channels through the cache: the L*a*b* planes of a
+// frame are computed the same way by both steps, so the global step reuses the local ones
+void cached_rgb_to_lab(const float *rgb, int w, int h, int pd, float *lab);
+
+#endif // PREPROCESS_CACHE_H
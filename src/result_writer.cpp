@@ -0,0 +1,109 @@
+#include "result_writer.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "flow_io.h"
+
+extern "C" {
+#include "iio.h"
+}
+
+static double seconds_since(std::chrono::system_clock::time_point t0) {
+    std::chrono::duration<double> d = std::chrono::system_clock::now() - t0;
+    return d.count();
+}
+
+ResultWriter::~ResultWriter() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    not_empty.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void ResultWriter::save(const std::string &filename, const float *data, int w, int h, int pd) {
+    push(filename, data, w, h, pd, false);
+}
+
+void ResultWriter::save_mask(const std::string &filename, const float *data, int w, int h) {
+    push(filename, data, w, h, 1, true);
+}
+
+void ResultWriter::push(const std::string &filename, const float *data, int w, int h, int pd, bool mask) {
+    auto t0 = std::chrono::system_clock::now();
+    std::unique_lock<std::mutex> guard(lock);
+    not_full.wait(guard, [this] { return queue.size() < RESULT_WRITER_CAPACITY; });
+    wait_secs += seconds_since(t0);
+    if (!worker.joinable())
+        worker = std::thread(&ResultWriter::run, this);
+
+    Job job;
+    job.filename = filename;
+    if (!pool.empty()) {
+        job.data.swap(pool.back());
+        pool.pop_back();
+    }
+    job.data.assign(data, data + (size_t) w * h * pd);
+    job.w = w;
+    job.h = h;
+    job.pd = pd;
+    job.mask = mask;
+    queue.push_back(std::move(job));
+    not_empty.notify_one();
+}
+
+void ResultWriter::run() {
+    std::vector<int> mask;
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        not_empty.wait(guard, [this] { return stop || !queue.empty(); });
+        if (queue.empty())
+            return;
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+        not_full.notify_one();
+        guard.unlock();
+
+        auto t0 = std::chrono::system_clock::now();
+        bool ok = true;
+        if (job.mask) {
+            mask.assign(job.data.begin(), job.data.end());
+            iio_save_image_int(job.filename.c_str(), mask.data(), job.w, job.h);
+        } else {
+            ok = save_image_planar(job.filename, job.data.data(), job.w, job.h, job.pd);
+        }
+        const double secs = seconds_since(t0);
+
+        guard.lock();
+        busy = false;
+        written += ok;
+        failed += !ok;
+        write_secs += secs;
+        if (pool.size() < RESULT_WRITER_CAPACITY)
+            pool.push_back(std::move(job.data));
+        if (queue.empty())
+            drained.notify_all();
+    }
+}
+
+void ResultWriter::flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    drained.wait(guard, [this] { return queue.empty() && !busy; });
+}
+
+void ResultWriter::print_stats(const char *who) const {
+    std::lock_guard<std::mutex> guard(lock);
+    if (written + failed == 0)
+        return;
+    printf("(%s) result writer: %d file(s) written in the background (%.4fs), %d failed; %.4fs waiting "
+           "for a free slot\n", who, written, write_secs, failed, wait_secs);
+}
+
+ResultWriter &result_writer() {
+    static ResultWriter writer;
+    return writer;
+}
@@ -0,0 +1,68 @@
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Background writer of results (flows, similarity maps, occlusion masks). save() copies the
+/// data into a pooled buffer and returns; a single thread writes the files in order. The queue
+/// is bounded, so a producer faster than the disk waits instead of piling up copies, and the
+/// buffers are recycled, so periodic snapshots (-partial_res 1) cost one memcpy and no allocation.
+
+#define RESULT_WRITER_CAPACITY 4
+
+class ResultWriter {
+public:
+    ResultWriter() = default;
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+    ~ResultWriter();
+
+    // Queues pd planes of w*h floats for save_image_planar (format from the extension)
+    void save(const std::string &filename, const float *data, int w, int h, int pd);
+
+    // Queues a mask, written by iio as an integer image (occlusions)
+    void save_mask(const std::string &filename, const float *data, int w, int h);
+
+    // Returns once every queued result is on disk
+    void flush();
+
+    // Files written, failures, time spent writing and time producers waited for a slot
+    void print_stats(const char *who) const;
+
+private:
+    struct Job {
+        std::string filename;
+        std::vector<float> data;
+        int w, h, pd;
+        bool mask;
+    };
+
+    void push(const std::string &filename, const float *data, int w, int h, int pd, bool mask);
+    void run();
+
+    mutable std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::condition_variable drained;
+    std::deque<Job> queue;
+    std::vector<std::vector<float>> pool;   // buffers of written jobs, reused by the next ones
+    std::thread worker;                     // started by the first save
+    bool busy = false;
+    bool stop = false;
+
+    int written = 0;
+    int failed = 0;
+    double write_secs = 0;
+    double wait_secs = 0;
+};
+
+// Writer shared by the whole executable
+ResultWriter &result_writer();
+
+#endif // RESULT_WRITER_H
@@ -6,7 +6,11 @@
 #include <cmath>
 #include <iostream>
 #include <cstdio>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include "utils_preprocess.h"
+#include "match_file.h"
+#include "flow_io.h"
 extern "C" {
 #include "iio.h"
 }
@@ -82,55 +86,68 @@ void visualize_flow(float *flow, int nx, int ny, cv::Mat &color_map, cv::Mat &ar
     }
 }
 
-static int sparse_optical_flow(char *input, int nx, int ny, float *out) {
-    float x1, x2, y1, y2;
-    std::string filename_sift_matches(input);
-    std::ifstream file(input);
-    std::string str;
-
-    //Initialize all the the optical flow to NAN
-    for (int j = 0; j < ny; j++){
-        for (int i = 0; i < nx; i++){
-            out[j*nx + i] = NAN;
-            out[nx*ny + j*nx + i] = NAN;
+// Sparse flow of one or more match lists (text in the given layout, or binary), keeping
+// the matches with a score above min_score. The combined, filtered list can be saved in the
+// binary format (save_matches) so later runs map it directly
+static int sparse_optical_flow(const std::vector<std::string> &inputs, int layout, float min_score,
+                               const std::string &save_matches, int nx, int ny, float *out) {
+    // A single list is rasterized where it lies (mapped if binary)
+    if (inputs.size() == 1 && save_matches.empty()) {
+        MatchFile file;
+        const bool found = file.open(inputs[0], layout);
+        sparse_flow_from_records(file.data(), file.size(), min_score, nx, ny, out);
+        if (!found) {
+            std::cout << "File does not exist\n";
+            std::cout << inputs[0] << "\n";
+            return 0;
         }
+        return 1;
     }
-    if (file){
-        //Insert the sparse flow obtained from matches
-        while (getline(file, str)){
-            //Colum I0, Row I0, Colum I1, Row I1
-            sscanf(str.c_str(), "%f %f %f %f\n",
-                   &x1, &y1, &x2, &y2);
-            float u = x2 - x1;
-            float v = y2 - y1;
-            int i = std::floor(x1);
-            int j = std::floor(y1);
-            out[j*nx + i] = u;
-            out[nx*ny + j*nx + i] = v;
+
+    std::vector<MatchRecord> joint;
+    for (const auto &input : inputs) {
+        MatchFile file;
+        if (!file.open(input, layout)) {
+            std::cout << "File does not exist\n";
+            std::cout << input << "\n";
+            continue;
         }
-        return 1;
-    }else{
-        std::cout << "File does not exist\n";
-        std::cout << input << "\n";
-        return 0;
+        for (size_t m = 0; m < file.size(); m++)
+            if (file.data()[m].score > min_score)
+                joint.push_back(file.data()[m]);
     }
+    sparse_flow_from_records(joint.data(), joint.size(), min_score, nx, ny, out);
+    if (!save_matches.empty() && !write_match_file(save_matches, joint.data(), joint.size()))
+        fprintf(stderr, "WARNING: cannot write %s\n", save_matches.c_str());
+    return 1;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "usage:\n\t%s sift_matches.txt colum row out.flo\n", *argv);
+    std::vector<std::string> args(argv, argv + argc);
+    auto layout_name = pick_option(args, "layout", "cut");      // column layout of text lists
+    auto min_score = pick_option(args, "min_score", "");        // keep matches with score > min_score
+    auto append = pick_option(args, "append", "");              // second list joined to the first
+    auto save_matches = pick_option(args, "save_matches", "");  // binary copy of the used matches
+
+    const int layout = parse_match_layout(layout_name);
+    if (args.size() != 5 || layout < 0) {
+        fprintf(stderr, "usage:\n\t%s matches colum row out.flo [-layout cut|sift|deep] [-min_score th]"
+                        " [-append matches2] [-save_matches out.fmt]\n", *argv);
         fprintf(stderr, "usage:\n\t Nargs:%d\n", argc);
         return 1;
     }
 
-    char *filename_in = argv[1];
-    char *filename_out = argv[4];
-    int nx = atoi(argv[2]);
-    int ny = atoi(argv[3]);
+    const char *filename_out = args[4].c_str();
+    int nx = atoi(args[2].c_str());
+    int ny = atoi(args[3].c_str());
     float *out = new float[2*nx*ny];
-    
+
     // Compute sparse optical flow
-    sparse_optical_flow(filename_in, nx, ny, out);
+    std::vector<std::string> inputs = {args[1]};
+    if (!append.empty())
+        inputs.push_back(append);
+    sparse_optical_flow(inputs, layout, min_score.empty() ? -INFINITY : std::stof(min_score), save_matches,
+                        nx, ny, out);
     
     // Visualize flow
     cv::Mat color_map, arrow_map;
@@ -143,7 +160,7 @@ int main(int argc, char *argv[]) {
     cv::imwrite(base_name + "_arrow.png", arrow_map);
     
     // Save the optical flow
-    iio_save_image_float_split(filename_out, out, nx, ny, 2);
+    save_image_planar(filename_out, out, nx, ny, 2);
 
     delete [] out;
     return 0;
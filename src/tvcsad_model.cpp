@@ -31,29 +31,29 @@ void  initialize_stuff_tvcsad(
 {
   //fprintf(stderr, "W x H :%d x %d\n", w, h);
   ofStuff->tvcsad.pnei = new PosNei[w*h];
-  ofStuff->tvcsad.xi11 = new float[w*h];
-  ofStuff->tvcsad.xi12 = new float[w*h];
-  ofStuff->tvcsad.xi21 = new float[w*h];
-  ofStuff->tvcsad.xi22 = new float[w*h];
-  ofStuff->tvcsad.u1x = new float[w*h];
-  ofStuff->tvcsad.u1y = new float[w*h];
-  ofStuff->tvcsad.u2x = new float[w*h];
-  ofStuff->tvcsad.u2y = new float[w*h];
-  ofStuff->tvcsad.v1 =  new float[w*h];
-  ofStuff->tvcsad.v2 =  new float[w*h];
-  ofStuff->tvcsad.rho_c =  new float[w*h];
-  ofStuff->tvcsad.grad =  new float[w*h];
-  ofStuff->tvcsad.u1_ =  new float[w*h];
-  ofStuff->tvcsad.u2_ =  new float[w*h];
-  ofStuff->tvcsad.u1_tmp = new float[w*h];
-  ofStuff->tvcsad.u2_tmp = new float[w*h];  
-  ofStuff->tvcsad.I1x = new float[w*h];
-  ofStuff->tvcsad.I1y = new float[w*h]; 
-  ofStuff->tvcsad.I1w = new float[w*h]; 
-  ofStuff->tvcsad.I1wx = new float[w*h]; 
-  ofStuff->tvcsad.I1wy = new float[w*h]; 
-  ofStuff->tvcsad.div_xi1 = new float[w*h]; 
-  ofStuff->tvcsad.div_xi2 = new float[w*h]; 
+  ofStuff->tvcsad.xi11 = new float[w*h]();
+  ofStuff->tvcsad.xi12 = new float[w*h]();
+  ofStuff->tvcsad.xi21 = new float[w*h]();
+  ofStuff->tvcsad.xi22 = new float[w*h]();
+  ofStuff->tvcsad.u1x = new float[w*h]();
+  ofStuff->tvcsad.u1y = new float[w*h]();
+  ofStuff->tvcsad.u2x = new float[w*h]();
+  ofStuff->tvcsad.u2y = new float[w*h]();
+  ofStuff->tvcsad.v1 =  new float[w*h]();
+  ofStuff->tvcsad.v2 =  new float[w*h]();
+  ofStuff->tvcsad.rho_c =  new float[w*h]();
+  ofStuff->tvcsad.grad =  new float[w*h]();
+  ofStuff->tvcsad.u1_ =  new float[w*h]();
+  ofStuff->tvcsad.u2_ =  new float[w*h]();
+  ofStuff->tvcsad.u1_tmp = new float[w*h]();
+  ofStuff->tvcsad.u2_tmp = new float[w*h]();  
+  ofStuff->tvcsad.I1x = new float[w*h]();
+  ofStuff->tvcsad.I1y = new float[w*h](); 
+  ofStuff->tvcsad.I1w = new float[w*h](); 
+  ofStuff->tvcsad.I1wx = new float[w*h](); 
+  ofStuff->tvcsad.I1wy = new float[w*h](); 
+  ofStuff->tvcsad.div_xi1 = new float[w*h](); 
+  ofStuff->tvcsad.div_xi2 = new float[w*h](); 
 }
 
 
@@ -33,31 +33,31 @@ void  initialize_stuff_tvcsad_w(
   //const int w = ofCore->params.w;
   //const int h = ofCore->params.h;
   //fprintf(stderr, "W x H :%d x %d\n", w, h);
-  ofStuff->tvcsadw.weight = new float[ofCore->params.w_radio*2 + 1];
+  ofStuff->tvcsadw.weight = new float[ofCore->params.w_radio*2 + 1]();
   ofStuff->tvcsadw.pnei = new PosNei[w*h];
-  ofStuff->tvcsadw.xi11 = new float[w*h];
-  ofStuff->tvcsadw.xi12 = new float[w*h];
-  ofStuff->tvcsadw.xi21 = new float[w*h];
-  ofStuff->tvcsadw.xi22 = new float[w*h];
-  ofStuff->tvcsadw.u1x = new float[w*h];
-  ofStuff->tvcsadw.u1y = new float[w*h];
-  ofStuff->tvcsadw.u2x = new float[w*h];
-  ofStuff->tvcsadw.u2y = new float[w*h];
-  ofStuff->tvcsadw.v1 =  new float[w*h];
-  ofStuff->tvcsadw.v2 =  new float[w*h];
-  ofStuff->tvcsadw.rho_c =  new float[w*h];
-  ofStuff->tvcsadw.grad =  new float[w*h];
-  ofStuff->tvcsadw.u1_ =  new float[w*h];
-  ofStuff->tvcsadw.u2_ =  new float[w*h];
-  ofStuff->tvcsadw.u1_tmp = new float[w*h];
-  ofStuff->tvcsadw.u2_tmp = new float[w*h];  
-  ofStuff->tvcsadw.I1x = new float[w*h];
-  ofStuff->tvcsadw.I1y = new float[w*h]; 
-  ofStuff->tvcsadw.I1w = new float[w*h]; 
-  ofStuff->tvcsadw.I1wx = new float[w*h]; 
-  ofStuff->tvcsadw.I1wy = new float[w*h]; 
-  ofStuff->tvcsadw.div_xi1 = new float[w*h]; 
-  ofStuff->tvcsadw.div_xi2 = new float[w*h]; 
+  ofStuff->tvcsadw.xi11 = new float[w*h]();
+  ofStuff->tvcsadw.xi12 = new float[w*h]();
+  ofStuff->tvcsadw.xi21 = new float[w*h]();
+  ofStuff->tvcsadw.xi22 = new float[w*h]();
+  ofStuff->tvcsadw.u1x = new float[w*h]();
+  ofStuff->tvcsadw.u1y = new float[w*h]();
+  ofStuff->tvcsadw.u2x = new float[w*h]();
+  ofStuff->tvcsadw.u2y = new float[w*h]();
+  ofStuff->tvcsadw.v1 =  new float[w*h]();
+  ofStuff->tvcsadw.v2 =  new float[w*h]();
+  ofStuff->tvcsadw.rho_c =  new float[w*h]();
+  ofStuff->tvcsadw.grad =  new float[w*h]();
+  ofStuff->tvcsadw.u1_ =  new float[w*h]();
+  ofStuff->tvcsadw.u2_ =  new float[w*h]();
+  ofStuff->tvcsadw.u1_tmp = new float[w*h]();
+  ofStuff->tvcsadw.u2_tmp = new float[w*h]();  
+  ofStuff->tvcsadw.I1x = new float[w*h]();
+  ofStuff->tvcsadw.I1y = new float[w*h](); 
+  ofStuff->tvcsadw.I1w = new float[w*h](); 
+  ofStuff->tvcsadw.I1wx = new float[w*h](); 
+  ofStuff->tvcsadw.I1wy = new float[w*h](); 
+  ofStuff->tvcsadw.div_xi1 = new float[w*h](); 
+  ofStuff->tvcsadw.div_xi2 = new float[w*h](); 
 }
 
 
@@ -20,33 +20,33 @@ void  initialize_stuff_tvl2coupled(
 {
     //fprintf(stderr, "W x H :%d x %d\n", w, h);
     // Dual variables
-    ofStuff->tvl2.xi11 = new float[w*h];
-    ofStuff->tvl2.xi12 = new float[w*h];
-    ofStuff->tvl2.xi21 = new float[w*h];
-    ofStuff->tvl2.xi22 = new float[w*h];
-
-    ofStuff->tvl2.u1x = new float[w*h];
-    ofStuff->tvl2.u1y = new float[w*h];
-    ofStuff->tvl2.u2x = new float[w*h];
-    ofStuff->tvl2.u2y = new float[w*h];
-
-    ofStuff->tvl2.v1 =  new float[w*h];
-    ofStuff->tvl2.v2 =  new float[w*h];
-
-    ofStuff->tvl2.rho_c =  new float[w*h];
-    ofStuff->tvl2.grad =  new float[w*h];
-    ofStuff->tvl2.u1_ =  new float[w*h];
-    ofStuff->tvl2.u2_ =  new float[w*h];
-    ofStuff->tvl2.u1Aux = new float[w*h];
-    ofStuff->tvl2.u2Aux = new float[w*h];
-    ofStuff->tvl2.I1x = new float[w*h];
-    ofStuff->tvl2.I1y = new float[w*h];
-    ofStuff->tvl2.I1w = new float[w*h];
-    ofStuff->tvl2.I1wx = new float[w*h];
-    ofStuff->tvl2.I1wy = new float[w*h];
-    ofStuff->tvl2.div_xi1 = new float[w*h];
-    ofStuff->tvl2.div_xi2 = new float[w*h];
-    ofStuff->tvl2.u_N = new float[w*h];
+    ofStuff->tvl2.xi11 = new float[w*h]();
+    ofStuff->tvl2.xi12 = new float[w*h]();
+    ofStuff->tvl2.xi21 = new float[w*h]();
+    ofStuff->tvl2.xi22 = new float[w*h]();
+
+    ofStuff->tvl2.u1x = new float[w*h]();
+    ofStuff->tvl2.u1y = new float[w*h]();
+    ofStuff->tvl2.u2x = new float[w*h]();
+    ofStuff->tvl2.u2y = new float[w*h]();
+
+    ofStuff->tvl2.v1 =  new float[w*h]();
+    ofStuff->tvl2.v2 =  new float[w*h]();
+
+    ofStuff->tvl2.rho_c =  new float[w*h]();
+    ofStuff->tvl2.grad =  new float[w*h]();
+    ofStuff->tvl2.u1_ =  new float[w*h]();
+    ofStuff->tvl2.u2_ =  new float[w*h]();
+    ofStuff->tvl2.u1Aux = new float[w*h]();
+    ofStuff->tvl2.u2Aux = new float[w*h]();
+    ofStuff->tvl2.I1x = new float[w*h]();
+    ofStuff->tvl2.I1y = new float[w*h]();
+    ofStuff->tvl2.I1w = new float[w*h]();
+    ofStuff->tvl2.I1wx = new float[w*h]();
+    ofStuff->tvl2.I1wy = new float[w*h]();
+    ofStuff->tvl2.div_xi1 = new float[w*h]();
+    ofStuff->tvl2.div_xi2 = new float[w*h]();
+    ofStuff->tvl2.u_N = new float[w*h]();
 }
 
 void  free_stuff_tvl2coupled(SpecificOFStuff *ofStuff){
@@ -34,73 +34,73 @@ void  initialize_stuff_tvl2coupled_occ(
         const int h)
 {
     // Occlusion variable
-    ofStuff.tvl2_occ.chix = new float[w*h];
-    ofStuff.tvl2_occ.chiy = new float[w*h];
+    ofStuff.tvl2_occ.chix = new float[w*h]();
+    ofStuff.tvl2_occ.chiy = new float[w*h]();
 
-    ofStuff.tvl2_occ.diff_u_N = new float[w*h];
+    ofStuff.tvl2_occ.diff_u_N = new float[w*h]();
     // Weight
-    ofStuff.tvl2_occ.g = new float[w*h];
+    ofStuff.tvl2_occ.g = new float[w*h]();
 
     // Dual variables
-    ofStuff.tvl2_occ.xi11 = new float[w*h];
-    ofStuff.tvl2_occ.xi12 = new float[w*h];
-    ofStuff.tvl2_occ.xi21 = new float[w*h];
-    ofStuff.tvl2_occ.xi22 = new float[w*h];
+    ofStuff.tvl2_occ.xi11 = new float[w*h]();
+    ofStuff.tvl2_occ.xi12 = new float[w*h]();
+    ofStuff.tvl2_occ.xi21 = new float[w*h]();
+    ofStuff.tvl2_occ.xi22 = new float[w*h]();
 
-    ofStuff.tvl2_occ.u1x = new float[w*h];
-    ofStuff.tvl2_occ.u1y = new float[w*h];
-    ofStuff.tvl2_occ.u2x = new float[w*h];
-    ofStuff.tvl2_occ.u2y = new float[w*h];
+    ofStuff.tvl2_occ.u1x = new float[w*h]();
+    ofStuff.tvl2_occ.u1y = new float[w*h]();
+    ofStuff.tvl2_occ.u2x = new float[w*h]();
+    ofStuff.tvl2_occ.u2y = new float[w*h]();
 
-    ofStuff.tvl2_occ.v1 = new float[w*h];
-    ofStuff.tvl2_occ.v2 = new float[w*h];
+    ofStuff.tvl2_occ.v1 = new float[w*h]();
+    ofStuff.tvl2_occ.v2 = new float[w*h]();
 
-    ofStuff.tvl2_occ.rho_c1 = new float[w*h];
-    ofStuff.tvl2_occ.rho_c_1 = new float[w*h];
-    ofStuff.tvl2_occ.grad_1 = new float[w*h];
-    ofStuff.tvl2_occ.grad__1 = new float[w*h];
+    ofStuff.tvl2_occ.rho_c1 = new float[w*h]();
+    ofStuff.tvl2_occ.rho_c_1 = new float[w*h]();
+    ofStuff.tvl2_occ.grad_1 = new float[w*h]();
+    ofStuff.tvl2_occ.grad__1 = new float[w*h]();
 
     if (ofCore.params.step_algorithm == GLOBAL_STEP) {
-        ofStuff.tvl2_occ.I0x = new float[w*h];
-        ofStuff.tvl2_occ.I0y = new float[w*h];
+        ofStuff.tvl2_occ.I0x = new float[w*h]();
+        ofStuff.tvl2_occ.I0y = new float[w*h]();
     } else {
         ofStuff.tvl2_occ.I0x = nullptr;
         ofStuff.tvl2_occ.I0y = nullptr;
     }
 
-    ofStuff.tvl2_occ.I1x = new float[w*h];
-    ofStuff.tvl2_occ.I1y = new float[w*h];
-    ofStuff.tvl2_occ.I1w = new float[w*h];
-    ofStuff.tvl2_occ.I1wx = new float[w*h];
-    ofStuff.tvl2_occ.I1wy = new float[w*h];
-
-    ofStuff.tvl2_occ.I_1x = new float[w*h];
-    ofStuff.tvl2_occ.I_1y = new float[w*h];
-    ofStuff.tvl2_occ.I_1w = new float[w*h];
-    ofStuff.tvl2_occ.I_1wx = new float[w*h];
-    ofStuff.tvl2_occ.I_1wy = new float[w*h];
-
-    ofStuff.tvl2_occ.vi_div1 = new float[w*h];
-    ofStuff.tvl2_occ.grad_x1 = new float[w*h];
-    ofStuff.tvl2_occ.grad_y1 = new float[w*h];
-    ofStuff.tvl2_occ.vi_div2 = new float[w*h];
-    ofStuff.tvl2_occ.grad_x2 = new float[w*h];
-    ofStuff.tvl2_occ.grad_y2 = new float[w*h];
-    ofStuff.tvl2_occ.g_xi11 = new float[w*h];
-    ofStuff.tvl2_occ.g_xi12 = new float[w*h];
-    ofStuff.tvl2_occ.g_xi21 = new float[w*h];
-    ofStuff.tvl2_occ.g_xi22 = new float[w*h];
-    ofStuff.tvl2_occ.div_g_xi1 = new float[w*h];
-    ofStuff.tvl2_occ.div_g_xi2 = new float[w*h];
-    ofStuff.tvl2_occ.eta1 = new float[w*h];
-    ofStuff.tvl2_occ.eta2 = new float[w*h];
-    ofStuff.tvl2_occ.F = new float[w*h];
-    ofStuff.tvl2_occ.G = new float[w*h];
-
-    ofStuff.tvl2_occ.div_u = new float[w*h];
-    ofStuff.tvl2_occ.g_eta1 = new float[w*h];
-    ofStuff.tvl2_occ.g_eta2 = new float[w*h];
-    ofStuff.tvl2_occ.div_g_eta = new float[w*h];
+    ofStuff.tvl2_occ.I1x = new float[w*h]();
+    ofStuff.tvl2_occ.I1y = new float[w*h]();
+    ofStuff.tvl2_occ.I1w = new float[w*h]();
+    ofStuff.tvl2_occ.I1wx = new float[w*h]();
+    ofStuff.tvl2_occ.I1wy = new float[w*h]();
+
+    ofStuff.tvl2_occ.I_1x = new float[w*h]();
+    ofStuff.tvl2_occ.I_1y = new float[w*h]();
+    ofStuff.tvl2_occ.I_1w = new float[w*h]();
+    ofStuff.tvl2_occ.I_1wx = new float[w*h]();
+    ofStuff.tvl2_occ.I_1wy = new float[w*h]();
+
+    ofStuff.tvl2_occ.vi_div1 = new float[w*h]();
+    ofStuff.tvl2_occ.grad_x1 = new float[w*h]();
+    ofStuff.tvl2_occ.grad_y1 = new float[w*h]();
+    ofStuff.tvl2_occ.vi_div2 = new float[w*h]();
+    ofStuff.tvl2_occ.grad_x2 = new float[w*h]();
+    ofStuff.tvl2_occ.grad_y2 = new float[w*h]();
+    ofStuff.tvl2_occ.g_xi11 = new float[w*h]();
+    ofStuff.tvl2_occ.g_xi12 = new float[w*h]();
+    ofStuff.tvl2_occ.g_xi21 = new float[w*h]();
+    ofStuff.tvl2_occ.g_xi22 = new float[w*h]();
+    ofStuff.tvl2_occ.div_g_xi1 = new float[w*h]();
+    ofStuff.tvl2_occ.div_g_xi2 = new float[w*h]();
+    ofStuff.tvl2_occ.eta1 = new float[w*h]();
+    ofStuff.tvl2_occ.eta2 = new float[w*h]();
+    ofStuff.tvl2_occ.F = new float[w*h]();
+    ofStuff.tvl2_occ.G = new float[w*h]();
+
+    ofStuff.tvl2_occ.div_u = new float[w*h]();
+    ofStuff.tvl2_occ.g_eta1 = new float[w*h]();
+    ofStuff.tvl2_occ.g_eta2 = new float[w*h]();
+    ofStuff.tvl2_occ.div_g_eta = new float[w*h]();
 }
 
 void  free_stuff_tvl2coupled_occ(SpecificOFStuff *ofStuff){
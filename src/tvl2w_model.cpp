@@ -20,31 +20,31 @@ void  initialize_stuff_tvl2coupled_w(
 
 {
     //fprintf(stderr, "W x H :%d x %d\n", w, h);
-    ofStuff->tvl2w.weight = new float[ofCore->params.w_radio*2 + 1];
-    ofStuff->tvl2w.xi11 = new float[w*h];
-    ofStuff->tvl2w.xi12 = new float[w*h];
-    ofStuff->tvl2w.xi21 = new float[w*h];
-    ofStuff->tvl2w.xi22 = new float[w*h];
-    ofStuff->tvl2w.u1x = new float[w*h];
-    ofStuff->tvl2w.u1y = new float[w*h];
-    ofStuff->tvl2w.u2x = new float[w*h];
-    ofStuff->tvl2w.u2y = new float[w*h];
-    ofStuff->tvl2w.v1 =  new float[w*h];
-    ofStuff->tvl2w.v2 =  new float[w*h];
-    ofStuff->tvl2w.rho_c =  new float[w*h];
-    ofStuff->tvl2w.grad =  new float[w*h];
-    ofStuff->tvl2w.u1_ =  new float[w*h];
-    ofStuff->tvl2w.u2_ =  new float[w*h];
-    ofStuff->tvl2w.u1Aux = new float[w*h];
-    ofStuff->tvl2w.u2Aux = new float[w*h];
-    ofStuff->tvl2w.I1x = new float[w*h];
-    ofStuff->tvl2w.I1y = new float[w*h];
-    ofStuff->tvl2w.I1w = new float[w*h];
-    ofStuff->tvl2w.I1wx = new float[w*h];
-    ofStuff->tvl2w.I1wy = new float[w*h];
-    ofStuff->tvl2w.div_xi1 = new float[w*h];
-    ofStuff->tvl2w.div_xi2 = new float[w*h];
-    ofStuff->tvl2w.u_N = new float[w*h];
+    ofStuff->tvl2w.weight = new float[ofCore->params.w_radio*2 + 1]();
+    ofStuff->tvl2w.xi11 = new float[w*h]();
+    ofStuff->tvl2w.xi12 = new float[w*h]();
+    ofStuff->tvl2w.xi21 = new float[w*h]();
+    ofStuff->tvl2w.xi22 = new float[w*h]();
+    ofStuff->tvl2w.u1x = new float[w*h]();
+    ofStuff->tvl2w.u1y = new float[w*h]();
+    ofStuff->tvl2w.u2x = new float[w*h]();
+    ofStuff->tvl2w.u2y = new float[w*h]();
+    ofStuff->tvl2w.v1 =  new float[w*h]();
+    ofStuff->tvl2w.v2 =  new float[w*h]();
+    ofStuff->tvl2w.rho_c =  new float[w*h]();
+    ofStuff->tvl2w.grad =  new float[w*h]();
+    ofStuff->tvl2w.u1_ =  new float[w*h]();
+    ofStuff->tvl2w.u2_ =  new float[w*h]();
+    ofStuff->tvl2w.u1Aux = new float[w*h]();
+    ofStuff->tvl2w.u2Aux = new float[w*h]();
+    ofStuff->tvl2w.I1x = new float[w*h]();
+    ofStuff->tvl2w.I1y = new float[w*h]();
+    ofStuff->tvl2w.I1w = new float[w*h]();
+    ofStuff->tvl2w.I1wx = new float[w*h]();
+    ofStuff->tvl2w.I1wy = new float[w*h]();
+    ofStuff->tvl2w.div_xi1 = new float[w*h]();
+    ofStuff->tvl2w.div_xi2 = new float[w*h]();
+    ofStuff->tvl2w.u_N = new float[w*h]();
 }
 
 void  free_stuff_tvl2coupled_w(SpecificOFStuff *ofStuff){
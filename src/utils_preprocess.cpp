@@ -1,10 +1,13 @@
 #include "string"
 #include "parameters.h"
 #include "energy_structures.h"
+#include "match_file.h"
 #include <wordexp.h>
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 
 bool pick_option(std::vector<std::string>& args, const std::string& option){
@@ -124,3 +127,19 @@ Parameters init_params(const std::string& file_params, int step_alg){
     }
     return params;
 }
+
+bool read_match_list(const std::string& filename, std::vector<float>& matches){
+    //Colum I0, Row I0, Colum I1, Row I1 (text list or binary match file)
+    MatchFile file;
+    if (!file.open(filename, MATCH_LAYOUT_CUT))
+        return false;
+    matches.reserve(matches.size() + 4 * file.size());
+    for (size_t m = 0; m < file.size(); m++){
+        const MatchRecord &r = file.data()[m];
+        matches.push_back(r.x0);
+        matches.push_back(r.y0);
+        matches.push_back(r.x1);
+        matches.push_back(r.y1);
+    }
+    return true;
+}
@@ -2,9 +2,16 @@
 #define UTILS_PREPROCESS_H
 
 #include "string"
+#include <vector>
+#include "energy_structures.h"
 
 bool pick_option(std::vector<std::string>& args, const std::string& option);
 std::string pick_option(std::vector<std::string>& args, const std::string& option, const std::string& default_value);
 Parameters init_params(const std::string& file_params, int step_alg);
 std::string path_abs2rel(std::string& option);
+
+// Reads a match list, one "x0 y0 x1 y1" line (column and row in I0 and I1) per match, or a
+// binary match file (match_file.h). Returns false if the file cannot be opened
+bool read_match_list(const std::string& filename, std::vector<float>& matches);
+
 #endif // UTILS_PREPROCESS_H